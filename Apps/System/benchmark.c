@@ -0,0 +1,317 @@
+/* benchmark.c
+ * Times the neographics drawing primitives
+ * RebbleOS
+ */
+
+#include "rebbleos.h"
+#include "benchmark.h"
+#include "ngfxwrap.h"
+#include "graphics_wrapper.h"
+
+/*
+ * Each benchmark is run over and over for at least BENCH_MIN_TICKS,
+ * timed with the cycle counter, and reported as pixels per second and CPU
+ * cycles per pixel.
+ * It then gets drawn once more on a clean screen and the framebuffer is
+ * checksummed. If an optimisation changes the checksum, it changed the
+ * output too.
+ *
+ * The results go to the log. Runs the same on colour and BW, and under
+ * the simulator.
+ *
+ * One benchmark is run per app timer, straight into the framebuffer, so
+ * nothing blocks in the layer update_proc and the rest of the system
+ * gets a go in between.
+ */
+
+/* short enough to keep the watchdog fed */
+#define BENCH_MIN_TICKS pdMS_TO_TICKS(100)
+
+/* gap between benchmarks */
+#define BENCH_SPACING_MS 10
+
+const char *benchmark_name = "Benchmark";
+
+typedef void (*bench_func)(n_GContext *ctx, uint16_t size);
+
+typedef struct {
+    const char *name;
+    bench_func func;
+    uint16_t size;
+    uint32_t pixels; // pixels drawn per call, near enough
+} bench_t;
+
+static Window *s_main_window;
+static Layer *s_bench_layer;
+static AppTimer *s_bench_timer;
+static uint8_t s_bench_next;
+static GFont s_font;
+static GBitmap *s_bitmap;
+
+static n_GPoint s_star[] = {
+    { 0, -10 }, { 3, -3 }, { 10, -3 }, { 4, 2 }, { 6, 10 },
+    { 0, 5 }, { -6, 10 }, { -4, 2 }, { -10, -3 }, { -3, -3 },
+};
+#define STAR_POINTS (sizeof(s_star) / sizeof(s_star[0]))
+
+static void _bench_fill_rect(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_fill_rect(ctx, n_GRect(0, 0, size, size), 0, n_GCornerNone);
+}
+
+static void _bench_line(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_context_set_stroke_width(ctx, 1);
+    n_graphics_draw_line(ctx, n_GPoint(0, 0), n_GPoint(size, size / 2));
+}
+
+static void _bench_thick_line(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_context_set_stroke_width(ctx, 5);
+    n_graphics_draw_line(ctx, n_GPoint(4, 4), n_GPoint(size, size / 2));
+    n_graphics_context_set_stroke_width(ctx, 1);
+}
+
+static void _bench_fill_circle(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_fill_circle(ctx, n_GPoint(size, size), size);
+}
+
+static void _bench_draw_circle(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_draw_circle(ctx, n_GPoint(size, size), size);
+}
+
+static void _bench_fill_path(n_GContext *ctx, uint16_t size)
+{
+    n_GPoint points[STAR_POINTS];
+
+    // size is the star's width in pixels
+    for (uint8_t i = 0; i < STAR_POINTS; i++)
+        points[i] = n_GPoint(size / 2 + s_star[i].x * size / 20,
+                             size / 2 + s_star[i].y * size / 20);
+
+    n_graphics_fill_path(ctx, STAR_POINTS, points);
+}
+
+static void _bench_text(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_draw_text(ctx, "The quick brown fox jumps over the lazy dog", s_font,
+                         n_GRect(0, 0, size, size), n_GTextOverflowModeWordWrap,
+                         n_GTextAlignmentLeft, NULL);
+}
+
+static void _bench_bitmap(n_GContext *ctx, uint16_t size)
+{
+    if (s_bitmap)
+        graphics_draw_bitmap_in_rect(ctx, s_bitmap, GRect(0, 0, size, size));
+}
+
+static const bench_t _benchmarks[] = {
+    { "fill_rect",   _bench_fill_rect,   8,   8 * 8 },
+    { "fill_rect",   _bench_fill_rect,   32,  32 * 32 },
+    { "fill_rect",   _bench_fill_rect,   DISPLAY_COLS, DISPLAY_COLS * DISPLAY_COLS },
+    { "line_1px",    _bench_line,        16,  16 },
+    { "line_1px",    _bench_line,        128, 128 },
+    { "line_5px",    _bench_thick_line,  128, 128 * 5 },
+    { "fill_circle", _bench_fill_circle, 8,   8 * 8 * 355 / 113 },
+    { "fill_circle", _bench_fill_circle, 60,  60 * 60 * 355 / 113 },
+    { "draw_circle", _bench_draw_circle, 8,   2 * 8 * 355 / 113 },
+    { "draw_circle", _bench_draw_circle, 60,  2 * 60 * 355 / 113 },
+    { "fill_path",   _bench_fill_path,   40,  40 * 40 * 2 / 5 },
+    { "fill_path",   _bench_fill_path,   140, 140 * 140 * 2 / 5 },
+    { "draw_text",   _bench_text,        DISPLAY_COLS, DISPLAY_COLS * 80 },
+    { "bitmap",      _bench_bitmap,      25,  25 * 25 },
+};
+#define BENCH_COUNT (sizeof(_benchmarks) / sizeof(_benchmarks[0]))
+
+/*
+ * FNV-1a over the whole framebuffer
+ */
+static uint32_t _bench_checksum(void)
+{
+    uint8_t *fb = display_get_buffer();
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t i = 0; i < __SCREEN_FRAMEBUFFER_ROW_BYTE_AMOUNT * __SCREEN_HEIGHT; i++)
+        hash = (hash ^ fb[i]) * 16777619u;
+
+    return hash;
+}
+
+static void _bench_clear(n_GContext *ctx)
+{
+    n_graphics_context_set_fill_color(ctx, GColorWhite);
+    n_graphics_fill_rect(ctx, n_GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS), 0, n_GCornerNone);
+    n_graphics_context_set_fill_color(ctx, GColorBlack);
+    n_graphics_context_set_stroke_color(ctx, GColorBlack);
+    n_graphics_context_set_text_color(ctx, GColorBlack);
+}
+
+static void _bench_run(n_GContext *ctx, const bench_t *bench)
+{
+    uint32_t calls = 0, cycles;
+    TickType_t start;
+
+    _bench_clear(ctx);
+
+    start = xTaskGetTickCount();
+    cycles = rcore_cycles();
+    do
+    {
+        bench->func(ctx, bench->size);
+        calls++;
+    } while (xTaskGetTickCount() - start < BENCH_MIN_TICKS);
+    cycles = rcore_cycles() - cycles;
+
+    _bench_clear(ctx);
+    bench->func(ctx, bench->size);
+
+    uint64_t pixels = (uint64_t)bench->pixels * calls;
+    uint64_t us = rcore_cycles_to_us(cycles);
+    uint32_t px_per_sec = (uint32_t)(pixels * 1000000 / us);
+    // in tenths, so we get a decimal place
+    uint32_t cycles_per_px = (uint32_t)((uint64_t)cycles * 10 / pixels);
+
+    SYS_LOG("bench", APP_LOG_LEVEL_INFO, "%s %d: %d px/s %d.%d cyc/px sum %x",
+            bench->name, bench->size, px_per_sec,
+            cycles_per_px / 10, cycles_per_px % 10, _bench_checksum());
+}
+
+/*
+ * Decode the PNG over and over, from flash to bitmap. The checksum is of
+ * the decoded pixels, so a decoder change that alters the image shows too
+ */
+static void _bench_png_decode(void)
+{
+    uint32_t decodes = 0, cycles;
+    TickType_t start, elapsed;
+    GBitmap *bitmap;
+
+    start = xTaskGetTickCount();
+    cycles = rcore_cycles();
+    do
+    {
+        bitmap = gbitmap_create_with_resource(RESOURCE_ID_SYSTEM_ICON);
+        if (!bitmap)
+        {
+            SYS_LOG("bench", APP_LOG_LEVEL_ERROR, "png_decode: no bitmap");
+            return;
+        }
+        decodes++;
+        elapsed = xTaskGetTickCount() - start;
+        if (elapsed < BENCH_MIN_TICKS)
+            gbitmap_destroy(bitmap);
+    } while (elapsed < BENCH_MIN_TICKS);
+    cycles = rcore_cycles() - cycles;
+
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < bitmap->row_size_bytes * bitmap->raw_bitmap_size.h; i++)
+        hash = (hash ^ bitmap->addr[i]) * 16777619u;
+
+    uint32_t pixels = bitmap->raw_bitmap_size.w * bitmap->raw_bitmap_size.h;
+    uint64_t us = rcore_cycles_to_us(cycles);
+
+    SYS_LOG("bench", APP_LOG_LEVEL_INFO, "png_decode %dx%d: %d us/decode %d px/s sum %x",
+            bitmap->raw_bitmap_size.w, bitmap->raw_bitmap_size.h,
+            (uint32_t)(us / decodes), (uint32_t)((uint64_t)pixels * decodes * 1000000 / us), hash);
+
+    gbitmap_destroy(bitmap);
+}
+
+/*
+ * Run the next benchmark, then come back for the one after
+ */
+static void _bench_step(void *data)
+{
+    n_GContext *nctx = rwatch_neographics_get_global_context();
+    n_GRect offset = nctx->offset;
+    
+    s_bench_timer = NULL;
+    
+    // we aren't inside a layer, so draw from the top left of the screen
+    nctx->offset = n_GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+    
+    if (s_bench_next == 0)
+    {
+#ifdef PBL_BW
+        SYS_LOG("bench", APP_LOG_LEVEL_INFO, "Running %d benchmarks, 1bpp", (int)BENCH_COUNT);
+#else
+        SYS_LOG("bench", APP_LOG_LEVEL_INFO, "Running %d benchmarks, 8bpp", (int)BENCH_COUNT);
+#endif
+    }
+    
+    if (s_bench_next < BENCH_COUNT)
+        _bench_run(nctx, &_benchmarks[s_bench_next]);
+    else
+        _bench_png_decode();
+    s_bench_next++;
+    
+    nctx->offset = offset;
+    
+    if (s_bench_next <= BENCH_COUNT)
+        s_bench_timer = app_timer_register(BENCH_SPACING_MS, _bench_step, NULL);
+    
+    // put our own screen back over whatever got drawn
+    layer_mark_dirty(s_bench_layer);
+}
+
+static void _bench_update_proc(Layer *layer, GContext *ctx)
+{
+    n_GContext *nctx = rwatch_neographics_get_global_context();
+    char *msg = s_bench_next > BENCH_COUNT ? "Benchmark done.\nResults are in the log."
+                                           : "Benchmark running...";
+
+    _bench_clear(nctx);
+    n_graphics_draw_text(nctx, msg, s_font,
+                         n_GRect(4, 60, DISPLAY_COLS - 8, 60), n_GTextOverflowModeWordWrap,
+                         n_GTextAlignmentCenter, NULL);
+}
+
+static void benchmark_window_load(Window *window)
+{
+    Layer *window_layer = window_get_root_layer(window);
+
+    s_font = fonts_get_system_font(FONT_KEY_GOTHIC_18);
+    s_bitmap = gbitmap_create_with_resource(RESOURCE_ID_SYSTEM_ICON);
+    s_bench_next = 0;
+
+    s_bench_layer = layer_create(GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS));
+    layer_set_update_proc(s_bench_layer, _bench_update_proc);
+    layer_add_child(window_layer, s_bench_layer);
+    
+    s_bench_timer = app_timer_register(BENCH_SPACING_MS, _bench_step, NULL);
+}
+
+static void benchmark_window_unload(Window *window)
+{
+    if (s_bench_timer)
+        app_timer_cancel(s_bench_timer);
+    layer_destroy(s_bench_layer);
+    if (s_bitmap)
+        gbitmap_destroy(s_bitmap);
+}
+
+void benchmark_init(void)
+{
+    s_main_window = window_create();
+
+    window_set_window_handlers(s_main_window, (WindowHandlers) {
+        .load = benchmark_window_load,
+        .unload = benchmark_window_unload,
+    });
+
+    window_stack_push(s_main_window, true);
+}
+
+void benchmark_deinit(void)
+{
+    window_destroy(s_main_window);
+}
+
+void benchmark_main(void)
+{
+    benchmark_init();
+    app_event_loop();
+    benchmark_deinit();
+}
@@ -0,0 +1,10 @@
+#pragma once
+/* benchmark.h
+ *
+ * RebbleOS
+ */
+
+#include "rebbleos.h"
+#include "librebble.h"
+
+void benchmark_main(void);
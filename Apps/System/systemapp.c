@@ -18,7 +18,7 @@ const char *systemapp_name = "System";
 static Window *s_main_window;
 static Menu *s_menu;
 
-StatusBarLayer *status_bar;
+static StatusBarLayer *status_bar;
 
 typedef struct {
     uint8_t hours;
@@ -53,6 +53,24 @@ static MenuItems* run_test_item_selected(const MenuItem *item)
     return NULL;
 }
 
+static MenuItems* benchmark_item_selected(const MenuItem *item)
+{
+    appmanager_app_start("Benchmark");
+    return NULL;
+}
+
+static MenuItems* sleep_stats_item_selected(const MenuItem *item)
+{
+    power_dump_sleep_stats();
+    return NULL;
+}
+
+static MenuItems* flash_stats_item_selected(const MenuItem *item)
+{
+    flash_cache_dump_stats();
+    return NULL;
+}
+
 static MenuItems* notification_item_selected(const MenuItem *item)
 {
     appmanager_app_start("Notification");
@@ -101,10 +119,13 @@ static void systemapp_window_load(Window *window)
 
     menu_set_click_config_onto_window(s_menu, window);
 
-    MenuItems *items = menu_items_create(4);
+    MenuItems *items = menu_items_create(7);
     menu_items_add(items, MenuItem("Watchfaces", "All your faces", 25, watch_list_item_selected));
     menu_items_add(items, MenuItem("Settings", "Move Along", 24, test_item_selected));
     menu_items_add(items, MenuItem("Tests", NULL, 25, run_test_item_selected));
+    menu_items_add(items, MenuItem("Benchmark", "Graphics speed", 25, benchmark_item_selected));
+    menu_items_add(items, MenuItem("Sleep Stats", "Log time asleep", 25, sleep_stats_item_selected));
+    menu_items_add(items, MenuItem("Flash Stats", "Log cache hits", 25, flash_stats_item_selected));
     menu_items_add(items, MenuItem("RebbleOS", "... v0.0.0.1", 24, NULL));
     menu_set_items(s_menu, items);
 
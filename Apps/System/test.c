@@ -17,7 +17,7 @@ const char *test_name = "Test";
 static Window *s_main_window;
 
 ActionBarLayer *action_bar;
-StatusBarLayer *status_bar;
+static StatusBarLayer *status_bar;
 
 typedef struct {
     uint8_t hours;
@@ -61,7 +61,7 @@ static void test_window_load(Window *window)
     action_bar = action_bar_layer_create();
     
     // Set the icons
-    GBitmap *icon1 = gbitmap_create_with_resource(21);
+    GBitmap *icon1 = gbitmap_create_with_resource(RESOURCE_ID_SYSTEM_ICON);
     GBitmap *icon2 = gbitmap_create_with_resource(25);
     GBitmap *icon3 = gbitmap_create_with_resource(22);
     action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, icon1);
@@ -0,0 +1,328 @@
+/* port.c
+ * FreeRTOS port for POSIX hosts, for the RebbleOS simulator
+ * RebbleOS
+ *
+ * Each task runs on its own pthread, but only one at a time: the task
+ * FreeRTOS has as pxCurrentTCB. Switching tasks wakes the next thread and
+ * puts the current one to sleep on its condition variable.
+ *
+ * The tick is SIGALRM from an interval timer. The running task is the only
+ * thread that ever has SIGALRM unblocked, so the tick "interrupts" it, and
+ * blocking SIGALRM is how we disable interrupts. Every other thread
+ * (main, and tasks that aren't running) keeps it blocked.
+ *
+ * Threads get their stacks from the host; the FreeRTOS stack only holds
+ * the thread's bookkeeping at its top. Like any interrupt, the tick can
+ * land in the middle of libc, so calls that take libc locks (stdio,
+ * localtime, malloc) want to be in a critical section.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+typedef struct
+{
+	pthread_t xThread;
+	pthread_mutex_t xMutex;
+	pthread_cond_t xCond;
+	BaseType_t xRunnable;
+	BaseType_t xDying;
+	TaskFunction_t pxCode;
+	void *pvParameters;
+} Thread_t;
+
+static UBaseType_t uxCriticalNesting = 0;
+
+/* where xPortStartScheduler waits, in case the scheduler is ended */
+static Thread_t xSchedulerThread;
+
+/*-----------------------------------------------------------*/
+
+/*
+ * The thread lives at the top of the task's stack, just above where
+ * pxTopOfStack (the first member of the TCB) points.
+ */
+static Thread_t *prvGetThreadFromTask( void *pvTask )
+{
+StackType_t *pxTopOfStack = *( StackType_t ** ) pvTask;
+
+	return ( Thread_t * ) ( pxTopOfStack + 1 );
+}
+
+static void prvThreadInit( Thread_t *pxThread )
+{
+	pthread_mutex_init( &pxThread->xMutex, NULL );
+	pthread_cond_init( &pxThread->xCond, NULL );
+	pxThread->xRunnable = pdFALSE;
+	pxThread->xDying = pdFALSE;
+}
+
+static void prvResumeThread( Thread_t *pxThread )
+{
+	pthread_mutex_lock( &pxThread->xMutex );
+	pxThread->xRunnable = pdTRUE;
+	pthread_cond_signal( &pxThread->xCond );
+	pthread_mutex_unlock( &pxThread->xMutex );
+}
+
+static void prvSuspendSelf( Thread_t *pxThread )
+{
+BaseType_t xDying;
+
+	pthread_mutex_lock( &pxThread->xMutex );
+	while( pxThread->xRunnable == pdFALSE && pxThread->xDying == pdFALSE )
+	{
+		pthread_cond_wait( &pxThread->xCond, &pxThread->xMutex );
+	}
+	pxThread->xRunnable = pdFALSE;
+	xDying = pxThread->xDying;
+	pthread_mutex_unlock( &pxThread->xMutex );
+
+	if( xDying != pdFALSE )
+	{
+		pthread_exit( NULL );
+	}
+}
+
+/*
+ * Hand over to pxThreadToResume, and sleep until we are switched back to.
+ * The critical nesting belongs to whichever task is running, so ours is
+ * put back when we wake.
+ */
+static void prvSwitchThread( Thread_t *pxThreadToResume, Thread_t *pxThreadToSuspend )
+{
+UBaseType_t uxSavedCriticalNesting;
+
+	if( pxThreadToResume != pxThreadToSuspend )
+	{
+		uxSavedCriticalNesting = uxCriticalNesting;
+		prvResumeThread( pxThreadToResume );
+		prvSuspendSelf( pxThreadToSuspend );
+		uxCriticalNesting = uxSavedCriticalNesting;
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvBlockTick( sigset_t *pxOld )
+{
+sigset_t xTick;
+
+	sigemptyset( &xTick );
+	sigaddset( &xTick, SIGALRM );
+	pthread_sigmask( SIG_BLOCK, &xTick, pxOld );
+}
+
+void vPortDisableInterrupts( void )
+{
+	prvBlockTick( NULL );
+}
+
+void vPortEnableInterrupts( void )
+{
+sigset_t xTick;
+
+	sigemptyset( &xTick );
+	sigaddset( &xTick, SIGALRM );
+	pthread_sigmask( SIG_UNBLOCK, &xTick, NULL );
+}
+
+UBaseType_t uxPortSetInterruptMask( void )
+{
+sigset_t xOld;
+
+	prvBlockTick( &xOld );
+	return sigismember( &xOld, SIGALRM );
+}
+
+void vPortClearInterruptMask( UBaseType_t uxMask )
+{
+	if( uxMask == 0 )
+	{
+		vPortEnableInterrupts();
+	}
+}
+
+void vPortEnterCritical( void )
+{
+	if( uxCriticalNesting == 0 )
+	{
+		vPortDisableInterrupts();
+	}
+	uxCriticalNesting++;
+}
+
+void vPortExitCritical( void )
+{
+	uxCriticalNesting--;
+	if( uxCriticalNesting == 0 )
+	{
+		vPortEnableInterrupts();
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void *prvThreadStart( void *pvParameters )
+{
+Thread_t *pxThread = ( Thread_t * ) pvParameters;
+
+	/* wait to be scheduled for the first time */
+	prvSuspendSelf( pxThread );
+
+	uxCriticalNesting = 0;
+	vPortEnableInterrupts();
+
+	pxThread->pxCode( pxThread->pvParameters );
+
+	/* tasks shouldn't return, but if one does it is gone */
+	vTaskDelete( NULL );
+
+	return NULL;
+}
+
+StackType_t *pxPortInitialiseStack( StackType_t *pxTopOfStack, TaskFunction_t pxCode, void *pvParameters )
+{
+Thread_t *pxThread;
+pthread_attr_t xAttr;
+sigset_t xOld;
+
+	pxThread = ( Thread_t * ) ( ( ( portPOINTER_SIZE_TYPE ) ( pxTopOfStack + 1 ) - sizeof( Thread_t ) ) & ~( portPOINTER_SIZE_TYPE ) 15 );
+	prvThreadInit( pxThread );
+	pxThread->pxCode = pxCode;
+	pxThread->pvParameters = pvParameters;
+
+	/* new threads start with the tick blocked, and pthread_create takes
+	 * libc locks the tick mustn't land in */
+	prvBlockTick( &xOld );
+
+	pthread_attr_init( &xAttr );
+	pthread_create( &pxThread->xThread, &xAttr, prvThreadStart, pxThread );
+	pthread_attr_destroy( &xAttr );
+
+	pthread_sigmask( SIG_SETMASK, &xOld, NULL );
+
+	return ( StackType_t * ) pxThread - 1;
+}
+
+void vPortCancelThread( void *pxTaskToDelete )
+{
+Thread_t *pxThread = prvGetThreadFromTask( pxTaskToDelete );
+sigset_t xOld;
+
+	prvBlockTick( &xOld );
+
+	pthread_mutex_lock( &pxThread->xMutex );
+	pxThread->xDying = pdTRUE;
+	pthread_cond_signal( &pxThread->xCond );
+	pthread_mutex_unlock( &pxThread->xMutex );
+
+	pthread_join( pxThread->xThread, NULL );
+	pthread_mutex_destroy( &pxThread->xMutex );
+	pthread_cond_destroy( &pxThread->xCond );
+
+	pthread_sigmask( SIG_SETMASK, &xOld, NULL );
+}
+/*-----------------------------------------------------------*/
+
+void vPortYield( void )
+{
+Thread_t *pxThreadToSuspend, *pxThreadToResume;
+
+	vPortEnterCritical();
+
+	pxThreadToSuspend = prvGetThreadFromTask( xTaskGetCurrentTaskHandle() );
+	vTaskSwitchContext();
+	pxThreadToResume = prvGetThreadFromTask( xTaskGetCurrentTaskHandle() );
+	prvSwitchThread( pxThreadToResume, pxThreadToSuspend );
+
+	vPortExitCritical();
+}
+
+static void prvTickHandler( int iSignal )
+{
+Thread_t *pxThreadToSuspend, *pxThreadToResume;
+
+	( void ) iSignal;
+
+	/* SIGALRM is blocked while we are in here */
+	uxCriticalNesting++;
+
+	if( xTaskIncrementTick() != pdFALSE )
+	{
+		pxThreadToSuspend = prvGetThreadFromTask( xTaskGetCurrentTaskHandle() );
+		vTaskSwitchContext();
+		pxThreadToResume = prvGetThreadFromTask( xTaskGetCurrentTaskHandle() );
+		prvSwitchThread( pxThreadToResume, pxThreadToSuspend );
+	}
+
+	uxCriticalNesting--;
+}
+/*-----------------------------------------------------------*/
+
+#if configUSE_TICKLESS_IDLE != 0
+
+/*
+ * There is no saving in skipping ticks here, but there is in not spinning
+ * the host's CPU, so the idle task just sleeps until the next one.
+ */
+void vPortSuppressTicksAndSleep( TickType_t xExpectedIdleTime )
+{
+sigset_t xOld, xWait;
+
+	( void ) xExpectedIdleTime;
+
+	prvBlockTick( &xOld );
+
+	if( eTaskConfirmSleepModeStatus() != eAbortSleep )
+	{
+		xWait = xOld;
+		sigdelset( &xWait, SIGALRM );
+		sigsuspend( &xWait );
+	}
+
+	pthread_sigmask( SIG_SETMASK, &xOld, NULL );
+}
+
+#endif /* configUSE_TICKLESS_IDLE */
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortStartScheduler( void )
+{
+struct sigaction xAction;
+struct itimerval xTimer;
+
+	/* the tick only ever goes to the running task */
+	prvBlockTick( NULL );
+
+	memset( &xAction, 0, sizeof( xAction ) );
+	xAction.sa_handler = prvTickHandler;
+	xAction.sa_flags = SA_RESTART;
+	sigemptyset( &xAction.sa_mask );
+	sigaction( SIGALRM, &xAction, NULL );
+
+	xTimer.it_interval.tv_sec = 0;
+	xTimer.it_interval.tv_usec = 1000000 / configTICK_RATE_HZ;
+	xTimer.it_value = xTimer.it_interval;
+	setitimer( ITIMER_REAL, &xTimer, NULL );
+
+	prvThreadInit( &xSchedulerThread );
+	prvResumeThread( prvGetThreadFromTask( xTaskGetCurrentTaskHandle() ) );
+	prvSuspendSelf( &xSchedulerThread );
+
+	return 0;
+}
+
+void vPortEndScheduler( void )
+{
+struct itimerval xTimer;
+
+	memset( &xTimer, 0, sizeof( xTimer ) );
+	setitimer( ITIMER_REAL, &xTimer, NULL );
+
+	prvResumeThread( &xSchedulerThread );
+	prvSuspendSelf( prvGetThreadFromTask( xTaskGetCurrentTaskHandle() ) );
+}
@@ -0,0 +1,2 @@
+const char git_version[] __attribute__((section(".version_string.1"))) = "c367190";
+const char _easter_egg[] __attribute__((section(".version_string.2"))) = "Cuidado! Las llamas son muy peligrosas!";
@@ -125,6 +125,7 @@ SRCS_all += Apps/System/menu.c
 
 SRCS_all += Apps/System/test.c
 SRCS_all += Apps/System/notification.c
+SRCS_all += Apps/System/benchmark.c
 
 include hw/chip/stm32f4xx/config.mk
 include hw/chip/stm32f2xx/config.mk
@@ -134,3 +135,4 @@ include hw/platform/snowy_family/config.mk
 include hw/platform/snowy/config.mk
 include hw/platform/tintin/config.mk
 include hw/platform/chalk/config.mk
+include hw/platform/sim/config.mk
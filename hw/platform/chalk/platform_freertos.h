@@ -3,4 +3,9 @@
 
 #include "system_stm32f4xx.h"
 
+/* Stop the tick when idle and sleep on the RTC wakeup timer */
+#define configUSE_TICKLESS_IDLE 2
+void rtc_sleep(uint32_t idle_ticks);
+#define portSUPPRESS_TICKS_AND_SLEEP(idle_ticks) rtc_sleep(idle_ticks)
+
 #endif
@@ -0,0 +1,31 @@
+# Host-side (Linux) simulator.  This builds rcore, rwatch, neographics and
+# the built-in apps against the FreeRTOS POSIX port, with flash backed by an
+# image file and the display backed by an in-memory framebuffer, so that the
+# real code can be run natively under perf, gdb, valgrind, and friends.
+#
+# minilib is left out: the host's libc does its job, and minilib's headers
+# and its memcpy and printf would only shadow the host's.
+
+# Do not override this here!  Override this in localconfig.mk.
+FREERTOS_POSIX_PORT ?= FreeRTOS/portable/GCC/Posix
+HOSTCC ?= gcc
+
+CC_sim = $(HOSTCC)
+
+CFLAGS_sim = $(filter-out -mthumb -mlittle-endian -IFreeRTOS/portable/GCC/ARM_CM4F -Ilib/minilib/inc,$(CFLAGS_all))
+CFLAGS_sim += -I$(FREERTOS_POSIX_PORT)
+CFLAGS_sim += $(CFLAGS_driver_stm32_buttons)
+CFLAGS_sim += -Ihw/platform/sim
+CFLAGS_sim += -DREBBLE_PLATFORM=sim -DREBBLE_PLATFORM_SIM
+
+SRCS_sim = $(filter-out FreeRTOS/portable/GCC/ARM_CM4F/port.c lib/minilib/%,$(SRCS_all))
+SRCS_sim += $(FREERTOS_POSIX_PORT)/port.c
+SRCS_sim += hw/platform/sim/sim.c
+
+LDFLAGS_sim =
+LIBS_sim = -lpthread -lrt
+
+# The flash image that the simulator reads; the same SPI image that QEMU uses.
+SIMFLASH_sim ?= Resources/snowy_spi.bin
+
+HOST_PLATFORMS += sim
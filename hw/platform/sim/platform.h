@@ -0,0 +1,11 @@
+#pragma once
+/* platform.h
+ * Includes for rebble platform hardware (host simulator)
+ * RebbleOS
+ */
+
+#include "platform_config.h"
+#include "sim.h"
+#include "stm32_buttons.h"
+
+#include "debug.h"
@@ -0,0 +1,54 @@
+#pragma once
+/* platform_config.h
+ * Configuration file for the host simulator
+ * RebbleOS
+ *
+ * The flash layout matches snowy, so that a snowy SPI flash image can be
+ * used as the backing store.
+ */
+
+#define DISPLAY_ROWS 168
+#define DISPLAY_COLS 144
+
+//We are a square device
+#define PBL_RECT
+
+/* Size of the app + stack + heap of the running app. 
+   IN BYTES
+ */ 
+#define MAX_APP_MEMORY_SIZE     60000
+
+/* Size of the stack in WORDS */
+#define MAX_APP_STACK_SIZE      5000
+
+// flash regions
+#define REGION_PRF_START        0x200000
+#define REGION_PRF_SIZE         0x1000000
+// DO NOT WRITE TO THIS REGION
+#define REGION_MFG_START        0xE0000
+#define REGION_MFG_SIZE         0x20000
+// Resource start
+#define REGION_RES_START        0x380000
+#define REGION_RES_SIZE         0x7D000
+
+#define REGION_FS_START         0x400000
+#define REGION_FS_PAGE_SIZE     0x2000
+#define REGION_FS_N_PAGES       ((0x1000000 - REGION_FS_START) / REGION_FS_PAGE_SIZE)
+
+#define REGION_APP_RES_START    0xB3A000
+#define REGION_APP_RES_SIZE     0x7D000
+
+/* Flash read cache (rcore/flash.c): FLASH_CACHE_SETS x FLASH_CACHE_WAYS
+ * lines of FLASH_CACHE_LINE_SIZE bytes.  The line size must be a power of
+ * two.  Leave FLASH_CACHE_LINE_SIZE undefined to turn the cache off.
+ * Read-ahead stops at FLASH_SIZE, the end of the flash. */
+#define FLASH_CACHE_LINE_SIZE   256
+#define FLASH_CACHE_SETS        8
+#define FLASH_CACHE_WAYS        4
+#define FLASH_SIZE              0x1000000
+
+#define APP_RES_START           0x1000
+
+/* System resource table offset */
+#define RES_START               0x200C
+#define SPLASH_RESOURCE_ID      474
@@ -0,0 +1,12 @@
+#ifndef _PLATFORM_FREERTOS_H
+#define _PLATFORM_FREERTOS_H
+
+#include <stdint.h>
+
+extern uint32_t SystemCoreClock;
+void SystemInit(void);
+
+/* Idle sleeps until the next tick rather than spinning; see the POSIX port */
+#define configUSE_TICKLESS_IDLE 2
+
+#endif
@@ -0,0 +1,309 @@
+/* sim.c
+ * Platform routines for the host-side simulator
+ * RebbleOS
+ *
+ * The simulator runs the real rcore / rwatch code on top of the FreeRTOS
+ * POSIX port.  Flash reads come from an image file (the same SPI image that
+ * QEMU uses) mapped into memory, and the display is a plain framebuffer in
+ * RAM.  Frames can optionally be dumped to disk as PPM files by pointing
+ * REBBLE_SIM_FRAMES at a directory.
+ *
+ * Environment:
+ *   REBBLE_SIM_FLASH   path to the flash image (default Resources/snowy_spi.bin)
+ *   REBBLE_SIM_FRAMES  directory to write frame_NNNNN.ppm into (default: off)
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "platform.h"
+#include "display.h"
+#include "log.h"
+
+#define SIM_DEFAULT_FLASH "Resources/snowy_spi.bin"
+
+uint32_t SystemCoreClock = 100000000;
+
+void SystemInit(void)
+{
+}
+
+/*** debug routines ***/
+
+void debug_init(void)
+{
+    /* logs go out through printf; don't lose them in a buffer if we die */
+    setvbuf(stdout, NULL, _IONBF, 0);
+}
+
+void debug_write(const unsigned char *p, size_t len)
+{
+    (void) write(STDOUT_FILENO, p, len);
+}
+
+void ss_debug_write(const unsigned char *p, size_t len)
+{
+    // unsupported on this platform
+}
+
+void log_clock_enable(void)
+{
+}
+
+void log_clock_disable(void)
+{
+}
+
+/*** platform ***/
+
+void platform_init(void)
+{
+}
+
+void platform_init_late(void)
+{
+    DRV_LOG("sim", APP_LOG_LEVEL_INFO, "RebbleOS host simulator");
+}
+
+void delay_us(uint16_t us)
+{
+    usleep(us);
+}
+
+void delay_ms(uint16_t ms)
+{
+    usleep(1000 * ms);
+}
+
+/*** watchdog timer ***/
+
+void hw_watchdog_init(void)
+{
+}
+
+void hw_watchdog_reset(void)
+{
+}
+
+/*** ambient light sensor ***/
+
+void hw_ambient_init(void)
+{
+}
+
+uint16_t hw_ambient_get(void)
+{
+    return 0;
+}
+
+/*** backlight ***/
+
+void hw_backlight_init(void)
+{
+}
+
+void hw_backlight_set(uint16_t val)
+{
+}
+
+/*** vibrate ***/
+
+void hw_vibrate_init(void)
+{
+}
+
+void hw_vibrate_enable(uint8_t enabled)
+{
+}
+
+/*** buttons ***/
+
+static hw_button_isr_t _button_isr;
+
+void hw_button_init(void)
+{
+}
+
+int hw_button_pressed(hw_button_t button_id)
+{
+    return 0;
+}
+
+void hw_button_set_isr(hw_button_isr_t isr)
+{
+    _button_isr = isr;
+}
+
+/*** rtc ***/
+
+static struct tm _time_now;
+
+void rtc_init(void)
+{
+}
+
+void rtc_config(void)
+{
+}
+
+void hw_get_time_str(char *buf)
+{
+    struct tm *tm = hw_get_time();
+
+    snprintf(buf, 12, "%02d:%02d:%02d\n", tm->tm_hour, tm->tm_min, tm->tm_sec);
+}
+
+struct tm *hw_get_time(void)
+{
+    time_t now = time(NULL);
+
+    localtime_r(&now, &_time_now);
+    return &_time_now;
+}
+
+/*** display ***/
+
+static uint8_t _display_fb[DISPLAY_ROWS * DISPLAY_COLS];
+static uint32_t _display_frames;
+static const char *_display_frame_dir;
+
+void hw_display_init(void)
+{
+    _display_frame_dir = getenv("REBBLE_SIM_FRAMES");
+}
+
+void hw_display_reset(void)
+{
+}
+
+void hw_display_start(void)
+{
+}
+
+/*
+ * Write the framebuffer out as a binary PPM.  Colours are the Pebble 8-bit
+ * ARGB2222 format; alpha is ignored.
+ */
+static void _sim_display_dump_frame(void)
+{
+    static uint8_t rgb[DISPLAY_ROWS * DISPLAY_COLS * 3];
+    char path[256];
+    char hdr[32];
+    int fd, hdrlen;
+
+    for (int i = 0; i < DISPLAY_ROWS * DISPLAY_COLS; i++)
+    {
+        rgb[i * 3 + 0] = ((_display_fb[i] >> 4) & 3) * 85;
+        rgb[i * 3 + 1] = ((_display_fb[i] >> 2) & 3) * 85;
+        rgb[i * 3 + 2] = ((_display_fb[i] >> 0) & 3) * 85;
+    }
+
+    snprintf(path, sizeof(path), "%s/frame_%05d.ppm", _display_frame_dir, (int)_display_frames);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        DRV_LOG("sim", APP_LOG_LEVEL_ERROR, "can't write frame to %s", path);
+        _display_frame_dir = NULL;
+        return;
+    }
+
+    snprintf(hdr, sizeof(hdr), "P6\n%d %d\n255\n", DISPLAY_COLS, DISPLAY_ROWS);
+    hdrlen = strlen(hdr);
+    (void) write(fd, hdr, hdrlen);
+    (void) write(fd, rgb, sizeof(rgb));
+    close(fd);
+}
+
+/*
+ * The "transfer" is instantaneous; signal completion straight back to the
+ * display thread, just as the DMA completion interrupt would on hardware.
+ */
+void hw_display_start_frame(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax)
+{
+    if (_display_frame_dir)
+        _sim_display_dump_frame();
+
+    _display_frames++;
+    display_done_ISR(0);
+}
+
+uint8_t hw_display_is_ready(void)
+{
+    return 1;
+}
+
+uint8_t *hw_display_get_buffer(void)
+{
+    return _display_fb;
+}
+
+/*** flash ***/
+
+static const uint8_t *_flash_image;
+static size_t _flash_image_size;
+
+/*
+ * Map the flash image.  Anything past the end of the image (or everything,
+ * if there is no image) reads back as erased flash.
+ */
+void hw_flash_init(void)
+{
+    const char *path = getenv("REBBLE_SIM_FLASH");
+    struct stat st;
+    int fd;
+
+    if (!path)
+        path = SIM_DEFAULT_FLASH;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        DRV_LOG("Flash", APP_LOG_LEVEL_ERROR, "can't open flash image %s", path);
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    _flash_image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (_flash_image == MAP_FAILED)
+    {
+        DRV_LOG("Flash", APP_LOG_LEVEL_ERROR, "can't map flash image %s", path);
+        _flash_image = NULL;
+        return;
+    }
+
+    _flash_image_size = st.st_size;
+    DRV_LOG("Flash", APP_LOG_LEVEL_DEBUG, "mapped %s, %d bytes", path, (int)_flash_image_size);
+}
+
+void hw_flash_deinit(void)
+{
+    if (_flash_image)
+        munmap((void *)_flash_image, _flash_image_size);
+    _flash_image = NULL;
+    _flash_image_size = 0;
+}
+
+void hw_flash_read_bytes(uint32_t address, uint8_t *buffer, size_t length)
+{
+    size_t avail = 0;
+
+    /* flash past the end of a short image reads as erased */
+    if (_flash_image && address < _flash_image_size)
+    {
+        avail = _flash_image_size - address;
+        if (avail > length)
+            avail = length;
+        memcpy(buffer, _flash_image + address, avail);
+    }
+
+    memset(buffer + avail, 0xFF, length - avail);
+}
@@ -0,0 +1,58 @@
+#pragma once
+/* sim.h
+ * Platform routines for the host-side simulator
+ * RebbleOS
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include "rebble_time.h"
+
+// How often are we resetting the watchdog timer (ms)
+#define WATCHDOG_RESET_MS 500
+
+// main hooks
+void debug_init(void);
+void debug_write(const unsigned char *p, size_t len);
+void ss_debug_write(const unsigned char *p, size_t len);
+void platform_init(void);
+void platform_init_late(void);
+void log_clock_enable(void);
+void log_clock_disable(void);
+
+/* There are no interrupts on the host; everything runs in task context. */
+static inline uint8_t is_interrupt_set(void)
+{
+    return 0;
+}
+
+void delay_us(uint16_t us);
+void delay_ms(uint16_t ms);
+
+void hw_watchdog_init(void);
+void hw_watchdog_reset(void);
+
+void hw_ambient_init(void);
+uint16_t hw_ambient_get(void);
+
+void hw_backlight_init(void);
+void hw_backlight_set(uint16_t val);
+
+void hw_vibrate_init(void);
+void hw_vibrate_enable(uint8_t enabled);
+
+void rtc_init(void);
+void rtc_config(void);
+void hw_get_time_str(char *buf);
+struct tm *hw_get_time(void);
+
+void hw_display_init(void);
+void hw_display_reset(void);
+void hw_display_start(void);
+void hw_display_start_frame(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax);
+uint8_t hw_display_is_ready(void);
+uint8_t *hw_display_get_buffer(void);
+
+void hw_flash_init(void);
+void hw_flash_deinit(void);
+void hw_flash_read_bytes(uint32_t address, uint8_t *buffer, size_t length);
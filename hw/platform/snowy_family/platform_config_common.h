@@ -27,6 +27,26 @@
 #define REGION_APP_RES_START    0xB3A000
 #define REGION_APP_RES_SIZE     0x7D000
 
+/* Flash read cache (rcore/flash.c): FLASH_CACHE_SETS x FLASH_CACHE_WAYS
+ * lines of FLASH_CACHE_LINE_SIZE bytes.  The line size must be a power of
+ * two.  Leave FLASH_CACHE_LINE_SIZE undefined to turn the cache off.
+ * Read-ahead stops at FLASH_SIZE, the end of the flash. */
+#define FLASH_CACHE_LINE_SIZE   256
+#define FLASH_CACHE_SETS        8
+#define FLASH_CACHE_WAYS        4
+#define FLASH_SIZE              0x1000000
+
+/* Render into a second framebuffer (rcore/display.c) so the next frame can
+ * be drawn while the last one is still going out to the FPGA.  Costs
+ * DISPLAY_ROWS * DISPLAY_COLS bytes of RAM.  Leave undefined to render
+ * straight into the driver's buffer. */
+#define DISPLAY_DOUBLE_BUFFER
+
+/* Convert the framebuffer to the FPGA's format 4 pixels at a time
+ * (snowy_scanlines.c) rather than a byte pair at a time.  Leave undefined
+ * for the plain byte version. */
+#define SCANLINE_CONVERT_WORD
+
 
 /* The size of the page that holds an apps header table. This is the amount before actual app content e.g
  0x0000  Resource table header
@@ -22,7 +22,19 @@
 
 #define ROW_LENGTH    DISPLAY_COLS
 #define COLUMN_LENGTH DISPLAY_ROWS
-static uint8_t _column_buffer[COLUMN_LENGTH];
+
+/* Columns converted and sent per DMA transfer. There are two of these
+ * buffers; one goes out over DMA while the next lot is converted into
+ * the other one */
+#define CHUNK_COLUMNS 12
+#define CHUNK_LENGTH  (COLUMN_LENGTH * CHUNK_COLUMNS)
+#define CHUNK_COUNT   (ROW_LENGTH / CHUNK_COLUMNS)
+
+#if ROW_LENGTH % CHUNK_COLUMNS
+#error "CHUNK_COLUMNS must divide the display width"
+#endif
+
+static uint8_t _column_buffer[2][CHUNK_LENGTH];
 static uint8_t _display_ready;
 
 void _snowy_display_start_frame(uint8_t xoffset, uint8_t yoffset);
@@ -42,7 +54,8 @@ void _snowy_display_SPI_end(void);
 void _snowy_display_drawscene(uint8_t scene);
 void _snowy_display_init_intn(void);
 void _snowy_display_dma_send(uint8_t *data, uint32_t len);
-void _snowy_display_next_column(uint8_t col_index);
+void _snowy_display_dma_next(uint8_t *data, uint32_t length);
+void _snowy_display_convert_chunk(uint8_t *out_buffer, uint8_t chunk_index);
 void _snowy_display_init_dma(void);
 
 // pointer to the place in flash where the FPGA image resides
@@ -332,36 +345,37 @@ void snowy_display_reinit_dma(uint32_t *data, uint32_t length)
 
 /*
  * DMA2 handler for SPI6
+ * Fires once per chunk of columns. The next chunk is already converted,
+ * so we just point the DMA at it, then convert the one after that into
+ * the buffer that just finished while it goes out
  */
 void DMA2_Stream5_IRQHandler()
 {
-    static uint8_t col_index = 0;
+    static uint8_t chunk_index = 0;
     
     if (DMA_GetITStatus(DMA2_Stream5, DMA_IT_TCIF5))
     {
         DMA_ClearITPendingBit(DMA2_Stream5, DMA_IT_TCIF5);
 
-        // check the tx finished
-        while (SPI_I2S_GetFlagStatus(SPI6, SPI_I2S_FLAG_TXE) == RESET)
-        {
-        };
-        
-        // make sure we are not busy
-        while (SPI_I2S_GetFlagStatus(SPI6, SPI_I2S_FLAG_BSY) == SET)
-        {
-        };
-
-        // if we are finished sending  each column, then reset and stop
-        if (col_index < ROW_LENGTH - 1)
+        // if we are finished sending each chunk, then reset and stop
+        if (chunk_index < CHUNK_COUNT - 1)
         {
-            ++col_index;
-            // ask for convert and display the next column
-            _snowy_display_next_column(col_index);
+            ++chunk_index;
+            _snowy_display_dma_next(_column_buffer[chunk_index & 1], CHUNK_LENGTH);
+            
+            if (chunk_index < CHUNK_COUNT - 1)
+                _snowy_display_convert_chunk(_column_buffer[(chunk_index + 1) & 1], chunk_index + 1);
             return;
         }
                 
         // done. We are still in control of the SPI select, so lets let go
-        col_index = 0;
+        chunk_index = 0;
+        
+        // the DMA is done, but the last byte is still on the wire.
+        // Only a byte or so to wait, and once a frame
+        while (SPI_I2S_GetFlagStatus(SPI6, SPI_I2S_FLAG_BSY) == SET)
+        {
+        };
         
         _snowy_display_cs(0);
         _display_ready = 1;
@@ -431,13 +445,12 @@ uint8_t _snowy_display_SPI6_send(uint8_t data)
 }
 
 /*
- * Given a column index, start the conversion of the display data and dma it
+ * Convert a chunk of CHUNK_COLUMNS columns of the framebuffer into
+ * the display's native format
  */
-void _snowy_display_next_column(uint8_t col_index)
-{   
-    // set the content
-    scanline_convert(_column_buffer, display.frame_buffer, col_index);
-    _snowy_display_dma_send(_column_buffer, COLUMN_LENGTH);
+void _snowy_display_convert_chunk(uint8_t *out_buffer, uint8_t chunk_index)
+{
+    scanline_convert_columns(out_buffer, display.frame_buffer, chunk_index * CHUNK_COLUMNS, CHUNK_COLUMNS);
 }
 
 /*
@@ -453,6 +466,19 @@ void _snowy_display_dma_send(uint8_t *data, uint32_t length)
     return;
 }
 
+/*
+ * Send the next buffer with the DMA set up by _snowy_display_dma_send.
+ * The stream turns itself off on completion, so from the ISR all that
+ * is needed is the new address and length. No waiting around
+ */
+void _snowy_display_dma_next(uint8_t *data, uint32_t length)
+{
+    DMA_ClearFlag(DMA2_Stream5, DMA_FLAG_FEIF5|DMA_FLAG_DMEIF5|DMA_FLAG_TEIF5|DMA_FLAG_HTIF5|DMA_FLAG_TCIF5);
+    DMA_MemoryTargetConfig(DMA2_Stream5, (uint32_t)data, DMA_Memory_0);
+    DMA_SetCurrDataCounter(DMA2_Stream5, length);
+    DMA_Cmd(DMA2_Stream5, ENABLE);
+}
+
 /*
  * Reset the FPGA. This goes through a convoluted set of steps
  * that basically pound the FPGA into submission. Ya see, sometimes
@@ -572,9 +598,12 @@ void _snowy_display_send_frame()
     _snowy_display_cs(1);
     delay_us(80);
     // send over DMA
-    // we are only going to send one single column at a time
+    // we send a chunk of columns at a time, with the next one ready to go.
     // the dma engine completion will trigger the next lot of data to go
-    _snowy_display_next_column(0);
+    _snowy_display_convert_chunk(_column_buffer[0], 0);
+    if (CHUNK_COUNT > 1)
+        _snowy_display_convert_chunk(_column_buffer[1], 1);
+    _snowy_display_dma_send(_column_buffer[0], CHUNK_LENGTH);
     // we return immediately and let the system take care of the rest
 }
 
@@ -596,9 +625,9 @@ void _snowy_display_send_frame_slow()
     // send via standard SPI
     for(uint8_t x = 0; x < DISPLAY_COLS; x++)
     {
-        scanline_convert(_column_buffer, display.frame_buffer, x);
+        scanline_convert(_column_buffer[0], display.frame_buffer, x);
         for (uint8_t j = 0; j < DISPLAY_ROWS; j++)
-            _snowy_display_SPI6_send(_column_buffer[j]);
+            _snowy_display_SPI6_send(_column_buffer[0][j]);
     }   
     
     _snowy_display_cs(0);
@@ -713,10 +742,12 @@ void hw_display_on()
 
 /*
  * Start a frame render
+ * The FPGA only knows how to take a whole frame, so the dirty
+ * area is ignored and the full framebuffer is sent
  */
-void hw_display_start_frame(uint8_t xoffset, uint8_t yoffset)
+void hw_display_start_frame(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax)
 {
-    _snowy_display_start_frame(xoffset, yoffset);
+    _snowy_display_start_frame(0, 0);
 }
 
 uint8_t *hw_display_get_buffer(void)
@@ -52,10 +52,11 @@ uint8_t hw_display_is_ready();
 uint8_t *hw_display_get_buffer(void);
 
 void hw_display_on();
-void hw_display_start_frame(uint8_t xoffset, uint8_t yoffset);
+void hw_display_start_frame(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax);
 
 // TODO: move to scanline
 void scanline_convert(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t column_index);
+void scanline_convert_columns(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t index, uint8_t count);
 // void scanline_rgb888pixel_to_frambuffer(UG_S16 x, UG_S16 y, UG_COLOR c);
 
 void delay_us(uint16_t us);
@@ -10,6 +10,8 @@
 #include "string.h"
 #include "stm32f4xx_gpio.h"
 #include "stm32f4xx_fsmc.h"
+#include <stm32f4xx_dma.h>
+#include <misc.h>
 #include "platform.h"
 #include "stm32_power.h"
 #include "log.h"
@@ -29,6 +31,7 @@ void _nor_clock_release(void);
 int _flash_test(void);
 
 static void _nor_write16(uint32_t address, uint16_t data);
+static void _nor_dma_init(void);
 
 /*
  * Initialise the flash hardware. 
@@ -113,6 +116,8 @@ void hw_flash_init(void)
     stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOD);
     stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOE);
     stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);    
+    
+    _nor_dma_init();
 }
 
 void hw_flash_deinit(void)
@@ -305,3 +310,170 @@ void hw_flash_read_bytes(uint32_t address, uint8_t *buffer, size_t length)
     _nor_clock_release();
 }
 
+/*
+ * Execute in place.
+ * The NOR is left in read array mode in the FMC bank, so anything that only
+ * wants to read flash can be given a pointer straight into it. The bank is
+ * kept clocked for as long as anyone has a mapping.
+ *
+ * That has a power cost. A read through hw_flash_read_bytes only clocks the
+ * FMC and GPIO B/D/E for the length of the read, but a mapping holds them
+ * on until it is unmapped, right through idle sleep. A mapped system font
+ * stays mapped for as long as the app runs, so with one loaded they are
+ * effectively always on while an app is up. Nothing can be done about it
+ * between accesses, as the pointer can be dereferenced at any time.
+ */
+#define NOR_MAP_SIZE 0x1000000
+
+const uint8_t *hw_flash_map(uint32_t address, size_t length)
+{
+    if (address >= NOR_MAP_SIZE || length > NOR_MAP_SIZE - address)
+        return NULL;
+    
+    /* released in hw_flash_unmap */
+    _nor_clock_request();
+    
+    return (const uint8_t *)(Bank1_NOR_ADDR + address);
+}
+
+/*
+ * Let go of a pointer from hw_flash_map.
+ * Returns 0 if it wasn't one of ours
+ */
+int hw_flash_unmap(const uint8_t *ptr)
+{
+    uint32_t addr = (uint32_t)ptr;
+    
+    if (addr < Bank1_NOR_ADDR || addr >= Bank1_NOR_ADDR + NOR_MAP_SIZE)
+        return 0;
+    
+    _nor_clock_release();
+    
+    return 1;
+}
+
+/*
+ * Asynchronous reads.
+ * The NOR is memory mapped, so we can have the DMA controller copy out of
+ * the bank for us.  Only DMA2 can do memory to memory, and stream 5 is
+ * taken by the display, so we use stream 0.  A stream can only move 65535
+ * items at a time, so longer reads are done in chunks from the interrupt.
+ */
+#define NOR_DMA_STREAM      DMA2_Stream0
+#define NOR_DMA_MAX_CHUNK   0xFFFF
+
+static uint32_t _nor_dma_address;
+static uint8_t *_nor_dma_buffer;
+static size_t _nor_dma_remaining;
+static size_t _nor_dma_chunk;
+
+static void _nor_dma_init(void)
+{
+    NVIC_InitTypeDef nvic_init_struct;
+    
+    nvic_init_struct.NVIC_IRQChannel = DMA2_Stream0_IRQn;
+    nvic_init_struct.NVIC_IRQChannelPreemptionPriority = 9;
+    nvic_init_struct.NVIC_IRQChannelSubPriority = 0;
+    nvic_init_struct.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvic_init_struct);
+}
+
+/*
+ * Expects clocks to already be running!
+ */
+static void _nor_dma_start_chunk(void)
+{
+    DMA_InitTypeDef dma_init_struct;
+    
+    _nor_dma_chunk = _nor_dma_remaining;
+    if (_nor_dma_chunk > NOR_DMA_MAX_CHUNK)
+        _nor_dma_chunk = NOR_DMA_MAX_CHUNK;
+    
+    DMA_Cmd(NOR_DMA_STREAM, DISABLE);
+    while (NOR_DMA_STREAM->CR & DMA_SxCR_EN);
+    
+    DMA_ClearFlag(NOR_DMA_STREAM, DMA_FLAG_FEIF0|DMA_FLAG_DMEIF0|DMA_FLAG_TEIF0|DMA_FLAG_HTIF0|DMA_FLAG_TCIF0);
+    
+    DMA_StructInit(&dma_init_struct);
+    // in memory to memory mode, the "peripheral" is the source
+    dma_init_struct.DMA_PeripheralBaseAddr = Bank1_NOR_ADDR + _nor_dma_address;
+    dma_init_struct.DMA_Memory0BaseAddr = (uint32_t)_nor_dma_buffer;
+    dma_init_struct.DMA_Channel = DMA_Channel_0;
+    dma_init_struct.DMA_DIR = DMA_DIR_MemoryToMemory;
+    dma_init_struct.DMA_BufferSize = _nor_dma_chunk;
+    dma_init_struct.DMA_PeripheralInc = DMA_PeripheralInc_Enable;
+    dma_init_struct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    dma_init_struct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    dma_init_struct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    dma_init_struct.DMA_Mode = DMA_Mode_Normal;
+    dma_init_struct.DMA_Priority = DMA_Priority_Medium;
+    // direct mode isn't allowed for memory to memory
+    dma_init_struct.DMA_FIFOMode = DMA_FIFOMode_Enable;
+    dma_init_struct.DMA_FIFOThreshold = DMA_FIFOThreshold_Full;
+    dma_init_struct.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+    dma_init_struct.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+    DMA_Init(NOR_DMA_STREAM, &dma_init_struct);
+    
+    DMA_ITConfig(NOR_DMA_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+    DMA_Cmd(NOR_DMA_STREAM, ENABLE);
+}
+
+/*
+ * Start copying length bytes from flash into buffer, and return straight
+ * away.  flash_read_done_ISR is called from the interrupt when it's done.
+ * Only one read can be in flight at a time, and length mustn't be 0: an
+ * empty transfer never completes.
+ */
+void hw_flash_read_bytes_dma(uint32_t address, uint8_t *buffer, size_t length)
+{
+    /* released in DMA2_Stream0_IRQHandler */
+    _nor_clock_request();
+    stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    
+    _nor_dma_address = address;
+    _nor_dma_buffer = buffer;
+    _nor_dma_remaining = length;
+    
+    _nor_dma_start_chunk();
+}
+
+static void _nor_dma_finish(int err)
+{
+    DMA_ITConfig(NOR_DMA_STREAM, DMA_IT_TC | DMA_IT_TE, DISABLE);
+    DMA_Cmd(NOR_DMA_STREAM, DISABLE);
+    
+    stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_DMA2);
+    _nor_clock_release();
+    
+    flash_read_done_ISR(err);
+}
+
+/*
+ * DMA2 handler for flash reads
+ */
+void DMA2_Stream0_IRQHandler(void)
+{
+    if (DMA_GetITStatus(NOR_DMA_STREAM, DMA_IT_TEIF0))
+    {
+        DMA_ClearITPendingBit(NOR_DMA_STREAM, DMA_IT_TEIF0);
+        _nor_dma_finish(1);
+        return;
+    }
+    
+    if (DMA_GetITStatus(NOR_DMA_STREAM, DMA_IT_TCIF0))
+    {
+        DMA_ClearITPendingBit(NOR_DMA_STREAM, DMA_IT_TCIF0);
+        
+        _nor_dma_address += _nor_dma_chunk;
+        _nor_dma_buffer += _nor_dma_chunk;
+        _nor_dma_remaining -= _nor_dma_chunk;
+        
+        if (_nor_dma_remaining)
+        {
+            _nor_dma_start_chunk();
+            return;
+        }
+        
+        _nor_dma_finish(0);
+    }
+}
@@ -13,3 +13,12 @@ void hw_flash_deinit(void);
 uint16_t hw_flash_read16(uint32_t address);
 void hw_flash_read_bytes(uint32_t address, uint8_t *buffer, size_t length);
 
+/* hw_flash_read_bytes_dma is available; see flash_read_bytes_async */
+#define HW_FLASH_HAS_DMA
+void hw_flash_read_bytes_dma(uint32_t address, uint8_t *buffer, size_t length);
+
+/* hw_flash_map is available; see flash_map */
+#define HW_FLASH_HAS_MAP
+const uint8_t *hw_flash_map(uint32_t address, size_t length);
+int hw_flash_unmap(const uint8_t *ptr);
+
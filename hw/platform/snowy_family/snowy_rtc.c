@@ -12,12 +12,30 @@
 #include "snowy_rtc.h"
 #include "stm32_power.h"
 #include "log.h"
+#include "FreeRTOS.h"
+#include "task.h"
 #include <stdlib.h>
 #include <time.h>
 
+// LSE is 32768Hz. The async prescaler gives a 256Hz subsecond counter
+#define RTC_ASYNCH_PREDIV 0x7F
+#define RTC_SYNCH_PREDIV  0xFF
+#define RTC_SUBSECOND_HZ  (RTC_SYNCH_PREDIV + 1)
+#define RTC_DAY_SUBSECONDS (86400UL * RTC_SUBSECOND_HZ)
+
+// the wakeup timer runs from RTCCLK/16, so it can sleep for up to 32s
+#define RTC_WAKEUP_HZ        (32768 / 16)
+#define RTC_WAKEUP_MAX_TICKS (0xFFFFUL * configTICK_RATE_HZ / RTC_WAKEUP_HZ)
+
 // a buffer for the last captured time to avoid malloc
 static struct tm time_now;
 
+// tickless idle bookkeeping
+static uint32_t _sleep_count;
+static uint32_t _sleep_ticks;
+// part of a tick slept but not yet given to the scheduler, in 1/256 ticks
+static uint32_t _sleep_remainder;
+
 // for the interrupts
 __IO uint32_t uwCaptureNumber = 0; 
 __IO uint32_t uwPeriodValue = 0;
@@ -48,9 +66,10 @@ void rtc_init(void)
     NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStruct);
 
-    // Configure the RTC WakeUp Clock source: CK_SPRE (1Hz)
-    RTC_WakeUpClockConfig(RTC_WakeUpClock_CK_SPRE_16bits);
-    RTC_SetWakeUpCounter(0x0);
+    // The wakeup timer is what brings us out of tickless idle.
+    // It only gets switched on while we are asleep, see rtc_sleep
+    RTC_WakeUpCmd(DISABLE);
+    RTC_WakeUpClockConfig(RTC_WakeUpClock_RTCCLK_Div16);
 
     // Enable the RTC Wakeup Interrupt
     RTC_ITConfig(RTC_IT_WUT, ENABLE);
@@ -58,9 +77,6 @@ void rtc_init(void)
     RTC_ClearITPendingBit(RTC_IT_WUT);
     EXTI_ClearITPendingBit(EXTI_Line22);
     
-    // Enable Wakeup Counter
-    RTC_WakeUpCmd(ENABLE);
-    
     stm32_power_release(STM32_POWER_APB2, RCC_APB2Periph_SYSCFG);
 }
 void rtc_config(void)
@@ -80,9 +96,6 @@ void rtc_config(void)
     }
 
     RCC_RTCCLKConfig(RCC_RTCCLKSource_LSI);
-  
-    uint32_t uwSynchPrediv = 0xFF;
-    uint32_t uwAsynchPrediv = 0x7F;
 
 
 // external oscilator
@@ -96,9 +109,6 @@ void rtc_config(void)
 
     RCC_RTCCLKConfig(RCC_RTCCLKSource_LSE);
 
-    uint32_t uwSynchPrediv = 0xFF;
-    uint32_t uwAsynchPrediv = 0x7F;
-
 #else
     #error Please select the RTC Clock source inside the main.c file
 #endif
@@ -107,8 +117,8 @@ void rtc_config(void)
     RTC_WaitForSynchro();
     
     // configure clock prescaler
-    RTC_InitStructure.RTC_AsynchPrediv = uwAsynchPrediv;
-    RTC_InitStructure.RTC_SynchPrediv = uwSynchPrediv;
+    RTC_InitStructure.RTC_AsynchPrediv = RTC_ASYNCH_PREDIV;
+    RTC_InitStructure.RTC_SynchPrediv = RTC_SYNCH_PREDIV;
     RTC_InitStructure.RTC_HourFormat = RTC_HourFormat_24;
     RTC_Init(&RTC_InitStructure);
 
@@ -175,13 +185,127 @@ void hw_set_date_time(struct tm date_time)
 //     RTC_SetTime(RTC_Format_BCD, &RTC_TimeStructure);
 }
 
+/*
+ * Time of day in 1/256 seconds, straight from the registers.
+ * Reading SSR locks the time and date shadows until DR is read
+ */
+static uint32_t _rtc_get_subseconds(void)
+{
+    uint32_t ssr = RTC->SSR & RTC_SSR_SS;
+    uint32_t tr = RTC->TR;
+    (void)RTC->DR;
+    
+    uint32_t hours = ((tr & RTC_TR_HT) >> 20) * 10 + ((tr & RTC_TR_HU) >> 16);
+    uint32_t mins = ((tr & RTC_TR_MNT) >> 12) * 10 + ((tr & RTC_TR_MNU) >> 8);
+    uint32_t secs = ((tr & RTC_TR_ST) >> 4) * 10 + (tr & RTC_TR_SU);
+    
+    // SSR counts down through the second
+    return (hours * 3600 + mins * 60 + secs) * RTC_SUBSECOND_HZ + (RTC_SYNCH_PREDIV - ssr);
+}
+
+/*
+ * Tickless idle. FreeRTOS calls this from the idle task when nothing is due
+ * for idle_ticks. We stop the SysTick, let the RTC wakeup timer wake us
+ * when the next task is due, and sleep. Anything else that interrupts
+ * (buttons, display DMA, bluetooth) wakes us early.
+ * When we come back we measure how long we were out on the RTC and tell
+ * the scheduler, so the tick count (and with it rcore_time_ms) doesn't drift.
+ *
+ * This is WFI sleep, not STOP mode, so the peripherals and DMA carry on.
+ */
+void rtc_sleep(uint32_t idle_ticks)
+{
+    uint32_t systick_elapsed, start, slept, ticks, wake;
+    
+    if (idle_ticks > RTC_WAKEUP_MAX_TICKS)
+        idle_ticks = RTC_WAKEUP_MAX_TICKS;
+    
+    __disable_irq();
+    __DSB();
+    __ISB();
+    
+    // something got readied while we were deciding to sleep
+    if (eTaskConfirmSleepModeStatus() == eAbortSleep)
+    {
+        __enable_irq();
+        return;
+    }
+    
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    systick_elapsed = SysTick->LOAD - SysTick->VAL;
+    
+    /* Part of this tick has gone already, and so has whatever we carried
+     * over from the last sleep, so the task is due that much sooner than
+     * idle_ticks away. Take both off the wakeup, like the port does when
+     * it loads the SysTick with what is left of the current tick.
+     * All in 1/256 ticks. */
+    systick_elapsed = systick_elapsed * RTC_SUBSECOND_HZ / (SysTick->LOAD + 1);
+    wake = idle_ticks * RTC_SUBSECOND_HZ;
+    wake = wake > _sleep_remainder + systick_elapsed ? wake - _sleep_remainder - systick_elapsed : 0;
+    wake = (uint64_t)wake * RTC_WAKEUP_HZ / ((uint64_t)configTICK_RATE_HZ * RTC_SUBSECOND_HZ);
+    
+    // too close to bother; the SysTick carries on from where it stopped
+    if (wake == 0)
+    {
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        __enable_irq();
+        return;
+    }
+    
+    RTC_WakeUpCmd(DISABLE);
+    RTC_SetWakeUpCounter(wake - 1);
+    RTC_ClearITPendingBit(RTC_IT_WUT);
+    EXTI_ClearITPendingBit(EXTI_Line22);
+    RTC_WakeUpCmd(ENABLE);
+    
+    start = _rtc_get_subseconds();
+    
+    __DSB();
+    __WFI();
+    __ISB();
+    
+    slept = (_rtc_get_subseconds() + RTC_DAY_SUBSECONDS - start) % RTC_DAY_SUBSECONDS;
+    RTC_WakeUpCmd(DISABLE);
+    
+    /* The RTC only counts 1/256s, so carry what is left of a tick
+     * over to the next sleep rather than losing it */
+    _sleep_remainder += slept * configTICK_RATE_HZ + systick_elapsed;
+    ticks = _sleep_remainder / RTC_SUBSECOND_HZ;
+    
+    // the scheduler can't be stepped past the task that is due
+    if (ticks > idle_ticks - 1)
+        ticks = idle_ticks - 1;
+    _sleep_remainder -= ticks * RTC_SUBSECOND_HZ;
+    
+    // the last tick goes through the tick interrupt so the due task wakes
+    if (_sleep_remainder >= RTC_SUBSECOND_HZ)
+    {
+        _sleep_remainder -= RTC_SUBSECOND_HZ;
+        SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+    }
+    
+    vTaskStepTick(ticks);
+    
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    
+    _sleep_count++;
+    _sleep_ticks += ticks;
+    
+    __enable_irq();
+}
+
+void rtc_get_sleep_stats(uint32_t *sleeps, uint32_t *asleep_ticks)
+{
+    *sleeps = _sleep_count;
+    *asleep_ticks = _sleep_ticks;
+}
 
 void RTC_WKUP_IRQHandler(void)
 {
     if(RTC_GetITStatus(RTC_IT_WUT) != RESET)
     {
         RTC_ClearITPendingBit(RTC_IT_WUT);
-        DRV_LOG("RTC", APP_LOG_LEVEL_DEBUG, "RTC WAKE IRQ");
         EXTI_ClearITPendingBit(EXTI_Line22);
     } 
 }
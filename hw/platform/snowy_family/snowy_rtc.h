@@ -12,7 +12,12 @@ void rtc_init(void);
 void rtc_config(void);
 void hw_get_time_str(char *buf);
 struct tm *hw_get_time(void);
+void rtc_sleep(uint32_t idle_ticks);
+void rtc_get_sleep_stats(uint32_t *sleeps, uint32_t *asleep_ticks);
 
 // make sure we use the external osc
 #define RTC_CLOCK_SOURCE_LSE
 
+// the RTC wakeup timer drives tickless idle
+#define HW_RTC_HAS_TICKLESS
+
@@ -84,9 +84,91 @@ void _scanline_convert_column(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_
     }
 }
 
+#ifdef SCANLINE_CONVERT_WORD
+/*
+ * Word at a time versions of the above. The bit twiddling is the same,
+ * but done on 4 pixels at once in a 32 bit register. The framebuffer
+ * is read as little endian words, which is what we are on.
+ * Both rows and column starts are word aligned as the display dimensions
+ * are multiples of 4
+ */
+#if DISPLAY_COLS % 4
+#error "SCANLINE_CONVERT_WORD needs the display width to be a multiple of 4"
+#endif
+
+static inline uint32_t _scanline_load32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void _scanline_store16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+/*
+ * Each word holds two pixel pairs: [r1 r0 r1 r0]
+ * Work out lsb/msb for both pairs in the low byte of each half word,
+ * then squash them together for a 16 bit write into each half
+ */
+void _scanline_convert_row_word(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t row_index)
+{
+    uint8_t *in = frame_buffer + row_index * DISPLAY_COLS;
+    uint8_t *out_lsb = out_buffer;
+    uint8_t *out_msb = out_buffer + DISPLAY_COLS / 2;
+
+    for (uint16_t xi = 0; xi < DISPLAY_COLS; xi += 4)
+    {
+        uint32_t w = _scanline_load32(in + xi);
+        uint32_t t = w & 0x2A2A2A2A;
+        uint32_t u = w & 0x15151515;
+        
+        // r1 is in the even bytes, r0 in the odd ones
+        uint32_t lsb = (t & 0x00FF00FF) | ((t >> 9) & 0x00150015);
+        uint32_t msb = ((u & 0x00FF00FF) << 1) | ((u >> 8) & 0x00FF00FF);
+        
+        _scanline_store16(out_lsb + xi / 2, (uint16_t)(lsb | (lsb >> 8)));
+        _scanline_store16(out_msb + xi / 2, (uint16_t)(msb | (msb >> 8)));
+    }
+}
+
+/*
+ * Convert 4 neighbouring columns at once. A word from each of two rows
+ * gives the lsb and msb bytes for all four columns, one per byte lane.
+ * Column n ends up at out_buffer + n * DISPLAY_ROWS
+ */
+void _scanline_convert_column4_word(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t column_index)
+{
+    uint16_t halfrows = DISPLAY_ROWS / 2;
+    uint8_t *in = frame_buffer + column_index;
+
+    for (uint16_t yi = 0; yi < DISPLAY_ROWS; yi += 2)
+    {
+        uint16_t halfy = (DISPLAY_ROWS - 1 - yi) / 2;
+        uint32_t r0 = _scanline_load32(in);
+        uint32_t r1 = _scanline_load32(in + DISPLAY_COLS);
+        
+        uint32_t lsb = (r0 & 0x2A2A2A2A) >> 1 | (r1 & 0x2A2A2A2A);
+        uint32_t msb = (r0 & 0x15151515) | (r1 & 0x15151515) << 1;
+        
+        for (uint8_t n = 0; n < 4; n++)
+        {
+            out_buffer[n * DISPLAY_ROWS + halfy] = lsb >> (n * 8);
+            out_buffer[n * DISPLAY_ROWS + halfrows + halfy] = msb >> (n * 8);
+        }
+        
+        in += 2 * DISPLAY_COLS;
+    }
+}
+#endif
+
 void scanline_convert(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t index)
 {
-#if defined(REBBLE_PLATFORM_CHALK)
+#if defined(REBBLE_PLATFORM_CHALK) && defined(SCANLINE_CONVERT_WORD)
+    _scanline_convert_row_word(out_buffer, frame_buffer, index);
+#elif defined(REBBLE_PLATFORM_CHALK)
     _scanline_convert_row(out_buffer, frame_buffer, index);
 #elif defined(REBBLE_PLATFORM_SNOWY)
     _scanline_convert_column(out_buffer, frame_buffer, index);
@@ -94,3 +176,25 @@ void scanline_convert(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t index)
     assert(!"I don't know how to drive this platform!");
 #endif
 }
+
+/*
+ * Convert count lines starting at index into consecutive
+ * DISPLAY_ROWS sized chunks of out_buffer
+ */
+void scanline_convert_columns(uint8_t *out_buffer, uint8_t *frame_buffer, uint8_t index, uint8_t count)
+{
+    uint8_t i = 0;
+    
+#if defined(REBBLE_PLATFORM_SNOWY) && defined(SCANLINE_CONVERT_WORD)
+    // four at a time once we are word aligned
+    while (i < count && (index + i) % 4)
+    {
+        scanline_convert(out_buffer + i * DISPLAY_ROWS, frame_buffer, index + i);
+        i++;
+    }
+    for (; i + 4 <= count; i += 4)
+        _scanline_convert_column4_word(out_buffer + i * DISPLAY_ROWS, frame_buffer, index + i);
+#endif
+    for (; i < count; i++)
+        scanline_convert(out_buffer + i * DISPLAY_ROWS, frame_buffer, index + i);
+}
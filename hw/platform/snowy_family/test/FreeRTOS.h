@@ -0,0 +1,4 @@
+/* FreeRTOS.h
+ * Host stand-in for the scanline tests. Nothing from it is used
+ */
+#pragma once
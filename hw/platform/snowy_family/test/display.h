@@ -0,0 +1,6 @@
+/* display.h
+ * Host stand-in for the scanline tests
+ */
+#pragma once
+#include <stdint.h>
+#include <assert.h>
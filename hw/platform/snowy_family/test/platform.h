@@ -0,0 +1,6 @@
+/* platform.h
+ * Host stand-in for the scanline tests. The display size and platform
+ * come in on the command line; see the Makefile
+ */
+#pragma once
+#include <stdint.h>
@@ -0,0 +1,139 @@
+/* scanlines_test.c
+ * Host test and benchmark for the snowy/chalk scanline converters
+ * RebbleOS
+ *
+ * The word at a time converters have to give the same bytes as the byte at
+ * a time ones for every framebuffer, so both are run over random and edge
+ * case frames and compared. Then each is timed converting whole frames.
+ * Build and run with the Makefile next to this.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../snowy_scanlines.c"
+
+#ifdef REBBLE_PLATFORM_SNOWY
+/* the display is driven a column at a time, DISPLAY_ROWS bytes each */
+#define LINES      DISPLAY_COLS
+#define LINE_BYTES DISPLAY_ROWS
+#define PLATFORM   "snowy"
+#define convert_line_byte _scanline_convert_column
+#else
+#define LINES      DISPLAY_ROWS
+#define LINE_BYTES DISPLAY_COLS
+#define PLATFORM   "chalk"
+#define convert_line_byte _scanline_convert_row
+#endif
+
+#define RANDOM_FRAMES 500
+#define BENCH_FRAMES  2000
+
+static uint8_t _fb[DISPLAY_ROWS * DISPLAY_COLS] __attribute__((aligned(4)));
+static uint8_t _ref[LINES * LINE_BYTES];
+static uint8_t _out[LINES * LINE_BYTES];
+
+static double _now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void _convert_frame_byte(uint8_t *out)
+{
+    for (uint16_t i = 0; i < LINES; i++)
+        convert_line_byte(out + i * LINE_BYTES, _fb, i);
+}
+
+/* the same way the display driver does it, a DMA buffer's worth at a time */
+static void _convert_frame_word(uint8_t *out, uint8_t batch)
+{
+    for (uint16_t i = 0; i < LINES; i += batch)
+    {
+        uint8_t count = LINES - i < batch ? LINES - i : batch;
+        scanline_convert_columns(out + i * LINE_BYTES, _fb, i, count);
+    }
+}
+
+static int _check_frame(const char *what)
+{
+    static const uint8_t batches[] = { 1, 3, 4, 5, 8, 12, 13 };
+
+    _convert_frame_byte(_ref);
+
+    for (uint8_t b = 0; b < sizeof(batches); b++)
+    {
+        memset(_out, 0xA5, sizeof(_out));
+        _convert_frame_word(_out, batches[b]);
+        if (memcmp(_ref, _out, sizeof(_ref)))
+        {
+            printf("%s: %s frame differs, %d lines at a time\n", PLATFORM, what, batches[b]);
+            return 1;
+        }
+    }
+
+    /* and starting part way along, not on a word boundary */
+    for (uint8_t start = 1; start < 8; start++)
+    {
+        memset(_out, 0xA5, sizeof(_out));
+        scanline_convert_columns(_out + start * LINE_BYTES, _fb, start, LINES - start);
+        if (memcmp(_ref + start * LINE_BYTES, _out + start * LINE_BYTES, (LINES - start) * LINE_BYTES))
+        {
+            printf("%s: %s frame differs, starting at line %d\n", PLATFORM, what, start);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    static const uint8_t fills[] = { 0x00, 0xFF, 0x3F, 0x2A, 0x15, 0xC0 };
+    int failed = 0;
+    double t0, t1, t2;
+
+    for (uint8_t i = 0; i < sizeof(fills); i++)
+    {
+        char what[16];
+
+        memset(_fb, fills[i], sizeof(_fb));
+        snprintf(what, sizeof(what), "0x%02x", fills[i]);
+        failed |= _check_frame(what);
+    }
+
+    srand(1);
+    for (int n = 0; n < RANDOM_FRAMES && !failed; n++)
+    {
+        for (uint32_t i = 0; i < sizeof(_fb); i++)
+            _fb[i] = rand();
+        failed |= _check_frame("random");
+    }
+
+    if (failed)
+        return 1;
+
+    printf("%s: %d frames match\n", PLATFORM, RANDOM_FRAMES + (int)sizeof(fills));
+
+    t0 = _now();
+    for (int n = 0; n < BENCH_FRAMES; n++)
+    {
+        _convert_frame_byte(_ref);
+        __asm__ volatile("" : : "r"(_ref) : "memory");
+    }
+    t1 = _now();
+    for (int n = 0; n < BENCH_FRAMES; n++)
+    {
+        _convert_frame_word(_out, 12);
+        __asm__ volatile("" : : "r"(_out) : "memory");
+    }
+    t2 = _now();
+
+    printf("%s: byte %.1f us/frame, word %.1f us/frame\n", PLATFORM,
+           (t1 - t0) / BENCH_FRAMES * 1e6, (t2 - t1) / BENCH_FRAMES * 1e6);
+
+    return 0;
+}
@@ -0,0 +1,5 @@
+/* stm32f4xx.h
+ * Host stand-in for the scanline tests, just enough for snowy_display.h
+ */
+#pragma once
+typedef struct { uint32_t unused; } GPIO_TypeDef;
@@ -3,6 +3,7 @@
 
 #include "tintin.h"
 #include "stm32_buttons.h"
+#include "stm32_power.h"
 
 #define DISPLAY_ROWS 168
 #define DISPLAY_COLS 144
@@ -23,6 +24,15 @@
 #define REGION_APP_RES_START    0xB3A000
 #define REGION_APP_RES_SIZE     0x7D000
 
+/* Flash read cache (rcore/flash.c): FLASH_CACHE_SETS x FLASH_CACHE_WAYS
+ * lines of FLASH_CACHE_LINE_SIZE bytes.  The line size must be a power of
+ * two.  Leave FLASH_CACHE_LINE_SIZE undefined to turn the cache off.
+ * Read-ahead stops at FLASH_SIZE, the end of the flash. */
+#define FLASH_CACHE_LINE_SIZE   128
+#define FLASH_CACHE_SETS        8
+#define FLASH_CACHE_WAYS        2
+#define FLASH_SIZE              0x400000
+
 // XXX TODO these are from Snowy. NOT correct
 /* App slots are a chunk of flash that holds the information.
     Seems to be paged 
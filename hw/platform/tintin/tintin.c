@@ -17,6 +17,7 @@
 #include <misc.h>
 
 #include "stm32_power.h"
+#include "display.h"
 
 extern void *strcpy(char *a2, const char *a1);
 
@@ -216,15 +217,16 @@ static void _display_write(unsigned char c) {
         ;
 }
 
-void hw_display_start_frame(uint8_t x, uint8_t y) {
+/* The memory LCD is addressed by line, so only the dirty rows get sent */
+void hw_display_start_frame(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax) {
     stm32_power_request(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
     stm32_power_request(STM32_POWER_APB1, RCC_APB1Periph_SPI2);
 
-    printf("tintin: here we go, slowly blitting %d %d\n", x, y);
+    printf("tintin: here we go, slowly blitting rows %d-%d\n", ymin, ymax);
     GPIO_WriteBit(GPIOB, 1 << 12, 1);
     delay_us(7);
     _display_write(0x80);
-    for (int i = 0; i < 168; i++) {
+    for (int i = ymin; i < ymax && i < 168; i++) {
         _display_write(__RBIT(__REV(167-i)));
         for (int j = 0; j < 18; j++)
             _display_write(__RBIT(__REV(_display_fb[i][j])));
@@ -236,6 +238,8 @@ void hw_display_start_frame(uint8_t x, uint8_t y) {
 
     stm32_power_release(STM32_POWER_APB1, RCC_APB1Periph_SPI2);
     stm32_power_release(STM32_POWER_AHB1, RCC_AHB1Periph_GPIOB);
+
+    display_done_ISR(0);
 }
 
 uint8_t *hw_display_get_buffer(void) {
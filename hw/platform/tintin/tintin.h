@@ -26,7 +26,7 @@ void delay_us(uint32_t us);
 void hw_display_init();
 void hw_display_reset();
 void hw_display_start();
-void hw_display_start_frame(uint8_t xoffset, uint8_t yoffset);
+void hw_display_start_frame(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax);
 uint8_t hw_display_get_state();
 uint8_t *hw_display_get_buffer(void);
 
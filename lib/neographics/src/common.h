@@ -40,6 +40,19 @@ void n_graphics_set_pixel(n_GContext * ctx, n_GPoint p, n_GColor color);
 void n_graphics_fill_pixel(n_GContext * ctx, n_GPoint p);
 void n_graphics_draw_pixel(n_GContext * ctx, n_GPoint p);
 
+// Sets pixel x in a framebuffer row. On b/w, color is a dither pattern like
+// the row/col fills take, picked from by the parity of x + y.
+static inline void n_graphics_prv_plot(uint8_t * row, int16_t x, int16_t y, uint8_t color) {
+#ifdef PBL_BW
+    if ((color >> ((x + y) & 1)) & 1)
+        row[x >> 3] |= 1 << (x & 7);
+    else
+        row[x >> 3] &= ~(1 << (x & 7));
+#else
+    row[x] = color;
+#endif
+}
+
 void n_graphics_prv_draw_col(uint8_t * fb,
         int16_t x, int16_t top, int16_t bottom,
         int16_t minx, int16_t maxx, int16_t miny, int16_t maxy,
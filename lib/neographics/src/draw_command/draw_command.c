@@ -248,12 +248,23 @@ void n_gdraw_command_sequence_set_bounds_size(n_GDrawCommandSequence * sequence,
 
 /* create with resource / clone / destroy */
 
-n_GDrawCommandImage * n_gdraw_command_image_create_with_resource(uint32_t resource_id) {
+// Images and sequences can be changed once created, so each gets its own copy
+// of the (cached) resource, less the 8 byte "PDCI"/"PDCS" + size header.
+static void * n_gdraw_command_prv_copy_resource(uint32_t resource_id) {
     ResHandle handle = resource_get_handle(resource_id);
-    size_t image_size = resource_size(handle) - 8;
-    n_GDrawCommandImage * image = malloc(image_size);
-    resource_load(handle, (uint8_t*)image, image_size);
-    return image;
+    uint8_t * data = resource_acquire(handle);
+    void * copy = NULL;
+    if (data && resource_size(handle) > 8) {
+        copy = app_malloc(resource_size(handle) - 8);
+        if (copy)
+            memcpy(copy, data + 8, resource_size(handle) - 8);
+    }
+    resource_release(data);
+    return copy;
+}
+
+n_GDrawCommandImage * n_gdraw_command_image_create_with_resource(uint32_t resource_id) {
+    return n_gdraw_command_prv_copy_resource(resource_id);
 }
 n_GDrawCommandImage * n_gdraw_command_image_clone(n_GDrawCommandImage * image) {
     return NULL; } // TODO
@@ -262,11 +273,7 @@ void n_gdraw_command_image_destroy(n_GDrawCommandImage * image) {
 }
 
 n_GDrawCommandSequence * n_gdraw_command_sequence_create_with_resource(uint32_t resource_id) {
-    ResHandle handle = resource_get_handle(resource_id);
-    size_t sequence_size = resource_size(handle) - 8;
-    n_GDrawCommandSequence * sequence = malloc(sequence_size);
-    resource_load(handle, (uint8_t*)sequence, sequence_size);
-    return sequence;
+    return n_gdraw_command_prv_copy_resource(resource_id);
 }
 n_GDrawCommandSequence * n_gdraw_command_sequence_clone(n_GDrawCommandSequence * image) {
     return NULL; }
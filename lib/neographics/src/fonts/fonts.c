@@ -25,7 +25,222 @@ uint8_t n_graphics_font_get_line_height(n_GFontInfo * font) {
     return font->line_height;
 }
 
+// Glyph lookup cache. Looking a glyph up means probing the font's hash
+// table, so remember the last few per font. Each font gets a small
+// set-associative table of codepoint -> glyph, evicting the least
+// recently used way, and fonts themselves are evicted LRU too.
+
+typedef struct n_GFontGlyphCacheSet {
+    uint32_t codepoint[__GLYPH_CACHE_WAYS];
+    n_GGlyphInfo * glyph[__GLYPH_CACHE_WAYS];
+    uint8_t next_victim;
+} n_GFontGlyphCacheSet;
+
+typedef struct n_GFontGlyphCache {
+    n_GFontInfo * font;
+    uint32_t last_used;
+    n_GFontGlyphCacheSet sets[__GLYPH_CACHE_SETS];
+} n_GFontGlyphCache;
+
+static n_GFontGlyphCache n_graphics_prv_glyph_cache[__GLYPH_CACHE_FONTS];
+static uint32_t n_graphics_prv_glyph_cache_clock;
+
+static n_GGlyphInfo * n_graphics_prv_font_lookup_glyph(n_GFontInfo * font, uint32_t codepoint);
+
+static void n_graphics_prv_glyph_cache_reset(n_GFontGlyphCache * cache, n_GFontInfo * font) {
+    cache->font = font;
+    for (uint8_t i = 0; i < __GLYPH_CACHE_SETS; i++)
+        for (uint8_t j = 0; j < __GLYPH_CACHE_WAYS; j++)
+            cache->sets[i].glyph[j] = NULL;
+}
+
+static n_GFontGlyphCache * n_graphics_prv_glyph_cache_for(n_GFontInfo * font) {
+    n_GFontGlyphCache * victim = &n_graphics_prv_glyph_cache[0];
+    for (uint8_t i = 0; i < __GLYPH_CACHE_FONTS; i++) {
+        n_GFontGlyphCache * cache = &n_graphics_prv_glyph_cache[i];
+        if (cache->font == font)
+            return cache;
+        if (cache->last_used < victim->last_used)
+            victim = cache;
+    }
+    n_graphics_prv_glyph_cache_reset(victim, font);
+    return victim;
+}
+
+void n_graphics_font_cache_flush(n_GFontInfo * font) {
+    for (uint8_t i = 0; i < __GLYPH_CACHE_FONTS; i++)
+        if (font == NULL || n_graphics_prv_glyph_cache[i].font == font) {
+            n_graphics_prv_glyph_cache_reset(&n_graphics_prv_glyph_cache[i], NULL);
+            n_graphics_prv_glyph_cache[i].last_used = 0;
+        }
+}
+
 n_GGlyphInfo * n_graphics_font_get_glyph_info(n_GFontInfo * font, uint32_t codepoint) {
+    n_GFontGlyphCache * cache = n_graphics_prv_glyph_cache_for(font);
+    n_GFontGlyphCacheSet * set = &cache->sets[codepoint % __GLYPH_CACHE_SETS];
+    cache->last_used = ++n_graphics_prv_glyph_cache_clock;
+
+    for (uint8_t i = 0; i < __GLYPH_CACHE_WAYS; i++)
+        if (set->glyph[i] && set->codepoint[i] == codepoint) {
+            // the other way is now the older one
+            set->next_victim = (i + 1) % __GLYPH_CACHE_WAYS;
+            return set->glyph[i];
+        }
+
+    uint8_t way = set->next_victim;
+    set->codepoint[way] = codepoint;
+    set->glyph[way] = n_graphics_prv_font_lookup_glyph(font, codepoint);
+    set->next_victim = (way + 1) % __GLYPH_CACHE_WAYS;
+    return set->glyph[way];
+}
+
+// Streamed fonts
+
+n_GFont n_graphics_font_stream_create(n_GFontReadFunc read, const void * context,
+        size_t context_size, void * (*alloc)(size_t)) {
+    n_GFontInfo info;
+    uint32_t data_offset;
+    uint8_t hash_table_size = 255, codepoint_bytes = 4, features = 0;
+
+    // version 1 headers are shorter, so this may read some hash table too
+    read((void *) context, 0, &info, sizeof(n_GFontInfo));
+    switch (info.version) {
+        case 1:
+            data_offset = __FONT_INFO_V1_LENGTH;
+            break;
+        case 2:
+            data_offset = __FONT_INFO_V2_LENGTH;
+            break;
+        default:
+            data_offset = info.fontinfo_size;
+    }
+    switch (info.version) {
+        default:
+            features = info.features;
+        case 2:
+            hash_table_size = info.hash_table_size;
+            codepoint_bytes = info.codepoint_bytes;
+        case 1:
+            break;
+    }
+    if (hash_table_size == 0)
+        return NULL;
+
+    // [info | stream | context | hash table | glyph cache], the context
+    // padded to keep the rest word aligned
+    size_t context_length = (context_size + 3) & ~3;
+    size_t hash_table_length = hash_table_size * sizeof(n_GFontHashTableEntry);
+    uint8_t * block = alloc(__FONT_STREAM_INFO_LENGTH + sizeof(n_GFontStream) +
+        context_length + hash_table_length + __FONT_STREAM_CACHE_SIZE);
+    if (block == NULL)
+        return NULL;
+
+    n_GFontInfo * font = (n_GFontInfo *) block;
+    n_GFontStream * stream = (n_GFontStream *) (block + __FONT_STREAM_INFO_LENGTH);
+
+    *font = info;
+    font->version = __FONT_VERSION_STREAM;
+    stream->glyph_amount = info.glyph_amount;
+    stream->hash_table_size = hash_table_size;
+    stream->codepoint_bytes = codepoint_bytes;
+    stream->features = features;
+    stream->offset_tables = data_offset + hash_table_length;
+    stream->read = read;
+    stream->context = (uint8_t *) stream + sizeof(n_GFontStream);
+    stream->hash_table = (n_GFontHashTableEntry *) ((uint8_t *) stream->context + context_length);
+    stream->cache = (uint8_t *) stream->hash_table + hash_table_length;
+    stream->cache_used = 0;
+    memcpy(stream->context, context, context_size);
+    read(stream->context, data_offset, stream->hash_table, hash_table_length);
+
+    return font;
+}
+
+void n_graphics_font_stream_destroy(n_GFontInfo * font, void (*dealloc)(void *)) {
+    n_graphics_font_cache_flush(font);
+    dealloc(font);
+}
+
+bool n_graphics_font_is_stream(n_GFontInfo * font) {
+    return font->version == __FONT_VERSION_STREAM;
+}
+
+// Offset table entries are little endian, and 2 or 4 bytes
+static uint32_t n_graphics_prv_font_stream_value(const uint8_t * data, uint8_t bytes) {
+    return bytes == 2 ? data[0] | data[1] << 8
+                      : data[0] | data[1] << 8 | data[2] << 16 | (uint32_t) data[3] << 24;
+}
+
+static n_GFontStream * n_graphics_prv_font_stream(n_GFontInfo * font) {
+    return (n_GFontStream *) ((uint8_t *) font + __FONT_STREAM_INFO_LENGTH);
+}
+
+static n_GGlyphInfo * n_graphics_prv_font_stream_lookup_glyph(n_GFontInfo * font, uint32_t codepoint) {
+    n_GFontStream * stream = n_graphics_prv_font_stream(font);
+    uint8_t offset_bytes = stream->features & n_GFontFeature2ByteGlyphOffset ? 2 : 4;
+    uint8_t offset_table_item_length = stream->codepoint_bytes + offset_bytes;
+    uint32_t glyphs = stream->offset_tables +
+        offset_table_item_length * stream->glyph_amount;
+    // Tofu, unless we find it
+    uint32_t glyph_offset = 4;
+
+    n_GFontHashTableEntry * hash_data =
+        &stream->hash_table[codepoint % stream->hash_table_size];
+
+    if (hash_data->hash_value == codepoint % stream->hash_table_size) {
+        // Go through the offset table a few entries at a time
+        uint8_t entries[8 * 8];
+        uint32_t offset = stream->offset_tables + hash_data->offset_table_offset;
+        uint16_t left = hash_data->offset_table_size;
+        bool found = false;
+        while (left && !found) {
+            uint8_t count = left > 8 ? 8 : left;
+            stream->read(stream->context, offset, entries, count * offset_table_item_length);
+            for (uint8_t i = 0; i < count; i++) {
+                uint8_t * entry = entries + i * offset_table_item_length;
+                if (n_graphics_prv_font_stream_value(entry, stream->codepoint_bytes) == codepoint) {
+                    glyph_offset = n_graphics_prv_font_stream_value(
+                        entry + stream->codepoint_bytes, offset_bytes);
+                    found = true;
+                    break;
+                }
+            }
+            offset += count * offset_table_item_length;
+            left -= count;
+        }
+    }
+
+    n_GGlyphInfo header;
+    stream->read(stream->context, glyphs + glyph_offset, &header, sizeof(n_GGlyphInfo));
+    size_t length = sizeof(n_GGlyphInfo) + (header.width * header.height + 7) / 8;
+    if (length > __FONT_STREAM_CACHE_SIZE) {
+        // Too big to ever fit. Make do with an empty one that takes up
+        // the right amount of space.
+        header.width = header.height = 0;
+        length = sizeof(n_GGlyphInfo);
+    }
+
+    if (stream->cache_used + length > __FONT_STREAM_CACHE_SIZE) {
+        // Full. Start again, and forget where the old glyphs were.
+        stream->cache_used = 0;
+        n_graphics_prv_glyph_cache_reset(
+            n_graphics_prv_glyph_cache_for(font), font);
+    }
+
+    n_GGlyphInfo * glyph = (n_GGlyphInfo *) (stream->cache + stream->cache_used);
+    *glyph = header;
+    if (length > sizeof(n_GGlyphInfo))
+        stream->read(stream->context, glyphs + glyph_offset + sizeof(n_GGlyphInfo),
+            glyph->data, length - sizeof(n_GGlyphInfo));
+    stream->cache_used += length;
+
+    return glyph;
+}
+
+static n_GGlyphInfo * n_graphics_prv_font_lookup_glyph(n_GFontInfo * font, uint32_t codepoint) {
+    if (font->version == __FONT_VERSION_STREAM)
+        return n_graphics_prv_font_stream_lookup_glyph(font, codepoint);
+
     uint8_t * data;
     uint8_t hash_table_size = 255, codepoint_bytes = 4, features = 0;
     switch (font->version) {
@@ -90,16 +305,73 @@ n_GGlyphInfo * n_graphics_font_get_glyph_info(n_GFontInfo * font, uint32_t codep
     return glyph;
 }
 
+// Glyph bitmaps are one bit per pixel, LSB first, with rows running on
+// from one another without padding. Get up to 8 bits from bit offset pos.
+static uint8_t n_graphics_prv_glyph_bits(const uint8_t * data, uint32_t pos, uint8_t count) {
+    uint16_t bits = data[pos / 8];
+    if (pos % 8 + count > 8)
+        bits |= data[pos / 8 + 1] << 8;
+    return (bits >> (pos % 8)) & ((1 << count) - 1);
+}
+
 void n_graphics_font_draw_glyph_bounded(n_GContext * ctx, n_GGlyphInfo * glyph,
     n_GPoint p, int16_t minx, int16_t maxx, int16_t miny, int16_t maxy) {
     p.x += glyph->left_offset;
     p.y += glyph->top_offset;
-    for (uint8_t y = 0; y < glyph->height; y++)
-        for (uint8_t x = 0; x < glyph->width; x++)
-            if (glyph->data[(y*glyph->width+x)/8] & (1 << ((y*glyph->width+x) % 8)) &&
-                    p.x + x >= minx && p.x + x < maxx &&
-                    p.y + y >= miny && p.y + y < maxy)
-                n_graphics_set_pixel(ctx, n_GPoint(p.x + x, p.y + y), ctx->text_color);
+
+    // clip once, in glyph coordinates
+    int16_t x0 = __BOUND_NUM(0, minx - p.x, glyph->width),
+            x1 = __BOUND_NUM(0, maxx - p.x, glyph->width),
+            y0 = __BOUND_NUM(0, miny - p.y, glyph->height),
+            y1 = __BOUND_NUM(0, maxy - p.y, glyph->height);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+#ifdef PBL_BW
+    bool white = ctx->text_color.argb & 0b111111;
+#else
+    uint8_t color = ctx->text_color.argb;
+#endif
+
+    for (int16_t y = y0; y < y1; y++) {
+        uint8_t * row = ctx->fbuf + (p.y + y) * __SCREEN_FRAMEBUFFER_ROW_BYTE_AMOUNT;
+        uint32_t row_bit = y * glyph->width;
+#ifdef PBL_BW
+        // The framebuffer is LSB first too, so take as many glyph bits as
+        // fit in the next framebuffer byte and write them in one go.
+        int16_t x = x0;
+        while (x < x1) {
+            int16_t sx = p.x + x;
+            uint8_t count = 8 - sx % 8;
+            if (count > x1 - x)
+                count = x1 - x;
+            uint8_t bits = n_graphics_prv_glyph_bits(glyph->data, row_bit + x, count) << (sx % 8);
+            if (white)
+                row[sx / 8] |= bits;
+            else
+                row[sx / 8] &= ~bits;
+            x += count;
+        }
+#else
+        // Find runs of set pixels and fill each run in one go.
+        int16_t x = x0;
+        while (x < x1) {
+            uint8_t count = x1 - x > 8 ? 8 : x1 - x;
+            uint8_t bits = n_graphics_prv_glyph_bits(glyph->data, row_bit + x, count);
+            if (bits == 0) {
+                x += count;
+                continue;
+            }
+            // skip to the run, then measure it
+            while (!(bits & 1))
+                bits >>= 1, x++;
+            int16_t start = x;
+            while (x < x1 && (glyph->data[(row_bit + x) / 8] & (1 << ((row_bit + x) % 8))))
+                x++;
+            memset(row + p.x + start, color, x - start);
+        }
+#endif
+    }
 }
 
 void n_graphics_font_draw_glyph(n_GContext * ctx, n_GGlyphInfo * glyph, n_GPoint p) {
@@ -72,8 +72,63 @@ typedef struct n_GGlyphInfo {
 
 typedef n_GFontInfo * n_GFont;
 
+// Glyph lookup cache: how many fonts to remember glyphs for, and how many
+// glyphs per font (sets * ways).
+#ifndef __GLYPH_CACHE_FONTS
+#define __GLYPH_CACHE_FONTS 4
+#endif
+#ifndef __GLYPH_CACHE_SETS
+#define __GLYPH_CACHE_SETS 16
+#endif
+#ifndef __GLYPH_CACHE_WAYS
+#define __GLYPH_CACHE_WAYS 2
+#endif
+
+// Streamed fonts. Only the header and hash table are kept in memory; the
+// offset tables and glyphs are read through read() as they're looked up,
+// and glyphs are kept in __FONT_STREAM_CACHE_SIZE bytes that get emptied
+// whenever they fill up. So a glyph from a streamed font is only good until
+// the next glyph lookup.
+#ifndef __FONT_STREAM_CACHE_SIZE
+#define __FONT_STREAM_CACHE_SIZE 1024
+#endif
+#define __FONT_VERSION_STREAM 0xFF
+
+typedef void (*n_GFontReadFunc)(void * context, uint32_t offset, void * buffer, size_t length);
+
+// A streamed font is one block: [info | stream | context | hash table |
+// glyph cache]. The n_GFont points at info, a copy of the font's header
+// but with version __FONT_VERSION_STREAM. The rest of the state isn't
+// packed, so it starts at the next 8 byte boundary after info.
+#define __FONT_STREAM_INFO_LENGTH ((sizeof(n_GFontInfo) + 7) & ~7)
+
+typedef struct n_GFontStream {
+    uint16_t glyph_amount;
+    uint8_t hash_table_size;
+    uint8_t codepoint_bytes;
+    uint8_t features;
+    uint32_t offset_tables; // where they start in the font
+    n_GFontReadFunc read;
+    void * context; // a copy of the one given to create
+    n_GFontHashTableEntry * hash_table;
+    uint8_t * cache;
+    uint16_t cache_used;
+} n_GFontStream;
+
 uint8_t n_graphics_font_get_line_height(n_GFont font);
 
+// Start streaming a font. context (context_size bytes) is copied in with
+// it, and the copy passed to read(). Everything is in one block from
+// alloc; give it back with n_graphics_font_stream_destroy.
+n_GFont n_graphics_font_stream_create(n_GFontReadFunc read, const void * context,
+    size_t context_size, void * (*alloc)(size_t));
+void n_graphics_font_stream_destroy(n_GFont font, void (*dealloc)(void *));
+bool n_graphics_font_is_stream(n_GFont font);
+
+// Forget cached glyphs for font, or for all fonts if NULL.
+// Must be called before font's memory is freed.
+void n_graphics_font_cache_flush(n_GFont font);
+
 n_GGlyphInfo * n_graphics_font_get_glyph_info(n_GFont font, uint32_t charcode);
 
 void n_graphics_font_draw_glyph(n_GContext * ctx, n_GGlyphInfo * glyph, n_GPoint p);
@@ -37,28 +37,6 @@ void n_gpath_destroy(n_GPath * path) {
 
 // --- //
 
-static void n_prv_bubblesort(int16_t * numbers, uint32_t amt) {
-    // Yes, bubblesort is sub-ideal. However, bubblesort is absolutely enough
-    // for 2-8 lines which will usually pass through a scanline.
-    if (!amt)
-        return;
-    bool swapped;
-    int16_t tmp;
-    do {
-        swapped = false;
-        for (uint32_t i = 0; i < amt-1; i++) {
-            if (numbers[i] > numbers[i+1]) {
-                tmp = numbers[i+1];
-                numbers[i+1] = numbers[i];
-                numbers[i] = tmp;
-                swapped = true;
-            }
-        }
-    } while(swapped);
-}
-
-// --- //
-
 void n_graphics_draw_path(n_GContext * ctx, uint32_t num_points, n_GPoint * points, bool open) {
     for (uint32_t p = 0; p < num_points - 1; p++)
         n_graphics_draw_line(ctx, points[p], points[p + 1]);
@@ -77,149 +55,197 @@ void n_graphics_draw_ppath(n_GContext * ctx, uint32_t num_points, n_GPoint * poi
             n_GPoint((points[0].x + 4) >> 3, (points[0].y + 4) >> 3));
 }
 
-static void n_graphics_fill_path_bounded(n_GContext * ctx, uint32_t num_points, n_GPoint * points,
-                                         int16_t minx, int16_t maxx, int16_t miny, int16_t maxy) {
-#ifdef PBL_BW
-    uint8_t color = __ARGB_TO_INTERNAL(ctx->fill_color.argb);
-#endif
+// Paths are filled with an active edge list: the edges are sorted by their
+// top scanline, and only the edges crossing the current scanline are looked
+// at. Each active edge steps its x along one row at a time with a running
+// quotient and remainder, so there's no division in the inner loop.
+//
+// An edge covers the rows from its start point up to but not including its
+// end point, and its x on a row is
+//   x0 + (dx * (y - y0) * 2 + sign(dx) * dy) / (dy * 2)
+// rounded towards zero. Both terms of the numerator always have the sign of
+// dx, so that's x0 + sign(dx) * floor((2|dx||y - y0| + |dy|) / 2|dy|). An
+// edge also covers its end row if the end point is a local extremum, so that
+// a lone vertex touching a scanline counts twice and doesn't flip the fill.
+
+typedef struct n_GPathEdge {
+    int16_t top, bottom; // rows covered, inclusive
+    int16_t x0, y0;      // start point
+    int8_t sign;         // of dx
+    int8_t dir;          // +1 if |y - y0| grows going down, -1 if it shrinks
+    int32_t q, r;        // floor and remainder of the numerator / den
+    int32_t den, step_q, step_r;
+} n_GPathEdge;
+
+static n_GPoint n_graphics_prv_path_point(n_GPoint * points, uint32_t i, bool fixed) {
+    if (fixed)
+        return n_GPoint((points[i].x + 4) >> 3, (points[i].y + 4) >> 3);
+    return points[i];
+}
 
-    // Minimize size we iterate over
-    int16_t _maxy = miny, _miny = maxy;
+static uint32_t n_graphics_prv_build_edges(n_GPathEdge * edges, uint32_t num_points,
+                                           n_GPoint * points, bool fixed, int16_t * bottom) {
+    uint32_t num_edges = 0;
     for (uint32_t i = 0; i < num_points; i++) {
-        if (points[i].y < _miny) _miny = points[i].y;
-        if (points[i].y > _maxy) _maxy = points[i].y;
-    }
-    maxy = __BOUND_NUM(miny, _maxy, maxy);
-    miny = __BOUND_NUM(miny, _miny, maxy);
-
-    // Further optimization may be possible here to minimize unnecessary allocation
-    int16_t * x_positions = malloc(sizeof(int16_t) * num_points);
-
-    for (int16_t y = miny; y <= maxy; y++) {
-        uint32_t num_x_positions = 0;
-        uint32_t b, i, n; // b, i, n == before, iter, next
-        for (i = 0; i < num_points; i++) {
-            b = (num_points + i - 1) % num_points;
-            n = (             i + 1) % num_points;
-
-            if ( (points[i].y <= y && points[n].y > y) ||
-                 (points[i].y >= y && points[n].y < y) ) {
-                bool rep = false;
-                int16_t dx = points[n].x - points[i].x,
-                        dy = points[n].y - points[i].y;
-                int8_t e = (dx == 0 ? 0 : (dx > 0 ? 1 : -1));
-
-                x_positions[num_x_positions] =
-                    points[i].x + (dx * (y - points[i].y) * 2 + e * dy) / (dy * 2);
-                num_x_positions += 1;
-
-                // If we're at a corner, add the position twice.
-                // We don't have to worry about going out of bounds of
-                // the array `x_positions` since being at a corner implies
-                // that at least one other point isn't in this scanline.
-                if ( (points[i].y == y &&
-                      points[b].y  < y && points[n].y < y) ||
-                     (points[i].y == y &&
-                      points[b].y  > y && points[n].y > y) ) {
-                    x_positions[num_x_positions] = x_positions[num_x_positions - 1];
-                    num_x_positions += 1;
-                }
-            }
+        n_GPoint p = n_graphics_prv_path_point(points, i, fixed),
+                 q = n_graphics_prv_path_point(points, (i + 1) % num_points, fixed),
+                 n = n_graphics_prv_path_point(points, (i + 2) % num_points, fixed);
+        int32_t dx = q.x - p.x, dy = q.y - p.y;
+        if (p.y > *bottom)
+            *bottom = p.y;
+        if (dy == 0)
+            continue;
+
+        // Does the next edge turn back the way we came?
+        bool extremum = (dy > 0) ? (n.y < q.y) : (n.y > q.y);
+
+        n_GPathEdge edge = {
+            .x0 = p.x, .y0 = p.y,
+            .sign = (dx == 0 ? 0 : (dx > 0 ? 1 : -1)),
+            .dir = (dy > 0 ? 1 : -1),
+            .den = 2 * (dy > 0 ? dy : -dy),
+        };
+        if (dy > 0) {
+            edge.top = p.y;
+            edge.bottom = extremum ? q.y : q.y - 1;
+        } else {
+            edge.top = extremum ? q.y : q.y + 1;
+            edge.bottom = p.y;
         }
-        n_prv_bubblesort(x_positions, num_x_positions);
-        for (uint32_t p = 0; (p + 1) < num_x_positions; p += 2) {
-            // We're not going to draw the path. Also, only actually draw if
-            // there is something to be drawn.
-            if (x_positions[p] <= x_positions[p+1] - 2)
-#ifdef PBL_BW
-                n_graphics_prv_draw_row(ctx->fbuf, y, x_positions[p] + 1, x_positions[p+1] - 1,
-                                        minx, maxx, miny, maxy, color);
-#else
-                n_graphics_prv_draw_row(ctx->fbuf, y, x_positions[p] + 1, x_positions[p+1] - 1,
-                                        minx, maxx, miny, maxy, ctx->fill_color.argb);
-#endif
+        edge.step_q = 2 * (dx > 0 ? dx : -dx) / edge.den;
+        edge.step_r = 2 * (dx > 0 ? dx : -dx) % edge.den;
+
+        // Keep them sorted by top row, there's only a handful.
+        uint32_t j = num_edges++;
+        while (j > 0 && edges[j - 1].top > edge.top) {
+            edges[j] = edges[j - 1];
+            j--;
         }
+        edges[j] = edge;
     }
-    free(x_positions);
+    return num_edges;
+}
+
+static void n_graphics_prv_edge_start(n_GPathEdge * edge, int16_t y) {
+    int32_t t = y - edge->y0, dx2 = edge->step_q * edge->den + edge->step_r;
+    int32_t num = dx2 * (t > 0 ? t : -t) + edge->den / 2;
+    edge->q = num / edge->den;
+    edge->r = num % edge->den;
 }
 
-static void n_graphics_fill_ppath_bounded(n_GContext * ctx, uint32_t num_points, n_GPoint * _points,
-                                         int16_t minx, int16_t maxx, int16_t miny, int16_t maxy) {
-    n_GPoint * points = malloc(sizeof(n_GPoint) * num_points);
-    for (uint32_t n = 0; n < num_points; n++) {
-        points[n] = n_GPoint((_points[n].x + 4) >> 3, (_points[n].y + 4) >> 3);
+static void n_graphics_prv_edge_step(n_GPathEdge * edge) {
+    if (edge->dir > 0) {
+        edge->q += edge->step_q;
+        edge->r += edge->step_r;
+        if (edge->r >= edge->den) {
+            edge->r -= edge->den;
+            edge->q++;
+        }
+    } else {
+        edge->q -= edge->step_q;
+        edge->r -= edge->step_r;
+        if (edge->r < 0) {
+            edge->r += edge->den;
+            edge->q--;
+        }
     }
+}
+
+static void n_graphics_prv_fill_edges(n_GContext * ctx, n_GPathEdge * edges, uint32_t num_edges,
+                                      n_GPathEdge ** active, int16_t * x_positions,
+                                      int16_t minx, int16_t maxx, int16_t miny, int16_t maxy) {
 #ifdef PBL_BW
     uint8_t color = __ARGB_TO_INTERNAL(ctx->fill_color.argb);
+#else
+    uint8_t color = ctx->fill_color.argb;
 #endif
+    uint32_t next_edge = 0, num_active = 0;
 
-    // Minimize size we iterate over
-    int16_t _maxy = miny, _miny = maxy;
-    for (uint32_t i = 0; i < num_points; i++) {
-        if (points[i].y < _miny) _miny = points[i].y;
-        if (points[i].y > _maxy) _maxy = points[i].y;
-    }
-    maxy = __BOUND_NUM(miny, _maxy, maxy);
-    miny = __BOUND_NUM(miny, _miny, maxy);
-
-    // Further optimization may be possible here to minimize unnecessary allocation
-    int16_t * x_positions = malloc(sizeof(int16_t) * num_points);
-
-    for (int16_t y = miny; y <= maxy; y++) {
-        uint32_t num_x_positions = 0;
-        uint32_t b, i, n; // b, i, n == before, iter, next
-        for (i = 0; i < num_points; i++) {
-            b = (num_points + i - 1) % num_points;
-            n = (             i + 1) % num_points;
-
-            if ( (points[i].y <= y && points[n].y > y) ||
-                 (points[i].y >= y && points[n].y < y) ) {
-                bool rep = false;
-                int16_t dx = points[n].x - points[i].x,
-                        dy = points[n].y - points[i].y;
-                int8_t e = (dx == 0 ? 0 : (dx > 0 ? 1 : -1));
-
-                x_positions[num_x_positions] =
-                    points[i].x + (dx * (y - points[i].y) * 2 + e * dy) / (dy * 2);
-                num_x_positions += 1;
-
-                // If we're at a corner, add the position twice.
-                // We don't have to worry about going out of bounds of
-                // the array `x_positions` since being at a corner implies
-                // that at least one other point isn't in this scanline.
-                if ( (points[i].y == y &&
-                      points[b].y  < y && points[n].y < y) ||
-                     (points[i].y == y &&
-                      points[b].y  > y && points[n].y > y) ) {
-                    x_positions[num_x_positions] = x_positions[num_x_positions - 1];
-                    num_x_positions += 1;
-                }
+    if (!num_edges)
+        return;
+
+    for (int16_t y = __BOUND_NUM(miny, edges[0].top, maxy); y < maxy; y++) {
+        // Drop finished edges, pick up new ones.
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < num_active; i++) {
+            if (active[i]->bottom >= y) {
+                n_graphics_prv_edge_step(active[i]);
+                active[kept++] = active[i];
+            }
+        }
+        num_active = kept;
+        while (next_edge < num_edges && edges[next_edge].top <= y) {
+            if (edges[next_edge].bottom >= y) {
+                n_graphics_prv_edge_start(&edges[next_edge], y);
+                active[num_active++] = &edges[next_edge];
+            }
+            next_edge++;
+        }
+        if (!num_active) {
+            if (next_edge == num_edges)
+                return;
+            y = edges[next_edge].top - 1;
+            continue;
+        }
+
+        // Insertion sort; the order barely changes between rows.
+        for (uint32_t i = 0; i < num_active; i++) {
+            int16_t x = active[i]->x0 + active[i]->sign * active[i]->q;
+            uint32_t j = i;
+            while (j > 0 && x_positions[j - 1] > x) {
+                x_positions[j] = x_positions[j - 1];
+                j--;
             }
+            x_positions[j] = x;
         }
-        n_prv_bubblesort(x_positions, num_x_positions);
-        for (uint32_t p = 0; (p + 1) < num_x_positions; p += 2) {
+
+        for (uint32_t p = 0; (p + 1) < num_active; p += 2) {
             // We're not going to draw the path. Also, only actually draw if
             // there is something to be drawn.
             if (x_positions[p] <= x_positions[p+1] - 2)
-#ifdef PBL_BW
                 n_graphics_prv_draw_row(ctx->fbuf, y, x_positions[p] + 1, x_positions[p+1] - 1,
                                         minx, maxx, miny, maxy, color);
-#else
-                n_graphics_prv_draw_row(ctx->fbuf, y, x_positions[p] + 1, x_positions[p+1] - 1,
-                                        minx, maxx, miny, maxy, ctx->fill_color.argb);
-#endif
         }
     }
-    free(x_positions);
-    free(points);
+}
+
+static void n_graphics_prv_fill_path_bounded(n_GContext * ctx, uint32_t num_points,
+                                             n_GPoint * points, bool fixed,
+                                             int16_t minx, int16_t maxx, int16_t miny, int16_t maxy) {
+    n_GPathEdge stack_edges[__PATH_FILL_STACK_EDGES];
+    n_GPathEdge * stack_active[__PATH_FILL_STACK_EDGES];
+    int16_t stack_x_positions[__PATH_FILL_STACK_EDGES];
+    n_GPathEdge * edges = stack_edges;
+    n_GPathEdge ** active = stack_active;
+    int16_t * x_positions = stack_x_positions;
+
+    // Only unusually big paths need the heap.
+    if (num_points > __PATH_FILL_STACK_EDGES) {
+        edges = malloc(num_points * (sizeof(n_GPathEdge) + sizeof(n_GPathEdge *) + sizeof(int16_t)));
+        if (!edges)
+            return;
+        active = (n_GPathEdge **) (edges + num_points);
+        x_positions = (int16_t *) (active + num_points);
+    }
+
+    // The lowest row of the path is left out, as it always has been.
+    int16_t bottom = miny;
+    uint32_t num_edges = n_graphics_prv_build_edges(edges, num_points, points, fixed, &bottom);
+    n_graphics_prv_fill_edges(ctx, edges, num_edges, active, x_positions,
+                              minx, maxx, miny, __BOUND_NUM(miny, bottom, maxy));
+
+    if (edges != stack_edges)
+        free(edges);
 }
 
 void n_graphics_fill_path(n_GContext * ctx, uint32_t num_points, n_GPoint * points) {
-    n_graphics_fill_path_bounded(ctx, num_points, points, 0, __SCREEN_WIDTH, 0, __SCREEN_HEIGHT);
+    n_graphics_prv_fill_path_bounded(ctx, num_points, points, false,
+                                     0, __SCREEN_WIDTH, 0, __SCREEN_HEIGHT);
 }
 
 void n_graphics_fill_ppath(n_GContext * ctx, uint32_t num_points, n_GPoint * points) {
-    n_graphics_fill_ppath_bounded(ctx, num_points, points, 0, __SCREEN_WIDTH, 0, __SCREEN_HEIGHT);
+    n_graphics_prv_fill_path_bounded(ctx, num_points, points, true,
+                                     0, __SCREEN_WIDTH, 0, __SCREEN_HEIGHT);
 }
 
 // --- //
@@ -255,11 +281,15 @@ void n_gpath_fill(n_GContext * ctx, n_GPath * path) {
     if (!(ctx->fill_color.argb & (0b11 << 6)))
         return;
     // n_gpath_fill_bounded(ctx, path, 0, __SCREEN_WIDTH, 0, __SCREEN_HEIGHT);
-    n_GPoint * points = malloc(sizeof(n_GPoint) * path->num_points);
+    n_GPoint stack_points[__PATH_FILL_STACK_EDGES];
+    n_GPoint * points = stack_points;
+    if (path->num_points > __PATH_FILL_STACK_EDGES)
+        points = malloc(sizeof(n_GPoint) * path->num_points);
     n_prv_transform_points(path->num_points, path->points, points,
         path->angle, path->offset);
     n_graphics_fill_path(ctx, path->num_points, points);
-    free(points);
+    if (points != stack_points)
+        free(points);
 }
 
 // --- //
@@ -26,6 +26,11 @@
 
 #include "../primitives/line.h"
 
+// Paths with up to this many points are filled without touching the heap.
+#ifndef __PATH_FILL_STACK_EDGES
+#define __PATH_FILL_STACK_EDGES 16
+#endif
+
 typedef struct {
     uint32_t num_points;
     n_GPoint * points;
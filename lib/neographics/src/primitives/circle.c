@@ -52,51 +52,67 @@ void n_graphics_fill_circle_bounded(n_GContext * ctx, n_GPoint p, uint16_t radiu
     }
 }
 
+// Plots one of the circle's eight mirrored points, checking bounds only if
+// the circle isn't entirely on screen.
+#define __CIRCLE_PLOT(row, x, y) \
+    if (!clip || ((x) >= minx && (x) < maxx && (y) >= miny && (y) < maxy)) \
+        n_graphics_prv_plot((row), (x), (y), color)
+
 void n_graphics_draw_circle_1px_bounded(n_GContext * ctx, n_GPoint p, uint16_t radius, int16_t minx, int16_t maxx, int16_t miny, int16_t maxy) {
     uint16_t a = radius,
              b = 0;
     int16_t err = 1 - a,
              err_a = -a * 2,
              err_b = 1;
+#ifdef PBL_BW
+    uint8_t color = (ctx->stroke_color.argb & 0b111111) ? 0b11111111 : 0;
+#else
+    uint8_t color = ctx->stroke_color.argb;
+#endif
+    // (a would wrap below zero for radius 0)
+    if (radius == 0 ||
+        p.x + radius < minx || p.x - radius >= maxx ||
+        p.y + radius < miny || p.y - radius >= maxy)
+        return;
+    bool clip = !(p.x - radius >= minx && p.x + radius < maxx &&
+                  p.y - radius >= miny && p.y + radius < maxy);
+
+    // Rows p.y + b, p.y - b, p.y + a and p.y - a, stepped along with a and b.
+    const int16_t stride = __SCREEN_FRAMEBUFFER_ROW_BYTE_AMOUNT;
+    uint8_t * center = ctx->fbuf + p.y * stride,
+            * row_pb = center,
+            * row_mb = center,
+            * row_pa = center + a * stride,
+            * row_ma = center - a * stride;
     while (b <= a) {
-        if (p.x + a >= minx && p.x + a < maxx) {
-            if (p.y + b >= miny && p.y + b < maxy)
-                n_graphics_draw_pixel(ctx, n_GPoint(p.x + a, p.y + b));
-            if (p.y - b >= miny && p.y - b < maxy)
-                n_graphics_draw_pixel(ctx, n_GPoint(p.x + a, p.y - b));
-        }
-        if (p.x - a >= minx && p.x - a < maxx) {
-            if (p.y + b >= miny && p.y + b < maxy)
-                n_graphics_draw_pixel(ctx, n_GPoint(p.x - a, p.y + b));
-            if (p.y - b >= miny && p.y - b < maxy)
-                n_graphics_draw_pixel(ctx, n_GPoint(p.x - a, p.y - b));
-        }
-        if (p.x + b >= minx && p.x + b < maxx) {
-            if (p.y + a >= miny && p.y + a < maxy)
-                n_graphics_draw_pixel(ctx, n_GPoint(p.x + b, p.y + a));
-            if (p.y - a >= miny && p.y - a < maxy)
-                n_graphics_draw_pixel(ctx, n_GPoint(p.x + b, p.y - a));
-        }
-        if (p.x - b >= minx && p.x - b < maxx) {
-            if (p.y + a >= miny && p.y + a < maxy)
-                n_graphics_draw_pixel(ctx, n_GPoint(p.x - b, p.y + a));
-            if (p.y - a >= miny && p.y - a < maxy)
-                n_graphics_draw_pixel(ctx, n_GPoint(p.x - b, p.y - a));
-        }
+        __CIRCLE_PLOT(row_pb, p.x + a, p.y + b);
+        __CIRCLE_PLOT(row_mb, p.x + a, p.y - b);
+        __CIRCLE_PLOT(row_pb, p.x - a, p.y + b);
+        __CIRCLE_PLOT(row_mb, p.x - a, p.y - b);
+        __CIRCLE_PLOT(row_pa, p.x + b, p.y + a);
+        __CIRCLE_PLOT(row_ma, p.x + b, p.y - a);
+        __CIRCLE_PLOT(row_pa, p.x - b, p.y + a);
+        __CIRCLE_PLOT(row_ma, p.x - b, p.y - a);
         if (err >= 0) {
             a -= 1;
             b += 1;
             err_a += 2;
             err_b += 2;
             err += err_a + err_b;
+            row_pa -= stride;
+            row_ma += stride;
         } else {
             b += 1;
             err_b += 2;
             err += err_b + 1;
         }
+        row_pb += stride;
+        row_mb -= stride;
     }
 }
 
+#undef __CIRCLE_PLOT
+
 void n_graphics_prv_draw_quarter_circle_bounded(n_GContext * ctx, n_GPoint p,
         uint16_t radius, uint16_t width, int8_t x_dir, int8_t y_dir,
         int16_t minx, int16_t maxx, int16_t miny, int16_t maxy) {
@@ -21,6 +21,13 @@
 
 #include "line.h"
 
+// Sloped lines are stepped Bresenham-style: the framebuffer row pointer and
+// the minor coordinate move along with a running remainder, so there's no
+// multiply or divide per pixel. The pixels are the same ones the old
+// per-pixel formula picked,
+//   minor = from + (d_minor * t * 2 + sign * d_major) / (d_major * 2)
+// (rounded towards zero), which is from + sign * floor((2|d_minor|t + d_major)
+// / 2d_major) since both terms of the numerator share a sign.
 void n_graphics_prv_draw_1px_line_bounded(n_GContext * ctx,
                                              n_GPoint from, n_GPoint to,
                                              int16_t minx, int16_t maxx,
@@ -28,7 +35,16 @@ void n_graphics_prv_draw_1px_line_bounded(n_GContext * ctx,
     bool iterate_over_y = false;
 #ifdef PBL_BW
     uint8_t color = __ARGB_TO_INTERNAL(ctx->stroke_color.argb);
+#else
+    uint8_t color = ctx->stroke_color.argb;
 #endif
+    // Entirely outside? Nothing to do. Entirely inside? No checks needed.
+    if ((from.x < minx && to.x < minx) || (from.x >= maxx && to.x >= maxx) ||
+        (from.y < miny && to.y < miny) || (from.y >= maxy && to.y >= maxy))
+        return;
+    bool clip = !(from.x >= minx && from.x < maxx && to.x >= minx && to.x < maxx &&
+                  from.y >= miny && from.y < maxy && to.y >= miny && to.y < maxy);
+
     int16_t dy = (to.y - from.y), dx = (to.x - from.x);
     if (abs(dy) > abs(dx)) {
         iterate_over_y = true;
@@ -46,24 +62,23 @@ void n_graphics_prv_draw_1px_line_bounded(n_GContext * ctx,
         int16_t begin = __BOUND_NUM(miny, from.y, maxy - 1);
         int16_t end = __BOUND_NUM(miny, to.y, maxy - 1);
         if (e == 0) {
-#ifdef PBL_BW
             n_graphics_prv_draw_col(ctx->fbuf, from.x, from.y, to.y,
                                     minx, maxx, miny, maxy, color);
-#else
-            n_graphics_prv_draw_col(ctx->fbuf, from.x, from.y, to.y,
-                                    minx, maxx, miny, maxy, ctx->stroke_color.argb);
-#endif
         } else {
+            int32_t den = dy * 2, inc = abs(dx) * 2,
+                    num = inc * (begin - from.y) + dy;
+            int32_t r = num % den;
+            int16_t x = from.x + e * (num / den);
+            uint8_t * row = ctx->fbuf + begin * __SCREEN_FRAMEBUFFER_ROW_BYTE_AMOUNT;
             for (int16_t y = begin; y <= end; y++) {
-                int16_t x = (dx * (y-from.y) * 2 + e * dy) / (dy * 2) + from.x;
-#ifdef PBL_BW
-                n_graphics_set_pixel(ctx, n_GPoint(x, y),
-                    ((color >> ((x + y) % 2)) & 1) ?
-                        (n_GColor) {.argb = 1} :
-                        (n_GColor) {.argb = 0});
-#else
-                n_graphics_set_pixel(ctx, n_GPoint(x, y), ctx->stroke_color);
-#endif
+                if (!clip || (x >= minx && x < maxx))
+                    n_graphics_prv_plot(row, x, y, color);
+                row += __SCREEN_FRAMEBUFFER_ROW_BYTE_AMOUNT;
+                r += inc;
+                if (r >= den) {
+                    r -= den;
+                    x += e;
+                }
             }
         }
     } else {
@@ -71,24 +86,24 @@ void n_graphics_prv_draw_1px_line_bounded(n_GContext * ctx,
         int16_t begin = __BOUND_NUM(minx, from.x, maxx - 1);
         int16_t end = __BOUND_NUM(minx, to.x, maxx - 1);
         if (e == 0) {
-#ifdef PBL_BW
             n_graphics_prv_draw_row(ctx->fbuf, from.y, from.x, to.x,
                                     minx, maxx, miny, maxy, color);
-#else
-            n_graphics_prv_draw_row(ctx->fbuf, from.y, from.x, to.x,
-                                    minx, maxx, miny, maxy, ctx->stroke_color.argb);
-#endif
         } else {
+            int32_t den = dx * 2, inc = abs(dy) * 2,
+                    num = inc * (begin - from.x) + dx;
+            int32_t r = num % den;
+            int16_t y = from.y + e * (num / den);
+            int16_t stride = e * __SCREEN_FRAMEBUFFER_ROW_BYTE_AMOUNT;
+            uint8_t * row = ctx->fbuf + y * __SCREEN_FRAMEBUFFER_ROW_BYTE_AMOUNT;
             for (int16_t x = begin; x <= end; x++) {
-                int16_t y = (dy * (x-from.x) * 2 + e * dx) / (dx * 2) + from.y;
-#ifdef PBL_BW
-                n_graphics_set_pixel(ctx, n_GPoint(x, y),
-                    ((color >> ((x + y) % 2)) & 1) ?
-                        (n_GColor) {.argb = 1} :
-                        (n_GColor) {.argb = 0});
-#else
-                n_graphics_set_pixel(ctx, n_GPoint(x, y), ctx->stroke_color);
-#endif
+                if (!clip || (y >= miny && y < maxy))
+                    n_graphics_prv_plot(row, x, y, color);
+                r += inc;
+                if (r >= den) {
+                    r -= den;
+                    y += e;
+                    row += stride;
+                }
             }
         }
     }
@@ -39,6 +39,38 @@
         /* extended a and b */ ((a) >= 0x100 && (a) <= 0x24f) \
     )
 
+// A layout is the list of lines n_graphics_draw_text would draw for a given
+// string, font and box. Working it out (decoding, measuring, breaking) is
+// most of the cost of drawing text, and text layers and menu cells draw the
+// same strings frame after frame, so the last few layouts are kept around.
+// Lines are stored relative to the box origin, so a layout survives its box
+// being moved (scrolling), except for centered text which ignores box x.
+
+typedef struct n_GTextLayoutLine {
+    uint16_t begin, end;
+    int16_t x, y;
+    int16_t width;
+    bool hyphen;
+} n_GTextLayoutLine;
+
+typedef struct n_GTextLayout {
+    const char * text;
+    uint32_t hash;
+    n_GFont font;
+    n_GSize box_size;
+    int16_t box_x;
+    uint8_t overflow_mode, alignment;
+    bool valid;
+    uint32_t last_used;
+    uint16_t line_count;
+    n_GSize size;
+    n_GTextLayoutLine lines[__TEXT_LAYOUT_CACHE_LINES];
+} n_GTextLayout;
+
+static n_GTextLayout n_graphics_prv_text_layout_cache[__TEXT_LAYOUT_CACHE_ENTRIES];
+static uint32_t n_graphics_prv_text_layout_clock;
+
+// Draws (or, without a context, only measures) one line of text.
 static n_GPoint n_graphics_prv_draw_text_line(n_GContext * ctx, const char * text,
         uint32_t idx, uint32_t idx_end,
         n_GFont const font, n_GPoint text_origin) {
@@ -68,19 +100,48 @@ static n_GPoint n_graphics_prv_draw_text_line(n_GContext * ctx, const char * tex
             idx += 1;
         }
         n_GGlyphInfo * glyph = n_graphics_font_get_glyph_info(font, codepoint);
-        n_graphics_font_draw_glyph(ctx, glyph, text_origin);
+        if (ctx)
+            n_graphics_font_draw_glyph(ctx, glyph, text_origin);
         text_origin.x += glyph->advance;
     }
     return text_origin;
 }
 
-void n_graphics_draw_text(
-    n_GContext * ctx, const char * text, n_GFont const font, const n_GRect box,
-    const n_GTextOverflowMode overflow_mode, const n_GTextAlignment alignment,
-    n_GTextAttributes * text_attributes) {
-    //TODO alignment
-    //TODO attributes
-    
+// Draws a line (if there is a context) and records it in the layout.
+// A line that ends in a hyphen gets the hyphen drawn right after its text.
+static void n_graphics_prv_text_layout_add_line(n_GContext * ctx,
+        n_GTextLayout * layout, const char * text, n_GFont const font,
+        uint32_t idx, uint32_t idx_end, n_GPoint origin, bool hyphen,
+        const n_GRect box) {
+    n_GPoint end = n_graphics_prv_draw_text_line(ctx, text, idx, idx_end, font, origin);
+    if (hyphen) {
+        n_GGlyphInfo * hyphen_glyph = n_graphics_font_get_glyph_info(font, '-');
+        if (ctx)
+            n_graphics_font_draw_glyph(ctx, hyphen_glyph, end);
+        end.x += hyphen_glyph->advance;
+    }
+
+    n_GTextLayoutLine line = {
+        .begin = idx, .end = idx_end,
+        .x = origin.x - box.origin.x, .y = origin.y - box.origin.y,
+        .width = end.x - origin.x,
+        .hyphen = hyphen,
+    };
+    if (layout->line_count < __TEXT_LAYOUT_CACHE_LINES)
+        layout->lines[layout->line_count] = line;
+    if (idx_end > UINT16_MAX)
+        layout->line_count = __TEXT_LAYOUT_CACHE_LINES; // too long to cache
+    layout->line_count++;
+
+    if (line.width > layout->size.w)
+        layout->size.w = line.width;
+    if (line.y + font->line_height > layout->size.h)
+        layout->size.h = line.y + font->line_height;
+}
+
+static void n_graphics_prv_text_layout_build(n_GContext * ctx,
+    n_GTextLayout * layout, const char * text, n_GFont const font,
+    const n_GRect box, const n_GTextAlignment alignment) {
     // Rendering of text is done as follows:
     // - We store the index of the beginning of the line.
     // - We iterate over characters in the line.
@@ -93,8 +154,11 @@ void n_graphics_draw_text(
     uint32_t line_begin = 0, index = 0, next_index = 0;
     int32_t last_breakable_index = -1, last_renderable_index = -1,
             lenience = n_graphics_font_get_glyph_info(font, ' ')->advance;
-    n_GGlyphInfo * hyphen = n_graphics_font_get_glyph_info(font, '-'),
-                 * glyph = NULL;
+    // Only advances are kept, as glyphs from a streamed font don't last
+    // past the next lookup.
+    int8_t hyphen_advance = n_graphics_font_get_glyph_info(font, '-')->advance,
+           advance = 0;
+    bool have_glyph = false;
 
     uint32_t codepoint = 0, next_codepoint = 0, last_codepoint = 0,
         last_renderable_codepoint = 0, last_breakable_codepoint = 0;
@@ -107,10 +171,10 @@ void n_graphics_draw_text(
         // 0b11110xxx 0b10xxxxxx 0b10xxxxxx 0b10xxxxxx
         
         if (text[index] == '\n'
-                && (char_origin.x + (__CODEPOINT_NEEDS_HYPHEN_AFTER(codepoint) ? hyphen->advance : 0)
+                && (char_origin.x + (__CODEPOINT_NEEDS_HYPHEN_AFTER(codepoint) ? hyphen_advance : 0)
                     <= box.origin.x + box.size.w)) {
-            n_graphics_prv_draw_text_line(ctx, text,
-                                          line_begin, index, font, line_origin);
+            n_graphics_prv_text_layout_add_line(ctx, layout, text, font,
+                                          line_begin, index, line_origin, false, box);
             char_origin.x = box.origin.x, char_origin.y += font->line_height;
             last_breakable_index = last_renderable_index = -1;
             line_origin = centered_origin;
@@ -143,20 +207,15 @@ void n_graphics_draw_text(
             next_codepoint = text[index];
             next_index += 1;
         }
-        n_GGlyphInfo * next_glyph = n_graphics_font_get_glyph_info(font, next_codepoint);
-
-        // Debugging:
-        // n_graphics_context_set_text_color(ctx, n_GColorLightGray);
-        // n_graphics_font_draw_glyph(ctx, next_glyph, char_origin);
-        // n_graphics_context_set_text_color(ctx, n_GColorBlack);
+        int8_t next_advance = n_graphics_font_get_glyph_info(font, next_codepoint)->advance;
 
         // We now know what codepoint the next character has.
 
-        if (glyph) {
+        if (have_glyph) {
             if (__CODEPOINT_ALLOW_PREBREAKABLE(codepoint)) {
                 if (char_origin.x +
                         (__CODEPOINT_NEEDS_HYPHEN_AFTER(last_codepoint)
-                            ? hyphen->advance : 0)
+                            ? hyphen_advance : 0)
                         <= box.origin.x + box.size.w) {
                     last_renderable_index = index;
                     last_renderable_codepoint = codepoint;
@@ -165,7 +224,7 @@ void n_graphics_draw_text(
             if (__CODEPOINT_GOOD_POSTBREAKABLE(codepoint) &&
                     ((
                         (__CODEPOINT_IGNORE_AT_LINE_END(codepoint) &&
-                        char_origin.x - glyph->advance <= box.origin.x + box.size.w) ||
+                        char_origin.x - advance <= box.origin.x + box.size.w) ||
                     char_origin.x <= box.origin.x + box.size.w))) {
                 last_breakable_index = index;
                 last_breakable_codepoint = codepoint;
@@ -177,8 +236,9 @@ void n_graphics_draw_text(
         index = next_index;
         last_codepoint = codepoint;
         codepoint = next_codepoint;
-        glyph = next_glyph;
-        char_origin.x += glyph->advance;
+        advance = next_advance;
+        have_glyph = true;
+        char_origin.x += advance;
 
         // Center it:
         if (alignment == n_GTextAlignmentCenter)
@@ -193,29 +253,27 @@ void n_graphics_draw_text(
             line_origin = right_origin;
         }
         
-        if ((char_origin.x + (__CODEPOINT_NEEDS_HYPHEN_AFTER(codepoint) ? hyphen->advance : 0) - lenience
+        if ((char_origin.x + (__CODEPOINT_NEEDS_HYPHEN_AFTER(codepoint) ? hyphen_advance : 0) - lenience
                 > box.origin.x + box.size.w)) {
             if (last_breakable_index > 0) {
-                n_GPoint end = n_graphics_prv_draw_text_line(ctx, text,
-                    line_begin, last_breakable_index, font, line_origin);
+                n_graphics_prv_text_layout_add_line(ctx, layout, text, font,
+                    line_begin, last_breakable_index, line_origin, false, box);
                 index = next_index = last_breakable_index;
                 char_origin.x = box.origin.x, char_origin.y += font->line_height;
                 line_begin = last_breakable_index;
                 last_breakable_index = last_renderable_index = -1;
                 line_origin = char_origin;
             } else if (last_renderable_index > 0) {
-                n_GPoint end = n_graphics_prv_draw_text_line(ctx, text,
-                    line_begin, last_renderable_index, font, line_origin);
-                if (__CODEPOINT_NEEDS_HYPHEN_AFTER(last_renderable_codepoint) || true) {
-                    n_graphics_font_draw_glyph(ctx, hyphen, end);
-                }
+                n_graphics_prv_text_layout_add_line(ctx, layout, text, font,
+                    line_begin, last_renderable_index, line_origin, true, box);
                 index = next_index = last_renderable_index;
                 char_origin.x = box.origin.x, char_origin.y += font->line_height;
                 line_begin = last_renderable_index;
                 last_breakable_index = last_renderable_index = -1;
                 line_origin = char_origin;
             } else {
-                n_graphics_font_draw_glyph(ctx, hyphen, line_origin);
+                n_graphics_prv_text_layout_add_line(ctx, layout, text, font,
+                    line_begin, line_begin, line_origin, true, box);
                 line_begin = next_index;
                 char_origin.x = box.origin.x, char_origin.y += font->line_height;
                 line_origin = char_origin;
@@ -224,19 +282,111 @@ void n_graphics_draw_text(
                 return;
             }
         }
-        
-        index += (0 * line_begin * last_breakable_codepoint);
     }
     if (index != line_begin) {
-        n_GPoint end = n_graphics_prv_draw_text_line(ctx, text,
-            line_begin, index, font, line_origin);
+        n_graphics_prv_text_layout_add_line(ctx, layout, text, font,
+            line_begin, index, line_origin, false, box);
+    }
+}
+
+static void n_graphics_prv_text_layout_draw(n_GContext * ctx,
+        n_GTextLayout * layout, const char * text, const n_GRect box) {
+    for (uint16_t i = 0; i < layout->line_count; i++) {
+        n_GTextLayoutLine * line = &layout->lines[i];
+        n_GPoint end = n_graphics_prv_draw_text_line(ctx, text, line->begin, line->end,
+            layout->font, n_GPoint(box.origin.x + line->x, box.origin.y + line->y));
+        if (line->hyphen)
+            n_graphics_font_draw_glyph(ctx,
+                n_graphics_font_get_glyph_info(layout->font, '-'), end);
+    }
+}
+
+static uint32_t n_graphics_prv_text_hash(const char * text) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*text)
+        hash = (hash ^ (uint8_t)*text++) * 16777619u;
+    return hash;
+}
+
+// Finds the layout of the text in the cache, or lays it out (drawing it as
+// it goes if there is a context) into the least recently used entry.
+// Text with more lines than an entry holds is laid out but not kept.
+static n_GTextLayout * n_graphics_prv_text_layout_get(n_GContext * ctx,
+        const char * text, n_GFont const font, const n_GRect box,
+        const n_GTextOverflowMode overflow_mode, const n_GTextAlignment alignment) {
+    uint32_t hash = n_graphics_prv_text_hash(text);
+    int16_t box_x = (alignment == n_GTextAlignmentCenter) ? box.origin.x : 0;
+    n_GTextLayout * victim = &n_graphics_prv_text_layout_cache[0];
+
+    for (uint8_t i = 0; i < __TEXT_LAYOUT_CACHE_ENTRIES; i++) {
+        n_GTextLayout * layout = &n_graphics_prv_text_layout_cache[i];
+        if (layout->valid && layout->text == text && layout->hash == hash &&
+                layout->font == font && layout->box_x == box_x &&
+                layout->box_size.w == box.size.w && layout->box_size.h == box.size.h &&
+                layout->overflow_mode == overflow_mode && layout->alignment == alignment) {
+            layout->last_used = ++n_graphics_prv_text_layout_clock;
+            if (ctx)
+                n_graphics_prv_text_layout_draw(ctx, layout, text, box);
+            return layout;
+        }
+        if (layout->last_used < victim->last_used)
+            victim = layout;
     }
+
+    *victim = (n_GTextLayout) {
+        .text = text, .hash = hash, .font = font,
+        .box_size = box.size, .box_x = box_x,
+        .overflow_mode = overflow_mode, .alignment = alignment,
+    };
+    n_graphics_prv_text_layout_build(ctx, victim, text, font, box, alignment);
+    victim->valid = victim->line_count <= __TEXT_LAYOUT_CACHE_LINES;
+    victim->last_used = victim->valid ? ++n_graphics_prv_text_layout_clock : 0;
+    return victim;
+}
+
+void n_graphics_text_layout_cache_flush(n_GFont const font) {
+    for (uint8_t i = 0; i < __TEXT_LAYOUT_CACHE_ENTRIES; i++)
+        if (font == NULL || n_graphics_prv_text_layout_cache[i].font == font) {
+            n_graphics_prv_text_layout_cache[i].valid = false;
+            n_graphics_prv_text_layout_cache[i].last_used = 0;
+        }
+}
+
+void n_graphics_text_layout_cache_invalidate(const char * text) {
+    for (uint8_t i = 0; i < __TEXT_LAYOUT_CACHE_ENTRIES; i++)
+        if (n_graphics_prv_text_layout_cache[i].text == text) {
+            n_graphics_prv_text_layout_cache[i].valid = false;
+            n_graphics_prv_text_layout_cache[i].last_used = 0;
+        }
+}
+
+void n_graphics_draw_text(
+    n_GContext * ctx, const char * text, n_GFont const font, const n_GRect box,
+    const n_GTextOverflowMode overflow_mode, const n_GTextAlignment alignment,
+    n_GTextAttributes * text_attributes) {
+    //TODO overflow modes
+    //TODO attributes
+    if (text == NULL)
+        return;
+
+    n_graphics_prv_text_layout_get(ctx, text, font, box, overflow_mode, alignment);
+}
+
+n_GSize n_graphics_text_layout_get_content_size_with_attributes(
+    const char * text, n_GFont const font, const n_GRect box,
+    const n_GTextOverflowMode overflow_mode, const n_GTextAlignment alignment,
+    n_GTextAttributes * text_attributes) {
+    if (text == NULL)
+        return (n_GSize) { 0, 0 };
+
+    return n_graphics_prv_text_layout_get(NULL, text, font, box,
+                                          overflow_mode, alignment)->size;
 }
 
 n_GSize n_graphics_text_layout_get_content_size(const char * text, n_GFont const font)
 {
     uint32_t text_len = strlen(text);
-    n_graphics_text_layout_get_content_size_with_index(text, font, 0, text_len);
+    return n_graphics_text_layout_get_content_size_with_index(text, font, 0, text_len);
 }
 
 n_GSize n_graphics_text_layout_get_content_size_with_index(const char *text, n_GFont const font, uint32_t idx, uint32_t idx_end)
@@ -32,6 +32,15 @@
 |                                                                              |
 `-----------------------------------------------------------------------------*/
 
+// Layouts of recently drawn text are cached (see text.c.) Each entry holds
+// up to __TEXT_LAYOUT_CACHE_LINES lines; longer text is laid out every time.
+#ifndef __TEXT_LAYOUT_CACHE_ENTRIES
+#define __TEXT_LAYOUT_CACHE_ENTRIES 8
+#endif
+#ifndef __TEXT_LAYOUT_CACHE_LINES
+#define __TEXT_LAYOUT_CACHE_LINES 8
+#endif
+
 typedef enum n_GTextOverflowMode {
     n_GTextOverflowModeWordWrap = 0,
         // "Normal" filling mode. Respects \n, cuts off at end.
@@ -81,6 +90,13 @@ n_GSize n_graphics_text_layout_get_content_size_with_attributes(
 
 n_GSize n_graphics_text_layout_get_content_size(const char * text, n_GFont const font);
 
+// Drops cached layouts in the given font (or all of them for NULL), for
+// when the font goes away.
+void n_graphics_text_layout_cache_flush(n_GFont const font);
+
+// Drops cached layouts of the given string, for when it is changed.
+void n_graphics_text_layout_cache_invalidate(const char * text);
+
 n_GSize n_graphics_text_layout_get_content_size_with_index(const char *text, n_GFont const font, uint32_t idx, uint32_t idx_end);
 
 /*
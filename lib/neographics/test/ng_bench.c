@@ -0,0 +1,656 @@
+/* ng_bench.c
+ * Host benchmark and regression check for the neographics primitives
+ * RebbleOS
+ *
+ * Draws the same things as the System app's benchmark, and a few harder
+ * ones (clipped lines and circles, polygons, wrapped and aligned text),
+ * into a framebuffer here on the host. Each is timed, and the framebuffer
+ * after one clean draw is checksummed and checked against _golden. An
+ * optimisation that changes the checksum changed the drawing too.
+ *
+ * Text is drawn with made up fonts (see _font_build), held in memory and
+ * streamed, and drawn twice over to go through the glyph and layout caches;
+ * all of those have to come out the same.
+ *
+ * The golden checksums are from the drawing code before it was optimised,
+ * except where noted. To check another copy of neographics against them,
+ * or print its checksums to update them, for all the drawings or just the
+ * ones named:
+ *
+ *   make -C lib/neographics/test NG=path/to/neographics/src
+ *   ./ng_bench_color [-g] [name...]
+ *
+ * Build and run with the Makefile next to this.
+ */
+
+#include <math.h>
+#include <time.h>
+#include "graphics.h"
+
+/* each draw is repeated for at least this long */
+#define BENCH_MIN_US 20000
+
+#define FB_SIZE (__SCREEN_FRAMEBUFFER_ROW_BYTE_AMOUNT * __SCREEN_HEIGHT)
+
+typedef void (*bench_func)(n_GContext *ctx, uint16_t size);
+
+typedef struct {
+    const char *name;
+    bench_func func;
+    uint16_t size;
+} bench_t;
+
+typedef struct {
+    const char *name;
+    uint16_t size;
+    uint32_t bw;    /* PBL_BW, 144x168 */
+    uint32_t color; /* PBL_COLOR, 144x168 */
+} golden_t;
+
+static uint8_t _fb[FB_SIZE];
+static n_GFont _font, _stream_font, _font_v2, _stream_font_v2;
+static uint8_t _font_data[4096], _font_v2_data[4096];
+
+/*** what neographics wants from the firmware ***/
+
+int32_t sin_lookup(int32_t angle)
+{
+    return (int32_t)lround(sin(angle * 2 * M_PI / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO);
+}
+
+int32_t cos_lookup(int32_t angle)
+{
+    return (int32_t)lround(cos(angle * 2 * M_PI / TRIG_MAX_ANGLE) * TRIG_MAX_RATIO);
+}
+
+GBitmap *graphics_capture_frame_buffer(GContext *ctx) { return NULL; }
+GBitmap *graphics_capture_frame_buffer_format(GContext *ctx, GBitmapFormat format) { return NULL; }
+bool graphics_release_frame_buffer(GContext *ctx, GBitmap *bitmap) { return false; }
+uint8_t *gbitmap_get_data(const GBitmap *bitmap) { return NULL; }
+
+/*** a font ***/
+
+/* a fixed sequence, so the font and the scenes are the same every run */
+static uint32_t _rand_state;
+
+static void _rand_seed(uint32_t seed)
+{
+    _rand_state = seed;
+}
+
+static uint32_t _rand(void)
+{
+    _rand_state = _rand_state * 1103515245u + 12345u;
+    return _rand_state >> 8;
+}
+
+static int16_t _rand_range(int16_t lo, int16_t hi)
+{
+    return lo + (int16_t)(_rand() % (uint32_t)(hi - lo));
+}
+
+#define FONT_FIRST       ' '
+#define FONT_LAST        '~'
+#define FONT_GLYPHS      (FONT_LAST - FONT_FIRST + 1)
+#define FONT_HASH_SIZE   16
+#define FONT_LINE_HEIGHT 14
+
+static uint16_t _font_put_glyph(uint8_t *glyphs, uint16_t at, uint8_t w, uint8_t h,
+                                int8_t left, int8_t top, int8_t advance, uint32_t seed)
+{
+    n_GGlyphInfo *glyph = (n_GGlyphInfo *)(glyphs + at);
+    uint16_t bytes = (w * h + 7) / 8;
+
+    glyph->width = w;
+    glyph->height = h;
+    glyph->left_offset = left;
+    glyph->top_offset = top;
+    glyph->advance = advance;
+
+    _rand_seed(seed);
+    for (uint16_t i = 0; i < bytes; i++)
+        glyph->data[i] = seed ? _rand() : 0xFF;
+
+    return at + sizeof(n_GGlyphInfo) + bytes;
+}
+
+/*
+ * A font of the printable ASCII characters, with a 16 entry hash table.
+ * Version 3 has 4 byte codepoints and 2 byte glyph offsets; version 2 has
+ * 2 byte codepoints, 4 byte offsets and bigger glyphs, more than fit in
+ * a font stream's cache at once. Glyphs are a few pixels of noise, of a
+ * few sizes, with a blank space and a solid block for tofu.
+ */
+static void _font_build(uint8_t *data, uint8_t version)
+{
+    n_GFontInfo *info = (n_GFontInfo *)data;
+    uint8_t info_size = version == 2 ? __FONT_INFO_V2_LENGTH : sizeof(n_GFontInfo);
+    uint8_t cp_bytes = version == 2 ? 2 : 4;
+    uint8_t item_size = 6; /* a codepoint and a glyph offset, either way */
+    uint8_t big = version == 2 ? 3 : 0;
+    n_GFontHashTableEntry *hash = (n_GFontHashTableEntry *)(data + info_size);
+    uint8_t *offsets = (uint8_t *)(hash + FONT_HASH_SIZE);
+    uint8_t *glyphs = offsets + FONT_GLYPHS * item_size;
+    uint32_t entry = 0, at = 4;
+
+    info->version = version;
+    info->line_height = FONT_LINE_HEIGHT + big;
+    info->glyph_amount = FONT_GLYPHS;
+    info->wildcard_codepoint = '?';
+    info->hash_table_size = FONT_HASH_SIZE;
+    info->codepoint_bytes = cp_bytes;
+    if (version >= 3)
+    {
+        info->fontinfo_size = sizeof(n_GFontInfo);
+        info->features = n_GFontFeature2ByteGlyphOffset;
+    }
+
+    /* tofu is always the first glyph */
+    memset(glyphs, 0, 4);
+    at = _font_put_glyph(glyphs, at, 5 + big, 9 + big, 0, 2, 7 + big, 0);
+
+    for (uint8_t bucket = 0; bucket < FONT_HASH_SIZE; bucket++)
+    {
+        hash[bucket].hash_value = bucket;
+        hash[bucket].offset_table_offset = entry * item_size;
+        hash[bucket].offset_table_size = 0;
+
+        for (uint32_t cp = FONT_FIRST; cp <= FONT_LAST; cp++)
+        {
+            uint8_t *item = offsets + entry * item_size;
+
+            if (cp % FONT_HASH_SIZE != bucket)
+                continue;
+
+            /* little endian, so the low bytes come first */
+            memcpy(item, &cp, cp_bytes);
+            memcpy(item + cp_bytes, &at, item_size - cp_bytes);
+            entry++;
+            hash[bucket].offset_table_size++;
+
+            if (cp == ' ')
+                at = _font_put_glyph(glyphs, at, 0, 0, 0, 0, 4 + big, 1);
+            else
+                at = _font_put_glyph(glyphs, at, 3 + big + cp % 4, 7 + big + cp % 3, cp % 2,
+                                     12 - (7 + cp % 3), 5 + big + cp % 4, cp);
+        }
+    }
+}
+
+#ifdef __FONT_VERSION_STREAM
+static void _font_read(void *context, uint32_t offset, void *buffer, size_t length)
+{
+    const uint8_t *data = *(const uint8_t **)context;
+
+    memcpy(buffer, data + offset, length);
+}
+#endif
+
+static void _font_flush(void)
+{
+#ifdef __TEXT_LAYOUT_CACHE_ENTRIES
+    n_graphics_text_layout_cache_flush(NULL);
+#endif
+#ifdef __GLYPH_CACHE_FONTS
+    n_graphics_font_cache_flush(NULL);
+#endif
+}
+
+/*** the things we draw ***/
+
+static n_GPoint _star[] = {
+    { 0, -10 }, { 3, -3 }, { 10, -3 }, { 4, 2 }, { 6, 10 },
+    { 0, 5 }, { -6, 10 }, { -4, 2 }, { -10, -3 }, { -3, -3 },
+};
+#define STAR_POINTS (sizeof(_star) / sizeof(_star[0]))
+
+static const char *_text = "The quick brown fox jumps over the lazy dog. "
+                           "Pack my box with five dozen liquor jugs!\n"
+                           "{Sphinx} of black quartz, judge my vow~";
+
+static void _bench_fill_rect(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_fill_rect(ctx, n_GRect(0, 0, size, size), 0, n_GCornerNone);
+}
+
+static void _bench_round_rect(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_fill_rect(ctx, n_GRect(4, 4, size, size), size / 4, n_GCornersAll);
+    n_graphics_context_set_fill_color(ctx, n_GColorDarkGray);
+    n_graphics_fill_rect(ctx, n_GRect(10, 90, size, size / 2), 6, n_GCornersTop);
+    n_graphics_draw_rect(ctx, n_GRect(20, 20, size, size), size / 5, n_GCornersAll);
+    n_graphics_context_set_fill_color(ctx, n_GColorBlack);
+}
+
+static void _bench_line(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_context_set_stroke_width(ctx, 1);
+    n_graphics_draw_line(ctx, n_GPoint(0, 0), n_GPoint(size, size / 2));
+}
+
+static void _bench_lines(n_GContext *ctx, uint16_t size)
+{
+    _rand_seed(size);
+    for (uint16_t i = 0; i < size; i++)
+        n_graphics_draw_line(ctx, n_GPoint(_rand_range(0, __SCREEN_WIDTH), _rand_range(0, __SCREEN_HEIGHT)),
+                                  n_GPoint(_rand_range(0, __SCREEN_WIDTH), _rand_range(0, __SCREEN_HEIGHT)));
+}
+
+static void _bench_lines_clipped(n_GContext *ctx, uint16_t size)
+{
+    _rand_seed(size);
+    for (uint16_t i = 0; i < size; i++)
+        n_graphics_draw_line(ctx, n_GPoint(_rand_range(-200, 350), _rand_range(-200, 370)),
+                                  n_GPoint(_rand_range(-200, 350), _rand_range(-200, 370)));
+}
+
+/* lines that miss the screen altogether draw nothing */
+static void _bench_lines_offscreen(n_GContext *ctx, uint16_t size)
+{
+    for (int16_t i = 1; i <= size; i++)
+    {
+        n_graphics_draw_line(ctx, n_GPoint(-i * 3, -i), n_GPoint(__SCREEN_WIDTH + i * 2, -i * 2));
+        n_graphics_draw_line(ctx, n_GPoint(-i, __SCREEN_HEIGHT + i), n_GPoint(__SCREEN_WIDTH + i, __SCREEN_HEIGHT + i * 3));
+        n_graphics_draw_line(ctx, n_GPoint(-i, -i * 4), n_GPoint(-i * 2, __SCREEN_HEIGHT + i));
+        n_graphics_draw_line(ctx, n_GPoint(__SCREEN_WIDTH + i, -i), n_GPoint(__SCREEN_WIDTH + i * 3, __SCREEN_HEIGHT + i * 5));
+    }
+}
+
+static void _bench_thick_line(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_context_set_stroke_width(ctx, 5);
+    n_graphics_draw_line(ctx, n_GPoint(4, 4), n_GPoint(size, size / 2));
+    n_graphics_context_set_stroke_width(ctx, 1);
+}
+
+static void _bench_fill_circle(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_fill_circle(ctx, n_GPoint(size, size), size);
+}
+
+static void _bench_draw_circle(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_draw_circle(ctx, n_GPoint(size, size), size);
+}
+
+static void _bench_circles_clipped(n_GContext *ctx, uint16_t size)
+{
+    _rand_seed(size);
+    for (uint16_t i = 0; i < size; i++)
+    {
+        n_GPoint p = n_GPoint(_rand_range(-60, 200), _rand_range(-60, 230));
+        uint16_t r = _rand_range(1, 80);
+
+        if (i & 1)
+            n_graphics_draw_circle(ctx, p, r);
+        else
+            n_graphics_fill_circle(ctx, p, r / 4 + 1);
+    }
+}
+
+static void _bench_thick_circle(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_context_set_stroke_width(ctx, 3);
+    n_graphics_draw_circle(ctx, n_GPoint(__SCREEN_WIDTH / 2, __SCREEN_HEIGHT / 2), size);
+    n_graphics_context_set_stroke_width(ctx, 1);
+}
+
+/* draws nothing, old and new; a radius 0 fill wraps and isn't tried */
+static void _bench_circle_r0(n_GContext *ctx, uint16_t size)
+{
+    n_graphics_draw_circle(ctx, n_GPoint(size, size), 0);
+}
+
+static void _bench_fill_path(n_GContext *ctx, uint16_t size)
+{
+    n_GPoint points[STAR_POINTS];
+
+    // size is the star's width in pixels
+    for (uint8_t i = 0; i < STAR_POINTS; i++)
+        points[i] = n_GPoint(size / 2 + _star[i].x * size / 20,
+                             size / 2 + _star[i].y * size / 20);
+
+    n_graphics_fill_path(ctx, STAR_POINTS, points);
+}
+
+static void _bench_polygons(n_GContext *ctx, uint16_t size)
+{
+    n_GPoint points[24];
+
+    _rand_seed(size);
+    for (uint16_t i = 0; i < 8; i++)
+    {
+        uint16_t n = _rand_range(3, 24);
+
+        /* outlines stay on screen; see lines_clipped for off it */
+        for (uint16_t j = 0; j < n; j++)
+            if (i < 6)
+                points[j] = n_GPoint(_rand_range(-20, __SCREEN_WIDTH + 20), _rand_range(-20, __SCREEN_HEIGHT + 20));
+            else
+                points[j] = n_GPoint(_rand_range(0, __SCREEN_WIDTH), _rand_range(0, __SCREEN_HEIGHT));
+
+        n_graphics_context_set_fill_color(ctx, (i & 1) ? n_GColorDarkGray : n_GColorBlack);
+        if (i < 6)
+            n_graphics_fill_path(ctx, n, points);
+        else
+            n_graphics_draw_path(ctx, n, points, i & 1);
+    }
+    n_graphics_context_set_fill_color(ctx, n_GColorBlack);
+}
+
+/*
+ * The other ways in to the filler: a rotated n_GPath, one with too many
+ * points for the stack, and fixed point (3 fractional bits) coordinates
+ */
+static void _bench_path_kinds(n_GContext *ctx, uint16_t size)
+{
+    n_GPoint points[40];
+    n_GPathInfo info = { STAR_POINTS, _star };
+    n_GPath *path = n_gpath_create(&info);
+
+    for (uint16_t a = 0; a < 4; a++)
+    {
+        n_gpath_rotate_to(path, a * TRIG_MAX_ANGLE / 14);
+        n_gpath_move_to(path, n_GPoint(20 + a * 34, 20));
+        n_gpath_fill(ctx, path);
+    }
+    n_gpath_destroy(path);
+
+    // a spiky wheel, past __PATH_FILL_STACK_EDGES
+    for (uint16_t i = 0; i < 40; i++)
+    {
+        int32_t r = i & 1 ? size / 2 : size / 5;
+        points[i] = n_GPoint(r * cos_lookup(i * TRIG_MAX_ANGLE / 40) / TRIG_MAX_RATIO,
+                             r * sin_lookup(i * TRIG_MAX_ANGLE / 40) / TRIG_MAX_RATIO);
+    }
+    info = (n_GPathInfo) { 40, points };
+    path = n_gpath_create(&info);
+    n_gpath_move_to(path, n_GPoint(72, 84));
+    n_gpath_fill(ctx, path);
+    n_gpath_destroy(path);
+
+    for (uint16_t i = 0; i < STAR_POINTS; i++)
+        points[i] = n_GPoint(_star[i].x * 21 + 3 + 8 * 40, _star[i].y * 19 + 5 + 8 * 140);
+    n_graphics_context_set_fill_color(ctx, n_GColorDarkGray);
+    n_graphics_fill_ppath(ctx, STAR_POINTS, points);
+    n_graphics_context_set_fill_color(ctx, n_GColorBlack);
+}
+
+static void _bench_text_in(n_GContext *ctx, n_GFont font, uint16_t size)
+{
+    n_graphics_draw_text(ctx, _text, font, n_GRect(0, 0, size, 80),
+                         n_GTextOverflowModeWordWrap, n_GTextAlignmentLeft, NULL);
+    n_graphics_draw_text(ctx, _text, font, n_GRect(4, 84, size - 8, 40),
+                         n_GTextOverflowModeTrailingEllipsis, n_GTextAlignmentCenter, NULL);
+    n_graphics_draw_text(ctx, "right\naligned", font, n_GRect(-10, 130, size, 40),
+                         n_GTextOverflowModeWordWrap, n_GTextAlignmentRight, NULL);
+}
+
+static void _bench_text(n_GContext *ctx, uint16_t size)
+{
+    _bench_text_in(ctx, _font, size);
+}
+
+/* glyphs cut by every edge of the screen */
+static void _bench_text_clipped(n_GContext *ctx, uint16_t size)
+{
+    for (int16_t y = -9; y < __SCREEN_HEIGHT; y += 37)
+        n_graphics_draw_text(ctx, _text, _font, n_GRect(-3 - y / 8, y, size, 60),
+                             n_GTextOverflowModeWordWrap, n_GTextAlignmentLeft, NULL);
+    n_graphics_draw_text(ctx, _text, _font, n_GRect(__SCREEN_WIDTH - 20, 40, size, 60),
+                         n_GTextOverflowModeWordWrap, n_GTextAlignmentLeft, NULL);
+}
+
+/* the glyph and layout caches are warm the second time */
+static void _bench_text_again(n_GContext *ctx, uint16_t size)
+{
+    _bench_text_in(ctx, _font, size);
+    _bench_text_in(ctx, _font, size);
+}
+
+/*
+ * Text scrolled about, as in a menu, and changed in place between draws,
+ * as a text layer's buffer is: neither may be drawn from a stale layout
+ */
+static void _bench_text_scroll(n_GContext *ctx, uint16_t size)
+{
+    char buf[64];
+
+    for (int16_t y = -20; y < __SCREEN_HEIGHT; y += 30)
+    {
+        n_graphics_draw_text(ctx, _text, _font, n_GRect(y / 4, y, size, 40),
+                             n_GTextOverflowModeTrailingEllipsis, n_GTextAlignmentLeft, NULL);
+        n_graphics_draw_text(ctx, _text, _font, n_GRect(y / 4, y + 14, size - 30, 28),
+                             n_GTextOverflowModeWordWrap, n_GTextAlignmentCenter, NULL);
+    }
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        snprintf(buf, sizeof(buf), "%d jugs of %s", i * 37, i & 1 ? "liquor" : "ale");
+        n_graphics_draw_text(ctx, buf, _font, n_GRect(0, 60 + i * 14, size, 40),
+                             n_GTextOverflowModeWordWrap, n_GTextAlignmentRight, NULL);
+    }
+}
+
+static void _bench_text_stream(n_GContext *ctx, uint16_t size)
+{
+    _bench_text_in(ctx, _stream_font, size);
+}
+
+static void _bench_text_v2(n_GContext *ctx, uint16_t size)
+{
+    _bench_text_in(ctx, _font_v2, size);
+}
+
+/* misses more glyphs than the stream's cache holds, and empties it */
+static void _bench_text_v2_stream(n_GContext *ctx, uint16_t size)
+{
+    _bench_text_in(ctx, _stream_font_v2, size);
+}
+
+static const bench_t _benchmarks[] = {
+    { "fill_rect",       _bench_fill_rect,       8 },
+    { "fill_rect",       _bench_fill_rect,       32 },
+    { "fill_rect",       _bench_fill_rect,       __SCREEN_WIDTH },
+    { "round_rect",      _bench_round_rect,      60 },
+    { "line_1px",        _bench_line,            16 },
+    { "line_1px",        _bench_line,            128 },
+    { "lines",           _bench_lines,           200 },
+    { "lines_clipped",   _bench_lines_clipped,   200 },
+    { "lines_offscreen", _bench_lines_offscreen, 20 },
+    { "line_5px",        _bench_thick_line,      128 },
+    { "fill_circle",     _bench_fill_circle,     8 },
+    { "fill_circle",     _bench_fill_circle,     60 },
+    { "draw_circle",     _bench_draw_circle,     8 },
+    { "draw_circle",     _bench_draw_circle,     60 },
+    { "circles_clipped", _bench_circles_clipped, 100 },
+    { "circle_3px",      _bench_thick_circle,    50 },
+    { "circle_r0",       _bench_circle_r0,       20 },
+    { "fill_path",       _bench_fill_path,       40 },
+    { "fill_path",       _bench_fill_path,       140 },
+    { "polygons",        _bench_polygons,        8 },
+    { "path_kinds",      _bench_path_kinds,      120 },
+    { "draw_text",       _bench_text,            __SCREEN_WIDTH },
+    { "draw_text_again", _bench_text_again,      __SCREEN_WIDTH },
+    { "text_clipped",    _bench_text_clipped,    __SCREEN_WIDTH },
+    { "text_scroll",     _bench_text_scroll,     __SCREEN_WIDTH },
+    { "draw_text_stream", _bench_text_stream,    __SCREEN_WIDTH },
+    { "text_v2",         _bench_text_v2,         __SCREEN_WIDTH },
+    { "text_v2_stream",  _bench_text_v2_stream,  __SCREEN_WIDTH },
+};
+#define BENCH_COUNT (sizeof(_benchmarks) / sizeof(_benchmarks[0]))
+
+/*
+ * From the code before it was optimised, but for lines_clipped and
+ * lines_offscreen: the old line code read and wrote outside the
+ * framebuffer for lines that ran off it along their minor axis, so those
+ * are from the code as it is now. (lines_offscreen is a blank screen.)
+ */
+static const golden_t _golden[] = {
+    { "fill_rect",          8, 0x723a3fc5, 0x2b17d185 },
+    { "fill_rect",         32, 0x0cda3cb5, 0x9ccbd545 },
+    { "fill_rect",        144, 0x132468d5, 0xe2b8f045 },
+    { "round_rect",        60, 0xbbc05fcc, 0x6f8ce7f4 },
+    { "line_1px",          16, 0x031389b6, 0xfda3ce4a },
+    { "line_1px",         128, 0x94620084, 0x2f2af9fa },
+    { "lines",            200, 0x67de29d8, 0x56302fd6 },
+    { "lines_clipped",    200, 0x497a7d72, 0x36e24c84 },
+    { "lines_offscreen",   20, 0xbc940035, 0x6ef43945 },
+    { "line_5px",         128, 0x68ed9f21, 0xab702eb6 },
+    { "fill_circle",        8, 0xa2d8bc56, 0xa22dc9fa },
+    { "fill_circle",       60, 0xf042466f, 0x7b396ff2 },
+    { "draw_circle",        8, 0x4d2c53d5, 0xb91e4975 },
+    { "draw_circle",       60, 0x47ae6c53, 0xbfe7879d },
+    { "circles_clipped",  100, 0x0e349deb, 0xba7f35f2 },
+    { "circle_3px",        50, 0xbdc0cfbb, 0x1c8630cd },
+    { "circle_r0",         20, 0xbc940035, 0x6ef43945 },
+    { "fill_path",         40, 0x19f0e370, 0xaa5f86f7 },
+    { "fill_path",        140, 0xa84026ea, 0x83739fd5 },
+    { "polygons",           8, 0xfebf0790, 0x78e1bdf7 },
+    { "path_kinds",       120, 0xf1189d3e, 0xd963d8d5 },
+    { "draw_text",        144, 0x06e02c56, 0x09488d36 },
+    { "draw_text_again",  144, 0x06e02c56, 0x09488d36 },
+    { "text_clipped",     144, 0x6bfad06b, 0x3c9e8116 },
+    { "text_scroll",      144, 0xab5dfdf7, 0x31a7fe91 },
+    { "draw_text_stream", 144, 0x06e02c56, 0x09488d36 },
+    { "text_v2",          144, 0x700e07e4, 0x131009d4 },
+    { "text_v2_stream",   144, 0x700e07e4, 0x131009d4 },
+};
+#define GOLDEN_COUNT (sizeof(_golden) / sizeof(_golden[0]))
+
+/*** running them ***/
+
+static double _now_us(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+/*
+ * FNV-1a over the whole framebuffer
+ */
+static uint32_t _checksum(void)
+{
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t i = 0; i < FB_SIZE; i++)
+        hash = (hash ^ _fb[i]) * 16777619u;
+
+    return hash;
+}
+
+static void _clear(n_GContext *ctx)
+{
+    n_graphics_context_set_fill_color(ctx, n_GColorWhite);
+    n_graphics_fill_rect(ctx, n_GRect(0, 0, __SCREEN_WIDTH, __SCREEN_HEIGHT), 0, n_GCornerNone);
+    n_graphics_context_set_fill_color(ctx, n_GColorBlack);
+    n_graphics_context_set_stroke_color(ctx, n_GColorBlack);
+    n_graphics_context_set_text_color(ctx, n_GColorBlack);
+    n_graphics_context_set_stroke_width(ctx, 1);
+}
+
+static const golden_t *_find_golden(const bench_t *bench)
+{
+    for (uint32_t i = 0; i < GOLDEN_COUNT; i++)
+        if (!strcmp(_golden[i].name, bench->name) && _golden[i].size == bench->size)
+            return &_golden[i];
+
+    return NULL;
+}
+
+/*
+ * Returns 0 if the drawing is as it should be
+ */
+static int _run(n_GContext *ctx, const bench_t *bench, int print_golden)
+{
+    const golden_t *golden = _find_golden(bench);
+    uint32_t calls = 0, sum, want;
+    double start, elapsed;
+
+    _clear(ctx);
+    _font_flush();
+
+    start = _now_us();
+    do
+    {
+        bench->func(ctx, bench->size);
+        calls++;
+        elapsed = _now_us() - start;
+    } while (elapsed < BENCH_MIN_US);
+
+    _clear(ctx);
+    _font_flush();
+    bench->func(ctx, bench->size);
+    sum = _checksum();
+
+    if (print_golden)
+    {
+        printf("    { \"%s\",%*s %3d, 0x%08x },\n", bench->name,
+               (int)(16 - strlen(bench->name)), "", bench->size, sum);
+        return 0;
+    }
+
+#ifdef PBL_BW
+    want = golden ? golden->bw : 0;
+#else
+    want = golden ? golden->color : 0;
+#endif
+
+    printf("%-16s %3d: %9.2f us %08x %s\n", bench->name, bench->size, elapsed / calls, sum,
+           !golden ? "no golden checksum" : sum == want ? "ok" : "CHANGED");
+
+    return !golden || sum != want;
+}
+
+static int _wanted(const bench_t *bench, int argc, char **argv)
+{
+    if (argc == 0)
+        return 1;
+
+    for (int i = 0; i < argc; i++)
+        if (!strcmp(argv[i], bench->name))
+            return 1;
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    n_GContext *ctx = n_graphics_context_from_buffer(_fb);
+    int print_golden = argc > 1 && !strcmp(argv[1], "-g");
+    int failed = 0;
+
+    argc -= 1 + print_golden;
+    argv += 1 + print_golden;
+
+    _font_build(_font_data, 3);
+    _font = (n_GFont)_font_data;
+    _font_build(_font_v2_data, 2);
+    _font_v2 = (n_GFont)_font_v2_data;
+#ifdef __FONT_VERSION_STREAM
+    const uint8_t *data = _font_data, *data_v2 = _font_v2_data;
+
+    _stream_font = n_graphics_font_stream_create(_font_read, &data, sizeof(data), malloc);
+    _stream_font_v2 = n_graphics_font_stream_create(_font_read, &data_v2, sizeof(data_v2), malloc);
+#else
+    _stream_font = _font;
+    _stream_font_v2 = _font_v2;
+#endif
+
+    for (uint32_t i = 0; i < BENCH_COUNT; i++)
+        if (_wanted(&_benchmarks[i], argc, argv))
+            failed += _run(ctx, &_benchmarks[i], print_golden);
+
+    if (failed)
+        printf("%d changed\n", failed);
+
+#ifdef __FONT_VERSION_STREAM
+    n_graphics_font_stream_destroy(_stream_font, free);
+    n_graphics_font_stream_destroy(_stream_font_v2, free);
+#endif
+    n_graphics_context_destroy(ctx);
+
+    return failed != 0;
+}
@@ -0,0 +1,39 @@
+/* pebble.h
+ * Host stand-in for the neographics benchmark: just enough of the
+ * firmware's pebble.h for the drawing code. The screen type (PBL_BW or
+ * PBL_COLOR) comes in on the command line; see the Makefile
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// neographics draws straight into our framebuffer
+#define NGFX_IS_CORE
+#define PBL_RECT
+
+// rect.c borrows the firmware's name for it
+#define GPoint n_GPoint
+
+#define TRIG_MAX_RATIO 0xffff
+#define TRIG_MAX_ANGLE 0x10000
+
+int32_t sin_lookup(int32_t angle);
+int32_t cos_lookup(int32_t angle);
+
+#define app_malloc malloc
+#define app_calloc calloc
+#define app_free free
+
+// only ever handed around by context.c, never looked inside
+typedef struct n_GContext GContext;
+typedef struct GBitmap GBitmap;
+typedef enum { GBitmapFormat1Bit, GBitmapFormat8Bit } GBitmapFormat;
+
+GBitmap *graphics_capture_frame_buffer(GContext *ctx);
+GBitmap *graphics_capture_frame_buffer_format(GContext *ctx, GBitmapFormat format);
+bool graphics_release_frame_buffer(GContext *ctx, GBitmap *bitmap);
+uint8_t *gbitmap_get_data(const GBitmap *bitmap);
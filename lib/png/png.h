@@ -3,7 +3,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <pebble.h>
+#include "upng.h"
 
 
-void png_to_gbitmap(GBitmap *bitmap, uint8_t *raw_buffer, size_t png_size);
+bool png_to_gbitmap(GBitmap *bitmap, uint8_t *raw_buffer, size_t png_size);
+bool png_to_gbitmap_stream(GBitmap *bitmap, upng_read_func read, void *context, size_t png_size);
 
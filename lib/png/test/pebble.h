@@ -0,0 +1,11 @@
+/* pebble.h
+ * Host stand-in for the upng benchmark: the app heap is the C heap
+ */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define app_malloc malloc
+#define app_calloc calloc
+#define app_free free
@@ -0,0 +1,323 @@
+/* upng_bench.c
+ * Host benchmark for the PNG decoder
+ * RebbleOS
+ *
+ * Give it a flash image and it decodes every PNG among the system
+ * resources, or give it PNG files. Each one is decoded from memory and
+ * streamed, as gbitmap does when it is mapped or not, and both have to give
+ * the same image as the old decoder in upng_ref.c. Then both are timed.
+ * upng doesn't do interlacing, so interlaced PNGs are skipped.
+ * Build and run with the Makefile next to this.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "upng.h"
+
+/* the old decoder; see upng_ref.c */
+upng_t *ref_upng_new_from_bytes(unsigned char *raw_buffer, unsigned long size, uint8_t **out_buffer);
+upng_error ref_upng_decode(upng_t *upng);
+const unsigned char *ref_upng_get_buffer(const upng_t *upng);
+unsigned ref_upng_get_size(const upng_t *upng);
+void ref_upng_free(upng_t *upng);
+
+/* where the system resources are in the SPI image; see platform_config.h */
+#define REGION_RES_START 0x380000
+#define RES_COUNT        0x00
+#define RES_TABLE_START  0x0C
+#define RES_START        0x200C
+
+/* each image is decoded for at least this long */
+#define BENCH_MIN_SECS   0.05
+
+/* where the interlace method is: signature, IHDR length and type, then
+ * width, height, depth, colour type, compression and filter */
+#define IHDR_INTERLACE   28
+
+typedef struct {
+    uint32_t index;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t crc;
+} res_handle_t;
+
+typedef struct {
+    const unsigned char *data;
+    unsigned long size;
+} png_source_t;
+
+static const unsigned char _png_sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+static int _pngs, _failed, _skipped, _unchecked;
+static unsigned long _pixels, _compressed;
+static double _bytes_secs, _stream_secs;
+
+static double _now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void _png_read(void *context, unsigned long offset, unsigned char *buffer, unsigned long length)
+{
+    png_source_t *source = (png_source_t *)context;
+
+    if (offset > source->size || length > source->size - offset)
+    {
+        printf("read of %lu at %lu is past the end of %lu bytes\n", length, offset, source->size);
+        exit(1);
+    }
+    memcpy(buffer, source->data + offset, length);
+}
+
+/*
+ * Decode once. Returns the image, which the caller frees, or NULL
+ */
+static unsigned char *_decode(const unsigned char *data, unsigned long size, int stream, unsigned *out_size)
+{
+    png_source_t source = { data, size };
+    upng_t *upng;
+    unsigned char *image = NULL;
+
+    if (stream)
+    {
+        upng = upng_new_from_stream(_png_read, &source, size);
+    }
+    else
+    {
+        /* it only reads the source, but doesn't say so */
+        upng = upng_new_from_bytes((unsigned char *)data, size, NULL);
+    }
+
+    if (upng == NULL)
+        return NULL;
+
+    if (upng_decode(upng) == UPNG_EOK)
+    {
+        image = (unsigned char *)upng_get_buffer(upng);
+        *out_size = upng_get_size(upng);
+    }
+    else if (upng_get_buffer(upng))
+    {
+        free((void *)upng_get_buffer(upng));
+    }
+
+    upng_free(upng);
+
+    return image;
+}
+
+/*
+ * Decode with the old decoder, which frees the PNG it is given. Returns
+ * the image, which the caller frees, or NULL
+ */
+static unsigned char *_decode_ref(const unsigned char *data, unsigned long size, unsigned *out_size)
+{
+    unsigned char *copy = malloc(size);
+    unsigned char *image = NULL;
+    upng_t *upng;
+
+    if (copy == NULL)
+        return NULL;
+    memcpy(copy, data, size);
+
+    upng = ref_upng_new_from_bytes(copy, size, NULL);
+    if (upng == NULL)
+    {
+        free(copy);
+        return NULL;
+    }
+
+    if (ref_upng_decode(upng) == UPNG_EOK)
+    {
+        image = (unsigned char *)ref_upng_get_buffer(upng);
+        *out_size = ref_upng_get_size(upng);
+    }
+
+    ref_upng_free(upng);
+
+    return image;
+}
+
+/*
+ * Seconds for one decode, averaged over as many as fit in BENCH_MIN_SECS
+ */
+static double _time_decode(const unsigned char *data, unsigned long size, int stream)
+{
+    double start = _now(), elapsed;
+    unsigned long decodes = 0;
+    unsigned out_size;
+
+    do
+    {
+        free(_decode(data, size, stream, &out_size));
+        decodes++;
+        elapsed = _now() - start;
+    } while (elapsed < BENCH_MIN_SECS);
+
+    return elapsed / decodes;
+}
+
+static void _bench_png(const char *name, const unsigned char *data, unsigned long size)
+{
+    unsigned bytes_size = 0, stream_size = 0, ref_size = 0;
+    unsigned char *bytes_image, *stream_image, *ref_image;
+    const char *err = NULL;
+    upng_t *upng;
+
+    if (size > IHDR_INTERLACE && data[IHDR_INTERLACE] != 0)
+    {
+        printf("%s: interlaced; upng doesn't do those, skipped\n", name);
+        _skipped++;
+        return;
+    }
+
+    bytes_image = _decode(data, size, 0, &bytes_size);
+    stream_image = _decode(data, size, 1, &stream_size);
+    ref_image = _decode_ref(data, size, &ref_size);
+
+    if (!bytes_image || !stream_image)
+        err = ref_image ? "doesn't decode, but the old decoder does" : "doesn't decode";
+    else if (bytes_size != stream_size || memcmp(bytes_image, stream_image, bytes_size))
+        err = "streamed decode differs";
+    else if (ref_image && (bytes_size != ref_size || memcmp(bytes_image, ref_image, bytes_size)))
+        err = "differs from the old decoder";
+
+    /* the old decoder turns down some good PNGs, so all we can do there is
+     * check the new one agrees with itself */
+    if (!err && !ref_image)
+    {
+        printf("%s: the old decoder can't do this one; not checked against it\n", name);
+        _unchecked++;
+    }
+
+    free(bytes_image);
+    free(stream_image);
+    free(ref_image);
+
+    if (err)
+    {
+        printf("%s: %s\n", name, err);
+        _failed++;
+        return;
+    }
+
+    upng = upng_new_from_bytes((unsigned char *)data, size, NULL);
+    upng_header(upng);
+    _pixels += upng_get_width(upng) * upng_get_height(upng);
+    upng_free(upng);
+
+    _compressed += size;
+    _pngs++;
+
+    _bytes_secs += _time_decode(data, size, 0);
+    _stream_secs += _time_decode(data, size, 1);
+}
+
+static void _bench_image(const char *path, const unsigned char *image, unsigned long size)
+{
+    uint32_t count;
+
+    if (size < REGION_RES_START + RES_START)
+    {
+        printf("%s: too small to be a flash image\n", path);
+        _failed++;
+        return;
+    }
+
+    memcpy(&count, image + REGION_RES_START + RES_COUNT, sizeof(count));
+    if (count == 0 || count > 4096)
+    {
+        printf("%s: no resource table at 0x%x\n", path, REGION_RES_START);
+        _failed++;
+        return;
+    }
+
+    for (uint32_t id = 1; id <= count; id++)
+    {
+        res_handle_t handle;
+        unsigned long start;
+        char name[64];
+
+        memcpy(&handle, image + REGION_RES_START + RES_TABLE_START + (id - 1) * sizeof(handle), sizeof(handle));
+        start = REGION_RES_START + RES_START + handle.offset;
+        if (handle.size < sizeof(_png_sig) || start > size || handle.size > size - start)
+            continue;
+        if (memcmp(image + start, _png_sig, sizeof(_png_sig)))
+            continue;
+
+        snprintf(name, sizeof(name), "%s resource %u", path, id);
+        _bench_png(name, image + start, handle.size);
+    }
+}
+
+static unsigned char *_load(const char *path, unsigned long *size)
+{
+    FILE *f = fopen(path, "rb");
+    unsigned char *data;
+
+    if (f == NULL)
+        return NULL;
+
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+
+    data = malloc(*size);
+    if (data && fread(data, 1, *size, f) != *size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: %s <flash image | file.png>...\n", argv[0]);
+        return 2;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        unsigned long size;
+        unsigned char *data = _load(argv[i], &size);
+
+        if (data == NULL)
+        {
+            printf("%s: can't read it\n", argv[i]);
+            return 1;
+        }
+
+        if (size >= sizeof(_png_sig) && !memcmp(data, _png_sig, sizeof(_png_sig)))
+            _bench_png(argv[i], data, size);
+        else
+            _bench_image(argv[i], data, size);
+
+        free(data);
+    }
+
+    if (_pngs)
+    {
+        printf("%d PNGs, %lu bytes compressed, %lu pixels\n", _pngs, _compressed, _pixels);
+        printf("from memory: %.1f us for all, %.2f Mpixel/s\n", _bytes_secs * 1e6, _pixels / _bytes_secs / 1e6);
+        printf("streamed:    %.1f us for all, %.2f Mpixel/s\n", _stream_secs * 1e6, _pixels / _stream_secs / 1e6);
+    }
+
+    if (_skipped)
+        printf("%d skipped\n", _skipped);
+    if (_unchecked)
+        printf("%d not checked against the old decoder\n", _unchecked);
+    if (_failed)
+        printf("%d failed\n", _failed);
+
+    return _failed || !_pngs;
+}
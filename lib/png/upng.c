@@ -33,8 +33,6 @@ freely, subject to the following restrictions:
 
 //smaller decompressor
 //saves about 900 bytes, but still crashing watch
-//#include "tinfl.h"
-//#define TINFL 1
 #include <pebble.h>
 
 //Debug stack overflow
@@ -61,14 +59,13 @@ freely, subject to the following restrictions:
 #define NUM_CODE_LENGTH_CODES 19	/*the code length codes. 0-15: code lengths, 16: copy previous 3-6 times, 17: 3-10 zeros, 18: 11-138 zeros */
 #define MAX_SYMBOLS 288 /* largest number of symbols used by any tree type */
 
-#define DEFLATE_CODE_BITLEN 15
-#define DISTANCE_BITLEN 15
-#define CODE_LENGTH_BITLEN 7
-#define MAX_BIT_LENGTH 15 // bug? 15 /* largest bitlen used by any tree type */
+#define MAX_BIT_LENGTH 15 /* largest bitlen used by any tree type; tables indexed by it need one more */
 
-#define DEFLATE_CODE_BUFFER_SIZE (NUM_DEFLATE_CODE_SYMBOLS * 2)
-#define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
-#define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
+/* Codes up to this many bits long are decoded with one lookup in a table
+ * indexed by the next bits of input. The few longer ones are decoded a bit
+ * at a time. The code length codes are at most 7 bits, so always fit */
+#define LITLEN_FAST_BITS 9
+#define DISTANCE_FAST_BITS 7
 
 #define SET_ERROR(upng,code) do { (upng)->error = (code); (upng)->error_line = __LINE__; } while (0)
 
@@ -93,11 +90,27 @@ typedef enum upng_color {
 } upng_color;
 
 typedef struct upng_source {
-        unsigned char*	buffer;
-        unsigned long			size;
-        char					owning;
+        upng_read_func	read;
+        void*		context;
+        unsigned long	size;
 } upng_source;
 
+/* The compressed image data is pulled out of the IDAT chunks a piece at a
+ * time as the inflater wants it, rather than all being gathered up into
+ * one buffer first */
+#define UPNG_READ_SIZE 128
+
+typedef struct upng_idat {
+        unsigned long	next_chunk;	/* offset of the next chunk header */
+        unsigned long	offset;		/* offset of the next unread IDAT byte */
+        unsigned long	left;		/* unread bytes in the current IDAT */
+        unsigned char	buffer[UPNG_READ_SIZE];
+        uint16_t	pos;		/* next byte in buffer */
+        uint16_t	len;		/* bytes in buffer */
+        uint32_t	bitbuf;		/* bits read in but not used yet, lsb first */
+        unsigned char	bitcount;	/* how many of them there are */
+} upng_idat;
+
 typedef struct upng_text {
 char* keyword;
 char* text;
@@ -131,14 +144,28 @@ struct upng_t {
 
         upng_state		state;
         upng_source		source;
+        upng_idat		idat;
 };
 
-#ifndef TINFL
-typedef struct huffman_tree {
-        uint16_t* tree2d;
-        uint16_t maxbitlen;	/*maximum number of bits a single code can get */
-        uint16_t numcodes;	/*number of symbols in the alphabet = number of codes */
-} huffman_tree;
+typedef struct huffman_table {
+        uint16_t* fast;		/* indexed by the next fast_bits bits: symbol << 4 | code length, or 0 for longer codes */
+        uint16_t* symbol;	/* the symbols in code order, for decoding the longer codes */
+        uint16_t count[MAX_BIT_LENGTH + 1];	/* number of codes of each length */
+        unsigned char fast_bits;
+} huffman_table;
+
+/* everything needed to decode a block; allocated once per image, rather
+ * than on the 2k Pebble stack */
+typedef struct inflate_tables {
+        huffman_table litlen;
+        huffman_table distance;
+        uint16_t litlen_fast[1 << LITLEN_FAST_BITS];
+        uint16_t litlen_symbol[NUM_DEFLATE_CODE_SYMBOLS];
+        uint16_t distance_fast[1 << DISTANCE_FAST_BITS];
+        uint16_t distance_symbol[NUM_DISTANCE_SYMBOLS];
+        unsigned char lengths[NUM_DEFLATE_CODE_SYMBOLS + NUM_DISTANCE_SYMBOLS];
+        unsigned char fixed;	/* the tables hold the fixed codes already */
+} inflate_tables;
 
 static const uint16_t LENGTH_BASE[29] = {	/*the base lengths represented by codes 257-285 */
         3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
@@ -163,571 +190,509 @@ static const uint16_t DISTANCE_EXTRA[30] = {	/*the extra bits of backwards dista
 static const uint16_t CLCL[NUM_CODE_LENGTH_CODES]	/*the order in which "code length alphabet code lengths" are stored, out of this the huffman tree of the dynamic huffman tree lengths is generated */
 = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
-static const uint16_t FIXED_DEFLATE_CODE_TREE[NUM_DEFLATE_CODE_SYMBOLS * 2] = {
-        289, 370, 290, 307, 546, 291, 561, 292, 293, 300, 294, 297, 295, 296, 0, 1,
-        2, 3, 298, 299, 4, 5, 6, 7, 301, 304, 302, 303, 8, 9, 10, 11, 305, 306, 12,
-        13, 14, 15, 308, 339, 309, 324, 310, 317, 311, 314, 312, 313, 16, 17, 18,
-        19, 315, 316, 20, 21, 22, 23, 318, 321, 319, 320, 24, 25, 26, 27, 322, 323,
-        28, 29, 30, 31, 325, 332, 326, 329, 327, 328, 32, 33, 34, 35, 330, 331, 36,
-        37, 38, 39, 333, 336, 334, 335, 40, 41, 42, 43, 337, 338, 44, 45, 46, 47,
-        340, 355, 341, 348, 342, 345, 343, 344, 48, 49, 50, 51, 346, 347, 52, 53,
-        54, 55, 349, 352, 350, 351, 56, 57, 58, 59, 353, 354, 60, 61, 62, 63, 356,
-        363, 357, 360, 358, 359, 64, 65, 66, 67, 361, 362, 68, 69, 70, 71, 364,
-        367, 365, 366, 72, 73, 74, 75, 368, 369, 76, 77, 78, 79, 371, 434, 372,
-        403, 373, 388, 374, 381, 375, 378, 376, 377, 80, 81, 82, 83, 379, 380, 84,
-        85, 86, 87, 382, 385, 383, 384, 88, 89, 90, 91, 386, 387, 92, 93, 94, 95,
-        389, 396, 390, 393, 391, 392, 96, 97, 98, 99, 394, 395, 100, 101, 102, 103,
-        397, 400, 398, 399, 104, 105, 106, 107, 401, 402, 108, 109, 110, 111, 404,
-        419, 405, 412, 406, 409, 407, 408, 112, 113, 114, 115, 410, 411, 116, 117,
-        118, 119, 413, 416, 414, 415, 120, 121, 122, 123, 417, 418, 124, 125, 126,
-        127, 420, 427, 421, 424, 422, 423, 128, 129, 130, 131, 425, 426, 132, 133,
-        134, 135, 428, 431, 429, 430, 136, 137, 138, 139, 432, 433, 140, 141, 142,
-        143, 435, 483, 436, 452, 568, 437, 438, 445, 439, 442, 440, 441, 144, 145,
-        146, 147, 443, 444, 148, 149, 150, 151, 446, 449, 447, 448, 152, 153, 154,
-        155, 450, 451, 156, 157, 158, 159, 453, 468, 454, 461, 455, 458, 456, 457,
-        160, 161, 162, 163, 459, 460, 164, 165, 166, 167, 462, 465, 463, 464, 168,
-        169, 170, 171, 466, 467, 172, 173, 174, 175, 469, 476, 470, 473, 471, 472,
-        176, 177, 178, 179, 474, 475, 180, 181, 182, 183, 477, 480, 478, 479, 184,
-        185, 186, 187, 481, 482, 188, 189, 190, 191, 484, 515, 485, 500, 486, 493,
-        487, 490, 488, 489, 192, 193, 194, 195, 491, 492, 196, 197, 198, 199, 494,
-        497, 495, 496, 200, 201, 202, 203, 498, 499, 204, 205, 206, 207, 501, 508,
-        502, 505, 503, 504, 208, 209, 210, 211, 506, 507, 212, 213, 214, 215, 509,
-        512, 510, 511, 216, 217, 218, 219, 513, 514, 220, 221, 222, 223, 516, 531,
-        517, 524, 518, 521, 519, 520, 224, 225, 226, 227, 522, 523, 228, 229, 230,
-        231, 525, 528, 526, 527, 232, 233, 234, 235, 529, 530, 236, 237, 238, 239,
-        532, 539, 533, 536, 534, 535, 240, 241, 242, 243, 537, 538, 244, 245, 246,
-        247, 540, 543, 541, 542, 248, 249, 250, 251, 544, 545, 252, 253, 254, 255,
-        547, 554, 548, 551, 549, 550, 256, 257, 258, 259, 552, 553, 260, 261, 262,
-        263, 555, 558, 556, 557, 264, 265, 266, 267, 559, 560, 268, 269, 270, 271,
-        562, 565, 563, 564, 272, 273, 274, 275, 566, 567, 276, 277, 278, 279, 569,
-        572, 570, 571, 280, 281, 282, 283, 573, 574, 284, 285, 286, 287, 0, 0
-};
-
-static const uint16_t FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
-        33, 48, 34, 41, 35, 38, 36, 37, 0, 1, 2, 3, 39, 40, 4, 5, 6, 7, 42, 45, 43,
-        44, 8, 9, 10, 11, 46, 47, 12, 13, 14, 15, 49, 56, 50, 53, 51, 52, 16, 17,
-        18, 19, 54, 55, 20, 21, 22, 23, 57, 60, 58, 59, 24, 25, 26, 27, 61, 62, 28,
-        29, 30, 31, 0, 0
-};
-#endif
-
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+static void upng_read(upng_t* upng, unsigned long offset, unsigned char* buffer, unsigned long length)
 {
-        unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
-        (*bitpointer)++;
-        return result;
+        upng->source.read(upng->source.context, offset, buffer, length);
 }
 
-#ifndef TINFL
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+/* read the next piece of compressed data into the buffer, moving on through
+ * the IDAT chunks as each runs out. returns 0 once there is no more */
+static int read_idat(upng_t* upng)
 {
-        unsigned result = 0, i;
-        for (i = 0; i < nbits; i++)
-                result |= ((unsigned)read_bit(bitpointer, bitstream)) << i;
-        return result;
+        upng_idat* idat = &upng->idat;
+        unsigned char header[8];
+
+        while (idat->left == 0) {
+                if (idat->next_chunk + 12 > upng->source.size) {
+                        return 0;
+                }
+
+                upng_read(upng, idat->next_chunk, header, 8);
+                if (upng_chunk_type(header) == CHUNK_IEND) {
+                        return 0;
+                } else if (upng_chunk_type(header) == CHUNK_IDAT) {
+                        idat->offset = idat->next_chunk + 8;
+                        idat->left = upng_chunk_length(header);
+                }
+
+                idat->next_chunk += upng_chunk_length(header) + 12;
+        }
+
+        idat->len = idat->left < UPNG_READ_SIZE ? idat->left : UPNG_READ_SIZE;
+        upng_read(upng, idat->offset, idat->buffer, idat->len);
+        idat->offset += idat->len;
+        idat->left -= idat->len;
+        idat->pos = 0;
+        return 1;
 }
 
-/* the buffer must be numcodes*2 in size! */
-static void huffman_tree_init(huffman_tree* tree, uint16_t* buffer, uint16_t numcodes, uint16_t maxbitlen)
+/* top the bit buffer up with as many whole bytes as fit, so the decoders can
+ * look ahead. At the end of the data there may be fewer bits than asked for */
+static void fill_bits(upng_t* upng)
 {
-        tree->tree2d = buffer;
+        upng_idat* idat = &upng->idat;
 
-        tree->numcodes = numcodes;
-        tree->maxbitlen = maxbitlen;
+        while (idat->bitcount <= 24) {
+                if (idat->pos == idat->len && !read_idat(upng)) {
+                        return;
+                }
+
+                idat->bitbuf |= (uint32_t)idat->buffer[idat->pos++] << idat->bitcount;
+                idat->bitcount += 8;
+        }
 }
 
-/*given the code lengths (as stored in the PNG file), generate the tree as defined by Deflate. maxbitlen is the maximum bits that a code in the tree can have. return value is error.*/
-static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const uint16_t *bitlen)
+/* take up to 16 bits off the input */
+static unsigned read_bits(upng_t* upng, unsigned nbits)
 {
-        uint16_t* tree1d = app_malloc(sizeof(uint16_t) * MAX_SYMBOLS);
-uint16_t blcount[MAX_BIT_LENGTH];
-uint16_t nextcode[MAX_BIT_LENGTH];
-        //unsigned* blcount = app_malloc(sizeof(unsigned) * MAX_BIT_LENGTH);
-        //unsigned* nextcode = app_malloc(sizeof(unsigned) * MAX_BIT_LENGTH);
-if (!tree1d) {
-                SET_ERROR(upng, UPNG_ENOMEM);
-                return;
-}
+        upng_idat* idat = &upng->idat;
+        unsigned result;
 
-        uint16_t bits, n, i;
-        uint16_t nodefilled = 0;	/*up to which node it is filled */
-        uint16_t treepos = 0;	/*position in the tree (1 of the numcodes columns) */
+        if (idat->bitcount < nbits) {
+                fill_bits(upng);
 
-        /* initialize local vectors */
-        memset(blcount, 0, sizeof(uint16_t) * MAX_BIT_LENGTH);
-        memset(nextcode, 0, sizeof(uint16_t) * MAX_BIT_LENGTH);
+                /* error: the data ran out before the end code */
+                if (idat->bitcount < nbits) {
+                        SET_ERROR(upng, UPNG_EMALFORMED);
+                        return 0;
+                }
+        }
 
-        /*step 1: count number of instances of each code length */
-        for (bits = 0; bits < tree->numcodes; bits++) {
-                blcount[bitlen[bits]]++;
+        result = idat->bitbuf & ((1u << nbits) - 1);
+        idat->bitbuf >>= nbits;
+        idat->bitcount -= nbits;
+        return result;
+}
+
+/*given the code lengths (as stored in the PNG file), generate the decoding table as defined by Deflate*/
+static void huffman_table_create(upng_t* upng, huffman_table* table, const unsigned char* bitlen, uint16_t numcodes)
+{
+        uint16_t offs[MAX_BIT_LENGTH + 1];
+        uint16_t len, n, i, code;
+        int left = 1;
+
+        /* count number of instances of each code length */
+        memset(table->count, 0, sizeof(table->count));
+        for (n = 0; n < numcodes; n++) {
+                table->count[bitlen[n]]++;
         }
+        table->count[0] = 0;
 
-        /*step 2: generate the nextcode values */
-        for (bits = 1; bits <= tree->maxbitlen; bits++) {
-                nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
+        /* check the code isn't oversubscribed. Incomplete codes are allowed,
+         * and anything that decodes to a missing code is an error */
+        for (len = 1; len <= MAX_BIT_LENGTH; len++) {
+                left = (left << 1) - table->count[len];
+                if (left < 0) {
+                        SET_ERROR(upng, UPNG_EMALFORMED);
+                        return;
+                }
         }
 
-        /*step 3: generate all the codes */
-        for (n = 0; n < tree->numcodes; n++) {
+        /* sort the symbols by code length, which puts them in code order */
+        offs[1] = 0;
+        for (len = 1; len < MAX_BIT_LENGTH; len++) {
+                offs[len + 1] = offs[len] + table->count[len];
+        }
+        for (n = 0; n < numcodes; n++) {
                 if (bitlen[n] != 0) {
-                        tree1d[n] = nextcode[bitlen[n]]++;
+                        table->symbol[offs[bitlen[n]]++] = n;
                 }
         }
 
-        /*convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means uninited, a value >= numcodes is an address to another bit, a value < numcodes is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as many columns as codes - 1
-        a good huffmann tree has N * 2 - 1 nodes, of which N - 1 are internal nodes. Here, the internal nodes are stored (what their 0 and 1 option point to). There is only memory for such good tree currently, if there are more nodes (due to too long length codes), error 55 will happen */
-        for (n = 0; n < tree->numcodes * 2; n++) {
-                tree->tree2d[n] = 32767;	/*32767 here means the tree2d isn't filled there yet */
-        }
+        /* each short code fills every fast entry that starts with it. The bits
+         * come in lsb first, so the entries are indexed by the code reversed */
+        memset(table->fast, 0, sizeof(uint16_t) << table->fast_bits);
+        code = 0;
+        i = 0;
+        for (len = 1; len <= table->fast_bits; len++) {
+                for (n = 0; n < table->count[len]; n++, i++, code++) {
+                        uint16_t reversed = 0, k;
 
-        for (n = 0; n < tree->numcodes; n++) {	/*the codes */
-                for (i = 0; i < bitlen[n]; i++) {	/*the bits for this code */
-                        unsigned char bit = (unsigned char)((tree1d[n] >> (bitlen[n] - i - 1)) & 1);
-                        /* check if oversubscribed */
-                        if (treepos > tree->numcodes - 2) {
-                                SET_ERROR(upng, UPNG_EMALFORMED);
-                                return;
+                        for (k = 0; k < len; k++) {
+                                reversed |= ((code >> k) & 1) << (len - 1 - k);
                         }
-
-                        if (tree->tree2d[2 * treepos + bit] == 32767) {	/*not yet filled in */
-                                if (i + 1 == bitlen[n]) {	/*last bit */
-                                        tree->tree2d[2 * treepos + bit] = n;	/*put the current code in it */
-                                        treepos = 0;
-                                } else {	/*put address of the next step in here, first that address has to be found of course (it's just nodefilled + 1)... */
-                                        nodefilled++;
-                                        tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;	/*addresses encoded with numcodes added to it */
-                                        treepos = nodefilled;
-                                }
-                        } else {
-                                treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
+                        for (k = reversed; k < (1 << table->fast_bits); k += 1 << len) {
+                                table->fast[k] = (table->symbol[i] << 4) | len;
                         }
                 }
+                code <<= 1;
         }
-
-        for (n = 0; n < tree->numcodes * 2; n++) {
-                if (tree->tree2d[n] == 32767) {
-                        tree->tree2d[n] = 0;	/*remove possible remaining 32767's */
-                }
-        }
-        app_free(tree1d);
-        //free(blcount);
-        //free(nextcode);
 }
 
-static uint16_t huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+/* a code too long for the fast table, so walk the canonical code a bit at a time */
+static uint16_t huffman_decode_slow(upng_t* upng, const huffman_table* table)
 {
-        uint16_t treepos = 0, ct;
-        unsigned char bit;
-        for (;;) {
-                /* error: end of input memory reached without endcode */
-                if (((*bp) & 0x07) == 0 && ((*bp) >> 3) > inlength) {
-                        SET_ERROR(upng, UPNG_EMALFORMED);
+        int code = 0, first = 0, index = 0;
+        uint16_t len;
+
+        for (len = 1; len <= MAX_BIT_LENGTH; len++) {
+                code |= read_bits(upng, 1);
+                if (upng->error != UPNG_EOK) {
                         return 0;
                 }
 
-                bit = read_bit(bp, in);
-
-                ct = codetree->tree2d[(treepos << 1) | bit];
-                if (ct < codetree->numcodes) {
-                        return ct;
+                if (code - first < table->count[len]) {
+                        return table->symbol[index + code - first];
                 }
 
-                treepos = ct - codetree->numcodes;
-                if (treepos >= codetree->numcodes) {
-                        SET_ERROR(upng, UPNG_EMALFORMED);
-                        return 0;
-                }
+                index += table->count[len];
+                first = (first + table->count[len]) << 1;
+                code <<= 1;
         }
+
+        /* error: no such code */
+        SET_ERROR(upng, UPNG_EMALFORMED);
+        return 0;
 }
 
-/* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, const unsigned char *in, unsigned long *bp, unsigned long inlength)
+static uint16_t huffman_decode_symbol(upng_t* upng, const huffman_table* table)
 {
+        upng_idat* idat = &upng->idat;
+        uint16_t entry;
 
-        //unsigned* codelengthcode = (unsigned*)app_malloc(sizeof(unsigned) * NUM_CODE_LENGTH_CODES);
-        uint16_t codelengthcode[NUM_CODE_LENGTH_CODES];
-        uint16_t* bitlen = (uint16_t*)app_malloc(sizeof(uint16_t) * NUM_DEFLATE_CODE_SYMBOLS);
-        //unsigned* bitlenD = (unsigned*)app_malloc(sizeof(unsigned) * NUM_DISTANCE_SYMBOLS);
-        uint16_t bitlenD[NUM_DISTANCE_SYMBOLS];
+        if (idat->bitcount < table->fast_bits) {
+                fill_bits(upng);
+        }
 
-if (!bitlen) {
-                SET_ERROR(upng, UPNG_ENOMEM);
-                return;
+        entry = table->fast[idat->bitbuf & ((1u << table->fast_bits) - 1)];
+        if (entry != 0 && (entry & 15) <= idat->bitcount) {
+                idat->bitbuf >>= entry & 15;
+                idat->bitcount -= entry & 15;
+                return entry >> 4;
+        }
+
+        return huffman_decode_slow(upng, table);
 }
 
-uint16_t n, hlit, hdist, hclen, i;
+/* the fixed codes are the same every time, so only build them if the last block didn't use them */
+static void get_tree_inflate_fixed(upng_t* upng, inflate_tables* tables)
+{
+        uint16_t i;
 
-        /*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated */
-        /*C-code note: use no "return" between ctor and dtor of an uivector! */
-        if ((*bp) >> 3 >= inlength - 2) {
-                SET_ERROR(upng, UPNG_EMALFORMED);
+        if (tables->fixed) {
                 return;
         }
 
-        /* clear bitlen arrays */
-        memset(bitlen, 0, sizeof(uint16_t) * NUM_DEFLATE_CODE_SYMBOLS);
-        memset(bitlenD, 0, sizeof(uint16_t) * NUM_DISTANCE_SYMBOLS);
+        for (i = 0; i < NUM_DEFLATE_CODE_SYMBOLS; i++) {
+                tables->lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        }
+        for (i = 0; i < NUM_DISTANCE_SYMBOLS; i++) {
+                tables->lengths[NUM_DEFLATE_CODE_SYMBOLS + i] = 5;
+        }
 
-        /*the bit pointer is or will go past the memory */
-        hlit = read_bits(bp, in, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
-        hdist = read_bits(bp, in, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
-        hclen = read_bits(bp, in, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+        huffman_table_create(upng, &tables->litlen, tables->lengths, NUM_DEFLATE_CODE_SYMBOLS);
+        huffman_table_create(upng, &tables->distance, tables->lengths + NUM_DEFLATE_CODE_SYMBOLS, NUM_DISTANCE_SYMBOLS);
+        tables->fixed = 1;
+}
+
+/* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
+static void get_tree_inflate_dynamic(upng_t* upng, inflate_tables* tables)
+{
+        unsigned char codelengthcode[NUM_CODE_LENGTH_CODES];
+        unsigned char* bitlen = tables->lengths;	/* lit/len code lengths, then the distance ones */
+        huffman_table codelengthcodetree;
+        uint16_t hlit, hdist, hclen, i;
+
+        hlit = read_bits(upng, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+        hdist = read_bits(upng, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+        hclen = read_bits(upng, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
 
         for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
                 if (i < hclen) {
-                        codelengthcode[CLCL[i]] = read_bits(bp, in, 3);
+                        codelengthcode[CLCL[i]] = read_bits(upng, 3);
                 } else {
                         codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
                 }
         }
 
-        huffman_tree_create_lengths(upng, codelengthcodetree, codelengthcode);
-
+        /* the code length codes are done with before the distance table is
+         * built, so they borrow its space */
+        tables->fixed = 0;
+        codelengthcodetree.fast = tables->distance_fast;
+        codelengthcodetree.symbol = tables->distance_symbol;
+        codelengthcodetree.fast_bits = DISTANCE_FAST_BITS;
+        huffman_table_create(upng, &codelengthcodetree, codelengthcode, NUM_CODE_LENGTH_CODES);
 
         /* bail now if we encountered an error earlier */
         if (upng->error != UPNG_EOK) {
                 return;
         }
 
+        /*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated */
+        memset(bitlen, 0, sizeof(tables->lengths));
 
         /*now we can use this tree to read the lengths for the tree that this function will return */
         i = 0;
         while (i < hlit + hdist) {	/*i is the current symbol we're reading in the part that contains the code lengths of lit/len codes and dist codes */
-                uint16_t code = huffman_decode_symbol(upng, in, bp, codelengthcodetree, inlength);
+                uint16_t code = huffman_decode_symbol(upng, &codelengthcodetree);
+                uint16_t replength = 1;
+                unsigned char value = code;
+
                 if (upng->error != UPNG_EOK) {
                         break;
                 }
 
-                if (code <= 15) {	/*a length code */
-                        if (i < hlit) {
-                                bitlen[i] = code;
-                        } else {
-                                bitlenD[i - hlit] = code;
-                        }
-                        i++;
-                } else if (code == 16) {	/*repeat previous */
-                        uint16_t replength = 3;	/*read in the 2 bits that indicate repeat length (3-6) */
-                        uint16_t value;	/*set value to the previous code */
-
-                        if ((*bp) >> 3 >= inlength) {
+                if (code == 16) {	/*repeat previous 3-6 times */
+                        /* error, there is no previous code */
+                        if (i == 0) {
                                 SET_ERROR(upng, UPNG_EMALFORMED);
                                 break;
                         }
-                        /*error, bit pointer jumps past memory */
-                        replength += read_bits(bp, in, 2);
-
-                        if ((i - 1) < hlit) {
-                                value = bitlen[i - 1];
-                        } else {
-                                value = bitlenD[i - hlit - 1];
-                        }
-
-                        /*repeat this value in the next lengths */
-                        for (n = 0; n < replength; n++) {
-                                /* i is larger than the amount of codes */
-                                if (i >= hlit + hdist) {
-                                        SET_ERROR(upng, UPNG_EMALFORMED);
-                                        break;
-                                }
-
-                                if (i < hlit) {
-                                        bitlen[i] = value;
-                                } else {
-                                        bitlenD[i - hlit] = value;
-                                }
-                                i++;
-                        }
+                        value = bitlen[i - 1];
+                        replength = 3 + read_bits(upng, 2);
                 } else if (code == 17) {	/*repeat "0" 3-10 times */
-                        uint16_t replength = 3;	/*read in the bits that indicate repeat length */
-                        if ((*bp) >> 3 >= inlength) {
-                                SET_ERROR(upng, UPNG_EMALFORMED);
-                                break;
-                        }
-
-                        /*error, bit pointer jumps past memory */
-                        replength += read_bits(bp, in, 3);
-
-                        /*repeat this value in the next lengths */
-                        for (n = 0; n < replength; n++) {
-                                /* error: i is larger than the amount of codes */
-                                if (i >= hlit + hdist) {
-                                        SET_ERROR(upng, UPNG_EMALFORMED);
-                                        break;
-                                }
-
-                                if (i < hlit) {
-                                        bitlen[i] = 0;
-                                } else {
-                                        bitlenD[i - hlit] = 0;
-                                }
-                                i++;
-                        }
+                        value = 0;
+                        replength = 3 + read_bits(upng, 3);
                 } else if (code == 18) {	/*repeat "0" 11-138 times */
-                        uint16_t replength = 11;	/*read in the bits that indicate repeat length */
-                        /* error, bit pointer jumps past memory */
-                        if ((*bp) >> 3 >= inlength) {
-                                SET_ERROR(upng, UPNG_EMALFORMED);
-                                break;
-                        }
-
-                        replength += read_bits(bp, in, 7);
-
-                        /*repeat this value in the next lengths */
-                        for (n = 0; n < replength; n++) {
-                                /* i is larger than the amount of codes */
-                                if (i >= hlit + hdist) {
-                                        SET_ERROR(upng, UPNG_EMALFORMED);
-                                        break;
-                                }
-                                if (i < hlit)
-                                        bitlen[i] = 0;
-                                else
-                                        bitlenD[i - hlit] = 0;
-                                i++;
-                        }
-                } else {
+                        value = 0;
+                        replength = 11 + read_bits(upng, 7);
+                } else if (code > 15) {
                         /* somehow an unexisting code appeared. This can never happen. */
                         SET_ERROR(upng, UPNG_EMALFORMED);
                         break;
                 }
+
+                /* error: i is larger than the amount of codes */
+                if (i + replength > hlit + hdist) {
+                        SET_ERROR(upng, UPNG_EMALFORMED);
+                        break;
+                }
+
+                memset(bitlen + i, value, replength);
+                i += replength;
         }
 
+        /*the length of the end code 256 must be larger than 0 */
         if (upng->error == UPNG_EOK && bitlen[256] == 0) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
         }
 
-        /*the length of the end code 256 must be larger than 0 */
         /*now we've finally got hlit and hdist, so generate the code trees, and the function is done */
         if (upng->error == UPNG_EOK) {
-                huffman_tree_create_lengths(upng, codetree, bitlen);
+                huffman_table_create(upng, &tables->litlen, bitlen, hlit);
         }
         if (upng->error == UPNG_EOK) {
-                huffman_tree_create_lengths(upng, codetreeD, bitlenD);
+                huffman_table_create(upng, &tables->distance, bitlen + hlit, hdist);
         }
-        //free(codelengthcode);
-        app_free(bitlen);
-        //free(bitlenD);
 }
 
-/*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, uint16_t btype)
+/* copy length bytes from distance back. If that's at least a word back the
+ * source and destination words never overlap, so they can go a word at a time */
+static void inflate_copy(unsigned char* out, unsigned long distance, unsigned long length)
 {
-//Converted to malloc, was overflowing 2k stack on Pebble
-        uint16_t* codetree_buffer = (uint16_t*)app_malloc(sizeof(uint16_t) * DEFLATE_CODE_BUFFER_SIZE);
-        uint16_t codetreeD_buffer[DISTANCE_BUFFER_SIZE];
-if (codetree_buffer == NULL) {
-                SET_ERROR(upng, UPNG_ENOMEM);
-                return;
-}
-        uint16_t done = 0;
-
-        huffman_tree codetree;
-        huffman_tree codetreeD;
-
-
-        if (btype == 1) {
-                /* fixed trees */
-                huffman_tree_init(&codetree, (uint16_t*)FIXED_DEFLATE_CODE_TREE, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-                huffman_tree_init(&codetreeD, (uint16_t*)FIXED_DISTANCE_TREE, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-        } else if (btype == 2) {
-                /* dynamic trees */
-                uint16_t codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
-                huffman_tree codelengthcodetree;
+        const unsigned char* in = out - distance;
 
+        if (distance == 1) {
+                memset(out, *in, length);
+                return;
+        }
 
-                huffman_tree_init(&codetree, codetree_buffer, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
+        if (distance >= 4) {
+                while (length >= 4) {
+                        uint32_t word;
+                        memcpy(&word, in, 4);
+                        memcpy(out, &word, 4);
+                        in += 4;
+                        out += 4;
+                        length -= 4;
+                }
+        }
 
-                
-    huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-                huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
-    
-    get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, in, bp, inlength);
+        while (length--) {
+                *out++ = *in++;
         }
+}
 
+/*inflate a block with dynamic of fixed Huffman tree*/
+static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, unsigned long *outpos, const huffman_table* codetree, const huffman_table* codetreeD)
+{
+        unsigned long pos = *outpos;
 
-        while (done == 0) {
-                uint16_t code = huffman_decode_symbol(upng, in, bp, &codetree, inlength);
+        for (;;) {
+                uint16_t code = huffman_decode_symbol(upng, codetree);
                 if (upng->error != UPNG_EOK) {
-                        return;
+                        break;
                 }
 
-                if (code == 256) {
-                        /* end code */
-                        done = 1;
-                } else if (code <= 255) {
+                if (code <= 255) {
                         /* literal symbol */
-                        if ((*pos) >= outsize) {
+                        if (pos >= outsize) {
                                 SET_ERROR(upng, UPNG_EMALFORMED);
-                                return;
+                                break;
                         }
 
                         /* store output */
-                        out[(*pos)++] = (unsigned char)(code);
-                } else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
+                        out[pos++] = (unsigned char)(code);
+                } else if (code == 256) {
+                        /* end code */
+                        break;
+                } else if (code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
                         /* part 1: get length base */
                         unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
-                        uint16_t codeD, distance, numextrabitsD;
-                        unsigned long start, forward, backward, numextrabits;
+                        unsigned long distance;
+                        uint16_t codeD;
 
                         /* part 2: get extra bits and add the value of that to length */
-                        numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
-
-                        /* error, bit pointer will jump past memory */
-                        if (((*bp) >> 3) >= inlength) {
-                                SET_ERROR(upng, UPNG_EMALFORMED);
-                                return;
-                        }
-                        length += read_bits(bp, in, numextrabits);
+                        length += read_bits(upng, LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX]);
 
                         /*part 3: get distance code */
-                        codeD = huffman_decode_symbol(upng, in, bp, &codetreeD, inlength);
+                        codeD = huffman_decode_symbol(upng, codetreeD);
                         if (upng->error != UPNG_EOK) {
-                                return;
+                                break;
                         }
 
                         /* invalid distance code (30-31 are never used) */
                         if (codeD > 29) {
                                 SET_ERROR(upng, UPNG_EMALFORMED);
-                                return;
+                                break;
                         }
 
-                        distance = DISTANCE_BASE[codeD];
-
                         /*part 4: get extra bits from distance */
-                        numextrabitsD = DISTANCE_EXTRA[codeD];
-
-                        /* error, bit pointer will jump past memory */
-                        if (((*bp) >> 3) >= inlength) {
-                                SET_ERROR(upng, UPNG_EMALFORMED);
-                                return;
-                        }
+                        distance = DISTANCE_BASE[codeD] + read_bits(upng, DISTANCE_EXTRA[codeD]);
 
-                        distance += read_bits(bp, in, numextrabitsD);
+                        /*part 5: fill in all the out[n] values based on the length and dist.
+                         * The output so far is the sliding window, so there's no separate one */
 
-                        /*part 5: fill in all the out[n] values based on the length and dist */
-                        start = (*pos);
-                        backward = start - distance;
-
-                        if ((*pos) + length > outsize) {
+                        /* error: the data ran out, or it points back before the start of the output */
+                        if (upng->error != UPNG_EOK || distance > pos || pos + length > outsize) {
                                 SET_ERROR(upng, UPNG_EMALFORMED);
-                                return;
+                                break;
                         }
 
-                        for (forward = 0; forward < length; forward++) {
-                                out[(*pos)++] = out[backward];
-                                backward++;
-
-                                if (backward >= start) {
-                                        backward = start - distance;
-                                }
-                        }
+                        inflate_copy(out + pos, distance, length);
+                        pos += length;
+                } else {
+                        /* codes 286 and 287 are never used */
+                        SET_ERROR(upng, UPNG_EMALFORMED);
+                        break;
                 }
         }
 
-app_free(codetree_buffer);
-//free(codetreeD_buffer);
-return;
+        *outpos = pos;
 }
-#endif //ifdef TINFL
 
-static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, unsigned long *pos)
 {
-        unsigned long p;
-        uint16_t len, nlen, n;
+        upng_idat* idat = &upng->idat;
+        unsigned long len, nlen;
 
         /* go to first boundary of byte */
-        while (((*bp) & 0x7) != 0) {
-                (*bp)++;
-        }
-        p = (*bp) / 8;		/*byte position */
+        read_bits(upng, idat->bitcount & 7);
 
         /* read len (2 bytes) and nlen (2 bytes) */
-        if (p >= inlength - 4) {
-                SET_ERROR(upng, UPNG_EMALFORMED);
+        len = read_bits(upng, 16);
+        nlen = read_bits(upng, 16);
+
+        if (upng->error != UPNG_EOK) {
                 return;
         }
 
-        len = in[p] + 256 * in[p + 1];
-        p += 2;
-        nlen = in[p] + 256 * in[p + 1];
-        p += 2;
-
         /* check if 16-bit nlen is really the one's complement of len */
         if (len + nlen != 65535) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return;
         }
 
-        if ((*pos) + len >= outsize) {
+        if ((*pos) + len > outsize) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return;
         }
 
-        /* read the literal data: len bytes are now stored in the out buffer */
-        if (p + len > inlength) {
-                SET_ERROR(upng, UPNG_EMALFORMED);
-                return;
+        /* read the literal data: first whatever is left in the bit buffer,
+         * then straight out of the read buffer */
+        while (len > 0 && idat->bitcount >= 8) {
+                out[(*pos)++] = read_bits(upng, 8);
+                len--;
         }
 
-        for (n = 0; n < len; n++) {
-                out[(*pos)++] = in[p++];
-        }
+        while (len > 0) {
+                unsigned long n;
 
-        (*bp) = p * 8;
+                if (idat->pos == idat->len && !read_idat(upng)) {
+                        SET_ERROR(upng, UPNG_EMALFORMED);
+                        return;
+                }
+
+                n = idat->len - idat->pos;
+                if (n > len) {
+                        n = len;
+                }
+
+                memcpy(out + *pos, idat->buffer + idat->pos, n);
+                idat->pos += n;
+                *pos += n;
+                len -= n;
+        }
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
-static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
+static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize)
 {
-        unsigned long bp = 0;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
         unsigned long pos = 0;	/*byte position in the out buffer */
-
         uint16_t done = 0;
 
+        inflate_tables* tables = (inflate_tables*)app_malloc(sizeof(inflate_tables));
+        if (tables == NULL) {
+                SET_ERROR(upng, UPNG_ENOMEM);
+                return upng->error;
+        }
+
+        tables->litlen.fast = tables->litlen_fast;
+        tables->litlen.symbol = tables->litlen_symbol;
+        tables->litlen.fast_bits = LITLEN_FAST_BITS;
+        tables->distance.fast = tables->distance_fast;
+        tables->distance.symbol = tables->distance_symbol;
+        tables->distance.fast_bits = DISTANCE_FAST_BITS;
+        tables->fixed = 0;
+
         while (done == 0) {
                 uint16_t btype;
 
-                /* ensure next bit doesn't point past the end of the buffer */
-                if ((bp >> 3) >= insize) {
-                        SET_ERROR(upng, UPNG_EMALFORMED);
-                        return upng->error;
-                }
-
                 /* read block control bits */
-                done = read_bit(&bp, &in[inpos]);
-                btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
+                done = read_bits(upng, 1);
+                btype = read_bits(upng, 2);
+
+                /* ensure we didn't run past the end of the data */
+                if (upng->error != UPNG_EOK) {
+                        break;
+                }
 
                 /* process control type appropriateyly */
                 if (btype == 3) {
                         SET_ERROR(upng, UPNG_EMALFORMED);
-                        return upng->error;
+                        break;
                 } else if (btype == 0) {
-                        inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+                        inflate_uncompressed(upng, out, outsize, &pos);	/*no compression */
                 } else {
-#ifndef TINFL			
-    inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
-#else
-    tinfl_decompressor inflator;
-    tinfl_init(&inflator);
-    tinfl_decompress(&inflator, &in[inpos], (size_t*)&insize, out, out, (uint8_t*)&outsize, 0);
-                        inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
-#endif
+                        if (btype == 1) {
+                                get_tree_inflate_fixed(upng, tables);
+                        } else {
+                                get_tree_inflate_dynamic(upng, tables);
+                        }
+
+                        if (upng->error == UPNG_EOK) {
+                                inflate_huffman(upng, out, outsize, &pos, &tables->litlen, &tables->distance);	/*compression, btype 01 or 10 */
+                        }
                 }
 
                 /* stop if an error has occured */
                 if (upng->error != UPNG_EOK) {
-                        return upng->error;
+                        break;
                 }
         }
 
+        app_free(tables);
         return upng->error;
 }
 
-static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long outsize, const unsigned char *in, unsigned long insize)
+static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long outsize)
 {
+        unsigned char in[2];
+
         /* we require two bytes for the zlib data header */
-        if (insize < 2) {
-                SET_ERROR(upng, UPNG_EMALFORMED);
+        in[0] = read_bits(upng, 8);
+        in[1] = read_bits(upng, 8);
+        if (upng->error != UPNG_EOK) {
                 return upng->error;
         }
 
@@ -749,8 +714,8 @@ static upng_error uz_inflate(upng_t* upng, unsigned char *out, unsigned long out
                 return upng->error;
         }
 
-        /* create output buffer */
-        uz_inflate_data(upng, out, outsize, in, insize, 2);
+        /* inflate straight into the output buffer */
+        uz_inflate_data(upng, out, outsize);
 
         return upng->error;
 }
@@ -980,20 +945,11 @@ case UPNG_PLT:
         }
 }
 
-static void upng_free_source(upng_t* upng)
-{
-    if (upng->source.owning != 0) {
-        app_free((void*)upng->source.buffer);
-    }
-
-    upng->source.buffer = NULL;
-    upng->source.size = 0;
-    upng->source.owning = 0;
-}
-
 /*read the information from the header and store it in the upng_Info. return value is error*/
 upng_error upng_header(upng_t* upng)
 {
+        unsigned char header[29];
+
         /* if we have an error state, bail now */
         if (upng->error != UPNG_EOK) {
                 return upng->error;
@@ -1011,23 +967,25 @@ upng_error upng_header(upng_t* upng)
                 SET_ERROR(upng, UPNG_ENOTPNG);
                 return upng->error;
         }
+        upng_read(upng, 0, header, 29);
+
         /* check that PNG header matches expected value */
-        if (upng->source.buffer[0] != 137 || upng->source.buffer[1] != 80 || upng->source.buffer[2] != 78 || upng->source.buffer[3] != 71 || upng->source.buffer[4] != 13 || upng->source.buffer[5] != 10 || upng->source.buffer[6] != 26 || upng->source.buffer[7] != 10) {
+        if (header[0] != 137 || header[1] != 80 || header[2] != 78 || header[3] != 71 || header[4] != 13 || header[5] != 10 || header[6] != 26 || header[7] != 10) {
                 SET_ERROR(upng, UPNG_ENOTPNG);
                 return upng->error;
         }
 
         /* check that the first chunk is the IHDR chunk */
-        if (MAKE_DWORD_PTR(upng->source.buffer + 12) != CHUNK_IHDR) {
+        if (MAKE_DWORD_PTR(header + 12) != CHUNK_IHDR) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return upng->error;
         }
 
         /* read the values given in the header */
-        upng->width = MAKE_DWORD_PTR(upng->source.buffer + 16);
-        upng->height = MAKE_DWORD_PTR(upng->source.buffer + 20);
-        upng->color_depth = upng->source.buffer[24];
-        upng->color_type = (upng_color)upng->source.buffer[25];
+        upng->width = MAKE_DWORD_PTR(header + 16);
+        upng->height = MAKE_DWORD_PTR(header + 20);
+        upng->color_depth = header[24];
+        upng->color_type = (upng_color)header[25];
 
         /* determine our color format */
         upng->format = determine_format(upng);
@@ -1037,19 +995,19 @@ upng_error upng_header(upng_t* upng)
         }
 
         /* check that the compression method (byte 27) is 0 (only allowed value in spec) */
-        if (upng->source.buffer[26] != 0) {
+        if (header[26] != 0) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return upng->error;
         }
 
         /* check that the compression method (byte 27) is 0 (only allowed value in spec) */
-        if (upng->source.buffer[27] != 0) {
+        if (header[27] != 0) {
                 SET_ERROR(upng, UPNG_EMALFORMED);
                 return upng->error;
         }
 
         /* check that the compression method (byte 27) is 0 (spec allows 1, but uPNG does not support it) */
-        if (upng->source.buffer[28] != 0) {
+        if (header[28] != 0) {
                 SET_ERROR(upng, UPNG_EUNINTERLACED);
                 return upng->error;
         }
@@ -1061,10 +1019,10 @@ upng_error upng_header(upng_t* upng)
 /*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
 upng_error upng_decode(upng_t* upng)
 {
-        const unsigned char *chunk;
-        unsigned char* compressed;
+        unsigned long chunk;
+        unsigned char header[8];
         unsigned char* inflated;
-        unsigned long compressed_size = 0, compressed_index = 0;
+        unsigned long compressed_size = 0;
         unsigned long inflated_size;
         upng_error error;
 
@@ -1092,113 +1050,132 @@ upng_error upng_decode(upng_t* upng)
         }
 
         /* first byte of the first chunk after the header */
-        chunk = upng->source.buffer + 33;
+        chunk = 33;
 
         /* scan through the chunks, finding the size of all IDAT chunks, and also
-        * verify general well-formed-ness */
-        while (chunk < upng->source.buffer + upng->source.size) {
+        * verify general well-formed-ness. Only the small chunks are read in here;
+        * the image data is read straight out of the source as it is inflated */
+        while (chunk < upng->source.size) {
                 unsigned long length;
-                const unsigned char *data = chunk + 8;	/*the data in the chunk */
+                unsigned long data = chunk + 8;	/*the data in the chunk */
 
                 /* make sure chunk header is not larger than the total compressed */
-                if ((unsigned long)(chunk - upng->source.buffer + 12) > upng->source.size) {
+                if (chunk + 12 > upng->source.size) {
                         SET_ERROR(upng, UPNG_EMALFORMED);
                         return upng->error;
                 }
+                upng_read(upng, chunk, header, 8);
 
                 /* get length; sanity check it */
-                length = upng_chunk_length(chunk);
+                length = upng_chunk_length(header);
                 if (length > INT_MAX) {
                         SET_ERROR(upng, UPNG_EMALFORMED);
                         return upng->error;
                 }
 
                 /* make sure chunk header+paylaod is not larger than the total compressed */
-                if ((unsigned long)(chunk - upng->source.buffer + length + 12) > upng->source.size) {
+                if (chunk + length + 12 > upng->source.size) {
                         SET_ERROR(upng, UPNG_EMALFORMED);
                         return upng->error;
                 }
 
                 /* parse chunks */
-                if (upng_chunk_type(chunk) == CHUNK_IDAT) {
+                if (upng_chunk_type(header) == CHUNK_IDAT) {
                         compressed_size += length;
-                } else if (upng_chunk_type(chunk) == CHUNK_IEND) {
+                } else if (upng_chunk_type(header) == CHUNK_IEND) {
                         break;
-                } else if (upng_chunk_type(chunk) == CHUNK_OFFS) {
-                    upng->x_offset = MAKE_DWORD_PTR(data);
-                    upng->y_offset = MAKE_DWORD_PTR(data + 4);
-                } else if (upng_chunk_type(chunk) == CHUNK_PLTE) {
+                } else if (upng_chunk_type(header) == CHUNK_OFFS) {
+                    unsigned char offs[8];
+                    if (length >= 8) {
+                        upng_read(upng, data, offs, 8);
+                        upng->x_offset = MAKE_DWORD_PTR(offs);
+                        upng->y_offset = MAKE_DWORD_PTR(offs + 4);
+                    }
+                } else if (upng_chunk_type(header) == CHUNK_PLTE) {
                     upng->palette_entries = length / 3; //3 bytes per color entry
                     if(upng->palette) {
                         app_free(upng->palette);
                         upng->palette = NULL;
                     }
                     upng->palette = app_malloc(length);
-                    memcpy(upng->palette, data, length);
-                } else if (upng_chunk_type(chunk) == CHUNK_tRNS) {
+                    if (upng->palette == NULL) {
+                        SET_ERROR(upng, UPNG_ENOMEM);
+                        return upng->error;
+                    }
+                    upng_read(upng, data, (unsigned char*)upng->palette, length);
+                } else if (upng_chunk_type(header) == CHUNK_tRNS) {
                     upng->alpha_entries = length;
                     if(upng->alpha) {
                         app_free(upng->alpha);
                         upng->alpha = NULL;
                     }
                     upng->alpha = app_malloc(length);
-                    memcpy(upng->alpha, data, length);
-                } else if (upng_chunk_type(chunk) == CHUNK_TEXT) {
-                    int keyword_length = (strlen((const char*)data) + 1);
+                    if (upng->alpha == NULL) {
+                        SET_ERROR(upng, UPNG_ENOMEM);
+                        return upng->error;
+                    }
+                    upng_read(upng, data, upng->alpha, length);
+                } else if (upng_chunk_type(header) == CHUNK_TEXT && upng->text_count < 10) {
+                    // Read the whole chunk in, null terminated, and split it up
+                    char *text = app_malloc(length + 1);
+                    if (text == NULL) {
+                        SET_ERROR(upng, UPNG_ENOMEM);
+                        return upng->error;
+                    }
+                    upng_read(upng, data, (unsigned char*)text, length);
+                    text[length] = '\0';
+
+                    int keyword_length = (strlen(text) + 1);
                     // Copy keyword located at start of data (includes null terminator)
                     upng->text[upng->text_count].keyword = app_malloc(keyword_length);
-                    strcpy(upng->text[upng->text_count].keyword,(const char*)data);
 
-                    int text_length = length - keyword_length + 1;
+                    int text_length = keyword_length > (int)length ? 1 : length - keyword_length + 1;
                     // Copy the text from data, starts after the null after keyword
                     upng->text[upng->text_count].text = app_malloc(text_length);
-                    memcpy((char*)upng->text[upng->text_count].text,(const char*)(data + keyword_length), text_length - 1);//no null terminator
+
+                    if (upng->text[upng->text_count].keyword == NULL || upng->text[upng->text_count].text == NULL) {
+                        app_free(upng->text[upng->text_count].keyword);
+                        app_free(upng->text[upng->text_count].text);
+                        app_free(text);
+                        SET_ERROR(upng, UPNG_ENOMEM);
+                        return upng->error;
+                    }
+                    strcpy(upng->text[upng->text_count].keyword, text);
+                    memcpy(upng->text[upng->text_count].text, text + keyword_length, text_length - 1);//no null terminator
                     //add missing null terminator
                     upng->text[upng->text_count].text[text_length - 1] = '\0';
-                    
+                    app_free(text);
+
                     upng->text_count++;
-                } else if (upng_chunk_critical(chunk)) {
+                } else if (upng_chunk_critical(header)) {
                         SET_ERROR(upng, UPNG_EUNSUPPORTED);
                         return upng->error;
                 }
 
-                chunk += upng_chunk_length(chunk) + 12;
+                chunk += length + 12;
         }
 
-        /* allocate enough space for the (compressed and filtered) image data */
-        compressed = (unsigned char*)app_malloc(compressed_size);
-        if (compressed == NULL) {
-                SET_ERROR(upng, UPNG_ENOMEM);
+        if (compressed_size == 0 || upng->width == 0 || upng->height == 0) {
+                SET_ERROR(upng, UPNG_EMALFORMED);
                 return upng->error;
         }
 
-        /* scan through the chunks again, this time copying the values into
-        * our compressed buffer.  there's no reason to validate anything a second time. */
-        chunk = upng->source.buffer + 33;
-        while (chunk < upng->source.buffer + upng->source.size) {
-                unsigned long length;
-                const unsigned char *data;	/*the data in the chunk */
-
-                length = upng_chunk_length(chunk);
-                data = chunk + 8;
-
-                /* parse chunks */
-                if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-                        memcpy(compressed + compressed_index, data, length);
-                        compressed_index += length;
-                } else if (upng_chunk_type(chunk) == CHUNK_IEND) {
-                        break;
-                }
-
-                chunk += upng_chunk_length(chunk) + 12;
-        }
-
-// Pebble has only so much free ram, so free source buffer now that we are
-// done with it.
-app_free(upng->source.buffer);
-upng->source.buffer = NULL;
-
-        /* allocate space to store inflated (but still filtered) data */
+        /* the inflater pulls the image data out of the IDAT chunks itself, so
+         * there's no need to gather it all up into one buffer first */
+        upng->idat.next_chunk = 33;
+        upng->idat.offset = 0;
+        upng->idat.left = 0;
+        upng->idat.pos = 0;
+        upng->idat.len = 0;
+        upng->idat.bitbuf = 0;
+        upng->idat.bitcount = 0;
+
+        /* allocate space to store inflated (but still filtered) data.
+         * This is the peak: the image plus a filter byte a row, the code
+         * tables (about 2.3k) and the upng_t. Unfiltering a row at a time
+         * wouldn't lower it; deflate can copy from up to 32k back, so the
+         * filtered rows have to be kept anyway, and the image itself is
+         * the result. Unfiltering in place shares the one buffer */
         //inflated_size = ((upng->width * (upng->height * upng_get_bpp(upng) + 7)) / 8) + upng->height;
 int width_aligned_bytes = (upng->width * upng_get_bpp(upng) + 7) / 8;
         inflated_size = (width_aligned_bytes * upng->height) + upng->height; //pad byte
@@ -1206,41 +1183,24 @@ int width_aligned_bytes = (upng->width * upng_get_bpp(upng) + 7) / 8;
         //inflated = (void*)0x1000a0d8;//(unsigned char*)app_malloc(inflated_size);
         inflated = (unsigned char*)app_malloc(inflated_size);
         if (inflated == NULL) {
-                app_free(compressed);
                 SET_ERROR(upng, UPNG_ENOMEM);
                 return upng->error;
         }
 
         /* decompress image data */
-        error = uz_inflate(upng, inflated, inflated_size, compressed, compressed_size);
+        error = uz_inflate(upng, inflated, inflated_size);
         if (error != UPNG_EOK) {
                 app_free(inflated);
-                app_free(compressed);
                 //free(inflated);
                 return upng->error;
         }
 
-        /* free the compressed compressed data */
-        app_free(compressed);
-
         /* allocate final image buffer */
         //upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
         upng->size = width_aligned_bytes * upng->height;
 
-/*
-        upng->buffer = (unsigned char*)app_malloc(upng->size);
-        if (upng->buffer == NULL) {
-    printf("allocating %ld in upng", upng->size);
-                app_free(inflated);
-                upng->size = 0;
-                SET_ERROR(upng, UPNG_ENOMEM);
-                return upng->error;
-        }
-*/
-
-        /* unfilter scanlines */
+        /* unfilter scanlines in place; the inflated buffer becomes the image */
         post_process_scanlines(upng, inflated, inflated, upng);
-        //app_free(inflated);
 upng->buffer = inflated;
 
         if (upng->error != UPNG_EOK) {
@@ -1251,9 +1211,6 @@ upng->buffer = inflated;
                 upng->state = UPNG_DECODED;
         }
 
-        /* we are done with our input buffer; free it if we own it */
-        upng_free_source(upng);
-
         return upng->error;
 }
 
@@ -1291,13 +1248,19 @@ static upng_t* upng_new(void)
 
         upng->text_count = 0;
 
-        upng->source.buffer = NULL;
+        upng->source.read = NULL;
+        upng->source.context = NULL;
         upng->source.size = 0;
-        upng->source.owning = 0;
 
         return upng;
 }
 
+/* the source is a buffer in memory (or mapped flash) which belongs to the caller */
+static void upng_read_bytes(void* context, unsigned long offset, unsigned char* buffer, unsigned long length)
+{
+        memcpy(buffer, (const unsigned char*)context + offset, length);
+}
+
 upng_t* upng_new_from_bytes(unsigned char* raw_buffer, unsigned long size, uint8_t **out_buffer)
 {
         upng_t* upng = upng_new();
@@ -1305,13 +1268,26 @@ upng_t* upng_new_from_bytes(unsigned char* raw_buffer, unsigned long size, uint8
                 return NULL;
         }
 
-        upng->source.buffer = raw_buffer;
+        upng->source.read = upng_read_bytes;
+        upng->source.context = raw_buffer;
         upng->source.size = size;
-        upng->source.owning = 0;
 //         *upng->buffer = out_buffer;
         return upng;
 }
 
+upng_t* upng_new_from_stream(upng_read_func read, void* context, unsigned long size)
+{
+        upng_t* upng = upng_new();
+        if (upng == NULL) {
+                return NULL;
+        }
+
+        upng->source.read = read;
+        upng->source.context = context;
+        upng->source.size = size;
+        return upng;
+}
+
 #if 0
 upng_t* upng_new_from_file(const char *filename)
 {
@@ -1370,9 +1346,6 @@ void upng_free(upng_t* upng)
         app_free(upng->alpha);
     }
 
-    /* deallocate source buffer, if necessary */
-    upng_free_source(upng);
-    
     if (upng->text_count) {
         for(unsigned int i = 0; i < upng->text_count; i++){
         app_free(upng->text[i].keyword);
@@ -67,7 +67,12 @@ typedef struct __attribute__((__packed__)) rgb {
   unsigned char b;
 } rgb;
 
+/* reads length bytes of the PNG file from offset. upng only ever asks for
+ * bytes that are inside the size it was given */
+typedef void (*upng_read_func)(void* context, unsigned long offset, unsigned char* buffer, unsigned long length);
+
 upng_t*		upng_new_from_bytes	(unsigned char* source_buffer, unsigned long source_size, unsigned char**buffer); //, unsigned char*output_buffer, unsigned long output_size);
+upng_t*		upng_new_from_stream	(upng_read_func read, void* context, unsigned long size);
 //upng_t*		upng_new_from_file	(const char* path);
 void		upng_free			(upng_t* upng);
 
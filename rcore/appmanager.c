@@ -13,6 +13,7 @@
 #include "systemapp.h"
 #include "test.h"
 #include "notification.h"
+#include "benchmark.h"
 #include "api_func_symbols.h"
 
 /*
@@ -25,7 +26,7 @@
  */
 
 extern void appHeapInit(size_t, uint8_t*);
-extern  GFont *fonts_load_custom_font(ResHandle*, struct file *file);
+extern GFont fonts_load_custom_font(ResHandle*, const struct file *file);
 
 static void _appmanager_flash_load_app_manifest();
 static App *_appmanager_create_app(char *name, uint8_t type, void *entry_point, bool is_internal,
@@ -77,6 +78,7 @@ void appmanager_init(void)
     _appmanager_add_to_manifest(_appmanager_create_app("NiVZ", APP_TYPE_FACE, nivz_main, true, &empty, &empty));
     _appmanager_add_to_manifest(_appmanager_create_app("Settings", APP_TYPE_SYSTEM, test_main, true, &empty, &empty));
     _appmanager_add_to_manifest(_appmanager_create_app("Notification", APP_TYPE_SYSTEM, notif_main, true, &empty, &empty));
+    _appmanager_add_to_manifest(_appmanager_create_app("Benchmark", APP_TYPE_SYSTEM, benchmark_main, true, &empty, &empty));
 
     _app_task_handle = NULL;
     
@@ -242,6 +244,10 @@ void _appmanager_flash_load_app_manifest(void)
                                                                &res_file));
         }
     }
+    
+    struct fs_index_stats stats;
+    fs_get_index_stats(&stats);
+    KERN_LOG("app", APP_LOG_LEVEL_DEBUG, "appdb: file lookups: %d hits, %d misses, %d flash scans", stats.hits, stats.misses, stats.fallbacks);
 }
 
 /* App manifest is a linked list. Just slot it in */
@@ -325,47 +331,349 @@ void appmanager_post_button_message(ButtonMessage *bmessage)
     xQueueSendToBack(_app_message_queue, &am, (TickType_t)10);
 }
 
+/*
+ * Drawing. However many times the screen gets marked dirty, only one draw
+ * is ever pending. The app thread renders it at the top of its loop, once
+ * the display has finished with the last frame, and no more than
+ * _frame_rate times a second.
+ */
+#define APP_DEFAULT_FRAME_RATE 30
+
+static volatile bool _draw_pending; /* the screen wants drawing */
+static volatile bool _draw_waiting; /* held up until the display is done */
+static uint8_t _frame_rate = APP_DEFAULT_FRAME_RATE;
+static TickType_t _last_frame;
+static struct app_frame_stats _frame_stats;
+
 void appmanager_post_draw_message(void)
 {
     AppMessage am = (AppMessage) {
         .message_type_id = APP_DRAW
     };
-    xQueueSendToBack(_app_message_queue, &am, (TickType_t)10);
+    bool pending;
+    
+    taskENTER_CRITICAL();
+    pending = _draw_pending;
+    _draw_pending = true;
+    _frame_stats.requests++;
+    taskEXIT_CRITICAL();
+    
+    if (!pending)
+        xQueueSendToBack(_app_message_queue, &am, (TickType_t)10);
 }
 
-/* Always adds to the running app's queue.  Note that this is only
- * reasonable to do from the app thread: otherwise, you can race with the
- * check for the timer head.  */
-void appmanager_timer_add(CoreTimer *timer)
+/*
+ * Called from the display thread once it can take another frame.
+ * Wakes the app up if it was holding a frame back for it
+ */
+void appmanager_display_done(void)
 {
-    CoreTimer **tnext = &_running_app->timer_head;
+    AppMessage am = (AppMessage) {
+        .message_type_id = APP_DRAW
+    };
     
-    /* until either the next pointer is null (i.e., we have hit the end of
-     * the list), or the thing that the next pointer points to is further in
-     * the future than we are (i.e., we want to insert before the thing that
-     * the next pointer points to)
-     */
-    while (*tnext && (timer->when > (*tnext)->when)) {
-        tnext = &((*tnext)->next);
+    if (!_draw_waiting)
+        return;
+    
+    _draw_waiting = false;
+    xQueueSendToBack(_app_message_queue, &am, 0);
+}
+
+/*
+ * Cap how often the app redraws. 0 draws as fast as the display goes
+ */
+void appmanager_set_frame_rate(uint8_t fps)
+{
+    _frame_rate = fps;
+}
+
+static void _appmanager_frame_reset(void)
+{
+    _draw_pending = false;
+    _draw_waiting = false;
+    _last_frame = xTaskGetTickCount() - configTICK_RATE_HZ;
+}
+
+/*
+ * Draw the pending frame if we are allowed to yet.
+ * Returns how long until we can, or portMAX_DELAY if there is nothing to
+ * draw or the display will wake us when it is ready
+ */
+static TickType_t _appmanager_frame(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t due;
+    uint32_t start, render;
+    
+    if (!_draw_pending)
+        return portMAX_DELAY;
+    
+    due = _last_frame + (_frame_rate ? configTICK_RATE_HZ / _frame_rate : 0);
+    if (TICK_BEFORE(now, due)) {
+        _frame_stats.rate_waits++;
+        return due - now;
+    }
+    
+    /* flag first, so the display can't finish between us looking and
+     * flagging, and never wake us */
+    _draw_waiting = true;
+    if (display_is_busy()) {
+        _frame_stats.display_waits++;
+        return portMAX_DELAY;
     }
+    _draw_waiting = false;
     
-    timer->next = *tnext;
-    *tnext = timer;
+    /* anything marked dirty while we draw goes in the next frame */
+    _draw_pending = false;
+    _last_frame = now;
+    /* a frame is a fraction of a tick, so count cycles */
+    start = rcore_cycles();
+    window_draw();
+    
+    render = rcore_cycles_to_us(rcore_cycles() - start);
+    _frame_stats.frames++;
+    _frame_stats.render_us += render;
+    if (render > _frame_stats.render_max_us)
+        _frame_stats.render_max_us = render;
+    
+    return portMAX_DELAY;
 }
 
-void appmanager_timer_remove(CoreTimer *timer)
+void appmanager_get_frame_stats(struct app_frame_stats *stats)
 {
-    CoreTimer **tnext = &_running_app->timer_head;
+    taskENTER_CRITICAL();
+    *stats = _frame_stats;
+    taskEXIT_CRITICAL();
+}
+
+void appmanager_dump_frame_stats(void)
+{
+    struct app_frame_stats stats;
+    
+    appmanager_get_frame_stats(&stats);
+    
+    KERN_LOG("app", APP_LOG_LEVEL_INFO, "frames: %d drawn for %d requests, held back %d times for the display, %d for the frame rate",
+             stats.frames, stats.requests, stats.display_waits, stats.rate_waits);
+    KERN_LOG("app", APP_LOG_LEVEL_INFO, "frames: %d us average render, %d us worst",
+             stats.frames ? (int)(stats.render_us / stats.frames) : 0, (int)stats.render_max_us);
+}
+
+/*
+ * App timers live in a hierarchical timer wheel. Level 0 has a slot per
+ * tick for the next 32 ticks, level 1 a slot per 32 ticks for the next
+ * 1024 and level 2 a slot per 1024 ticks for the next 32768 (a couple of
+ * minutes). Anything further out than that waits on the far list.
+ * As time moves on, the slots of the upper levels get cascaded down into
+ * the lower ones. Adding and removing a timer is O(1) however many there are.
+ *
+ * Only the running app has timers, so there is just the one wheel. It is
+ * only touched from the app thread.
+ */
+#define TIMER_WHEEL_BITS   5
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK   (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 3
+
+struct timer_wheel {
+    TickType_t now; /* the next tick to run. Everything before it has fired */
+    uint32_t pending[TIMER_WHEEL_LEVELS]; /* slots that may have timers in */
+    CoreTimer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    CoreTimer *far;
+    CoreTimer *expired; /* added when they were already due */
+};
+
+static struct timer_wheel _timers;
+
+static void _timer_wheel_init(TickType_t now)
+{
+    memset(&_timers, 0, sizeof(_timers));
+    _timers.now = now;
+}
+
+static void _timer_link(CoreTimer **head, CoreTimer *timer)
+{
+    timer->next = *head;
+    if (timer->next)
+        timer->next->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+}
+
+static void _timer_unlink(CoreTimer *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* Move a whole list onto a head of our own, so anything put back
+ * where it came from while we walk it doesn't get seen twice */
+static void _timer_take_list(CoreTimer **from, CoreTimer **to)
+{
+    *to = *from;
+    *from = NULL;
+    if (*to)
+        (*to)->pprev = to;
+}
+
+static void _timer_wheel_insert(CoreTimer *timer)
+{
+    TickType_t when = timer->when;
+    TickType_t delta = when - _timers.now;
     
-    while (*tnext) {
-        if (*tnext == timer) {
-            *tnext = timer->next;
+    /* it's a tick we have already run, so it goes out next time round */
+    if (TICK_BEFORE(when, _timers.now)) {
+        _timer_link(&_timers.expired, timer);
+        return;
+    }
+    
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        if (delta < (1UL << (TIMER_WHEEL_BITS * (level + 1)))) {
+            uint8_t slot = (when >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+            
+            _timer_link(&_timers.slots[level][slot], timer);
+            _timers.pending[level] |= 1UL << slot;
             return;
         }
-        tnext = &(*tnext)->next;
     }
     
-    assert(!"appmanager_timer_remove did not find timer in list");
+    _timer_link(&_timers.far, timer);
+}
+
+static void _timer_wheel_cascade(CoreTimer **head)
+{
+    CoreTimer *list, *timer;
+    
+    _timer_take_list(head, &list);
+    while ((timer = list)) {
+        _timer_unlink(timer);
+        _timer_wheel_insert(timer);
+    }
+}
+
+/* We are on a level 0 boundary. Bring down whatever is in the next
+ * slot up, and on up the levels for as long as they wrap too */
+static void _timer_wheel_cascade_at(TickType_t tick)
+{
+    for (uint8_t level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        uint8_t slot = (tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+        
+        _timers.pending[level] &= ~(1UL << slot);
+        _timer_wheel_cascade(&_timers.slots[level][slot]);
+        if (slot)
+            return;
+    }
+    
+    _timer_wheel_cascade(&_timers.far);
+}
+
+/*
+ * Fire every timer due up to and including tick 'to'. Stretches with
+ * nothing in level 0 get skipped a slot boundary at a time, so catching up
+ * after a long sleep doesn't mean walking every tick.
+ */
+static void _timer_wheel_fire(CoreTimer **head)
+{
+    CoreTimer *list, *timer;
+    
+    /* Dequeue first, then invoke. The callback is free to add itself
+     * back, or cancel any other timer, including ones due now */
+    _timer_take_list(head, &list);
+    while ((timer = list)) {
+        _timer_unlink(timer);
+        timer->callback(timer);
+    }
+}
+
+static void _timer_wheel_run(TickType_t to)
+{
+    _timer_wheel_fire(&_timers.expired);
+    
+    while (!TICK_AFTER(_timers.now, to)) {
+        TickType_t tick = _timers.now;
+        uint8_t slot = tick & TIMER_WHEEL_MASK;
+        
+        if (slot == 0)
+            _timer_wheel_cascade_at(tick);
+        
+        if (!_timers.pending[0]) {
+            TickType_t next = (tick | TIMER_WHEEL_MASK) + 1;
+            
+            _timers.now = TICK_AFTER(next, to) ? to + 1 : next;
+            continue;
+        }
+        
+        _timers.now = tick + 1;
+        _timers.pending[0] &= ~(1UL << slot);
+        _timer_wheel_fire(&_timers.slots[0][slot]);
+    }
+}
+
+static void _timer_wheel_earliest(CoreTimer *timer, TickType_t *when, bool *found)
+{
+    for (; timer; timer = timer->next) {
+        if (!*found || TICK_BEFORE(timer->when, *when)) {
+            *when = timer->when;
+            *found = true;
+        }
+    }
+}
+
+/*
+ * Find when the next timer is due. Only the first busy slot of each level
+ * needs looking at, and the one we are in, as it can hold timers from a
+ * whole turn of the wheel ahead
+ */
+static bool _timer_wheel_next(TickType_t *when)
+{
+    bool found = false;
+    
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint8_t start = (_timers.now >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+        uint32_t pending = _timers.pending[level] & ~(1UL << start);
+        
+        _timer_wheel_earliest(_timers.slots[level][start], when, &found);
+        
+        /* rotate so bit 0 is the slot we are in */
+        if (start)
+            pending = (pending >> start) | (pending << (TIMER_WHEEL_SLOTS - start));
+        
+        while (pending) {
+            uint8_t slot = (start + __builtin_ctz(pending)) & TIMER_WHEEL_MASK;
+            
+            if (_timers.slots[level][slot]) {
+                _timer_wheel_earliest(_timers.slots[level][slot], when, &found);
+                break;
+            }
+            /* emptied by timers being removed */
+            _timers.pending[level] &= ~(1UL << slot);
+            pending &= pending - 1;
+        }
+    }
+    
+    _timer_wheel_earliest(_timers.far, when, &found);
+    _timer_wheel_earliest(_timers.expired, when, &found);
+    
+    return found;
+}
+
+/* Always adds to the running app's wheel.  Note that this is only
+ * reasonable to do from the app thread. */
+void appmanager_timer_add(CoreTimer *timer)
+{
+    _timer_wheel_insert(timer);
+}
+
+void appmanager_timer_remove(CoreTimer *timer)
+{
+    if (!timer->pprev) {
+        assert(!"appmanager_timer_remove did not find timer in list");
+        return;
+    }
+    
+    _timer_unlink(timer);
 }
 
 /*
@@ -404,24 +712,34 @@ void app_event_loop(void)
 //         window_single_click_subscribe(BUTTON_ID_BACK, back_long_click_handler);
     
     // redraw
-    window_draw();
+    window_dirty(true);
     
     // block forever
     for ( ;; )
     {
         /* Is there something queued up to do?  If so, we have the potential to do it. */
-        TickType_t next_timer;
+        TickType_t next_timer, next_frame, when;
         
-        if (_running_app->timer_head) {
+        /* Fire everything that has come due in one go, rather than
+         * waking up once for each of them */
+        _timer_wheel_run(xTaskGetTickCount());
+        
+        /* then draw whatever they (and everyone else) changed */
+        next_frame = _appmanager_frame();
+        
+        if (_timer_wheel_next(&when)) {
             TickType_t curtime = xTaskGetTickCount();
-            if (curtime > _running_app->timer_head->when)
-                next_timer = 0;
+            if (TICK_AFTER(when, curtime))
+                next_timer = when - curtime;
             else
-                next_timer = _running_app->timer_head->when - curtime;
+                next_timer = 0;
         } else {
             next_timer = portMAX_DELAY; /* Just block forever. */
         }
         
+        if (next_frame < next_timer)
+            next_timer = next_frame;
+        
         // we are inside the apps main loop event handler now
         if (xQueueReceive(_app_message_queue, &data, next_timer))
         {
@@ -450,21 +768,10 @@ void app_event_loop(void)
             }
             else if (data.message_type_id == APP_DRAW)
             {
-                window_draw();
+                /* the frame gets drawn at the top of the loop */
             }
-        } else {
-            /* We woke up because we hit a timer expiry.  Dequeue first,
-             * then invoke -- otherwise someone else could insert themselves
-             * at the head, and we would wrongfully dequeue them!  */
-            CoreTimer *timer = _running_app->timer_head;
-            assert(timer);
-            
-            KERN_LOG("app", APP_LOG_LEVEL_INFO, "woke up for a timer");
-
-            _running_app->timer_head = timer->next;
-            
-            timer->callback(timer);
         }
+        /* If we timed out instead, the timers go off at the top of the loop */
     }
     KERN_LOG("app", APP_LOG_LEVEL_INFO, "App Signalled shutdown...");
     // the app itself will quit now
@@ -517,6 +824,15 @@ static void _appmanager_app_thread(void *parms)
         if (app == NULL)
             continue;
 
+#ifdef REBBLE_PLATFORM_SIM
+        // flash apps are Thumb PIC binaries; the host can't execute them
+        if (!app->is_internal)
+        {
+            KERN_LOG("app", APP_LOG_LEVEL_ERROR, "Can't run flash app %s in the simulator", app_name);
+            continue;
+        }
+#endif
+
         // it's the one
         _running_app = app;
         
@@ -524,7 +840,9 @@ static void _appmanager_app_thread(void *parms)
             vTaskDelete(_app_task_handle);
             _app_task_handle = NULL;
         }
-        _running_app->timer_head = NULL;
+        _timer_wheel_init(xTaskGetTickCount());
+        animation_scheduler_reset();
+        _appmanager_frame_reset();
         
         // If the app is running off RAM (i.e it's a PIC loaded app...) and not system, we need to patch it
         if (!app->is_internal)
@@ -608,9 +926,9 @@ static void _appmanager_app_thread(void *parms)
             fs_read(&fd, &header, sizeof(ApplicationHeader));
         
             // load the app from flash
-            // and any reloc entries too.
+            // and any reloc entries too. The display can carry on while it copies
             fs_seek(&fd, 0, FS_SEEK_SET);
-            fs_read(&fd, app_stack_heap.byte_buf, header.app_size + (header.reloc_entries_count * 4));
+            fs_read_wait(&fd, app_stack_heap.byte_buf, header.app_size + (header.reloc_entries_count * 4));
             
             
             // re-allocate the GOT for -fPIC
@@ -649,10 +967,10 @@ static void _appmanager_app_thread(void *parms)
             total_app_size = header.virtual_size;
             
             // load the address of our lookup table into the special register in the app. hopefully in a platformish independant way
-            app_stack_heap.byte_buf[header.sym_table_addr]     =     (uint32_t)(sym)         & 0xFF;
-            app_stack_heap.byte_buf[header.sym_table_addr + 1] =     ((uint32_t)(sym) >> 8)  & 0xFF;
-            app_stack_heap.byte_buf[header.sym_table_addr + 2] =     ((uint32_t)(sym) >> 16) & 0xFF;
-            app_stack_heap.byte_buf[header.sym_table_addr + 3] =     ((uint32_t)(sym) >> 24) & 0xFF;
+            app_stack_heap.byte_buf[header.sym_table_addr]     =     (uint32_t)(uintptr_t)(sym)         & 0xFF;
+            app_stack_heap.byte_buf[header.sym_table_addr + 1] =     ((uint32_t)(uintptr_t)(sym) >> 8)  & 0xFF;
+            app_stack_heap.byte_buf[header.sym_table_addr + 2] =     ((uint32_t)(uintptr_t)(sym) >> 16) & 0xFF;
+            app_stack_heap.byte_buf[header.sym_table_addr + 3] =     ((uint32_t)(uintptr_t)(sym) >> 24) & 0xFF;
             
             KERN_LOG("app", APP_LOG_LEVEL_DEBUG, "App signature:");
             KERN_LOG("app", APP_LOG_LEVEL_DEBUG, "H:    %s", header.header);
@@ -692,6 +1010,13 @@ static void _appmanager_app_thread(void *parms)
                 stack_entry, 
                 stack_size);
         
+        /* fonts and text from the last app's heap are gone, so are their
+         * glyphs and layouts */
+        n_graphics_font_cache_flush(NULL);
+        n_graphics_text_layout_cache_flush(NULL);
+        fonts_cache_flush();
+        resource_cache_flush();
+        
         /* heap is all uint8_t */
         appHeapInit(heap_size, (void *)heap_entry);
 
@@ -718,7 +1043,7 @@ static void _appmanager_app_thread(void *parms)
             else
             {
                 if (_running_app->shutdown_at_tick > 0 &&
-                    xTaskGetTickCount() >= _running_app->shutdown_at_tick)
+                    !TICK_BEFORE(xTaskGetTickCount(), _running_app->shutdown_at_tick))
                 {
                     KERN_LOG("app", APP_LOG_LEVEL_ERROR, "!! Hard terminating app");
                     /* go and process the queue */
@@ -850,6 +1175,11 @@ void resource_load(ResHandle resource_handle, uint8_t *buffer, uint32_t size)
     return resource_load_app(resource_handle, buffer, &_running_app->resource_file);
 }
 
+uint8_t *resource_acquire(ResHandle resource_handle)
+{
+    return resource_acquire_res_app(resource_handle, &_running_app->resource_file);
+}
+
 // app proxies by pointer
 ResHandle *resource_get_handle_proxy(uint16_t resource_id)
 {
@@ -863,8 +1193,8 @@ ResHandle *resource_get_handle_proxy(uint16_t resource_id)
     return x;
 }
 
-GFont *fonts_load_custom_font_proxy(ResHandle *handle)
+GFont fonts_load_custom_font_proxy(ResHandle *handle)
 {
-    return (GFont *)fonts_load_custom_font(handle, &_running_app->resource_file);
+    return fonts_load_custom_font(handle, &_running_app->resource_file);
 }
 
@@ -22,8 +22,23 @@ typedef struct CoreTimer
     TickType_t when; /* ticks when this should fire, in ticks since boot */
     void (*callback)(struct CoreTimer *); /* always called back on the app thread */
     struct CoreTimer *next;
+    struct CoreTimer **pprev; /* whatever points at us, NULL when not queued */
 } CoreTimer;
 
+/* Tick comparisons that survive the tick count wrapping.
+ * Good for anything less than 2^31 ticks apart */
+#define TICK_BEFORE(a, b) ((int32_t)((TickType_t)(a) - (TickType_t)(b)) < 0)
+#define TICK_AFTER(a, b)  TICK_BEFORE(b, a)
+
+struct app_frame_stats {
+    uint32_t requests;      /* times a draw was asked for */
+    uint32_t frames;        /* frames actually rendered */
+    uint32_t display_waits; /* times a frame was held back for the display */
+    uint32_t rate_waits;    /* times a frame was held back for the frame rate */
+    uint64_t render_us;     /* total time spent rendering */
+    uint32_t render_max_us; /* the slowest frame */
+};
+
 typedef struct AppMessage
 {
     uint8_t message_type_id;
@@ -95,7 +110,6 @@ typedef struct App {
     char *name;
     ApplicationHeader *header;
     AppMainHandler main; // A shortcut to main
-    struct CoreTimer *timer_head;
     struct App *next;
 } App;
 
@@ -122,6 +136,10 @@ void appmanager_timer_add(CoreTimer *timer);
 void appmanager_timer_remove(CoreTimer *timer);
 void appmanager_post_button_message(ButtonMessage *bmessage);
 void appmanager_post_draw_message(void);
+void appmanager_display_done(void);
+void appmanager_set_frame_rate(uint8_t fps);
+void appmanager_get_frame_stats(struct app_frame_stats *stats);
+void appmanager_dump_frame_stats(void);
 void appmanager_app_start(char *name);
 void appmanager_app_quit(void);
 App *appmanager_get_app(char *app_name);
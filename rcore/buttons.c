@@ -8,37 +8,31 @@
 /*
  * MODULE TODO
  * 
- * Button Multi click support
- * buttonholder -> clickrecognizer convert / typedef
  * Theres a couple of bytes of ram to be shaved
  * 
  * review task priorities
  */
 #include "FreeRTOS.h"
 #include "task.h"
-#include "queue.h"
 #include "buttons.h"
 
-static TaskHandle_t _button_debounce_task;
-static StaticTask_t _button_debounce_task_buf;
-static StackType_t _button_debounce_task_stack[configMINIMAL_STACK_SIZE];
-
-static TaskHandle_t _button_message_task;
-static StaticTask_t _button_message_task_buf;
-static StackType_t _button_message_task_stack[configMINIMAL_STACK_SIZE];
-
-static xQueueHandle _button_queue;
-static StaticQueue_t _button_queue_buf;
-#define BUTTON_QUEUE_SIZE 5
-static uint8_t _button_queue_contents[BUTTON_QUEUE_SIZE];
-
-static ButtonMessage _button_message;
-static uint8_t _last_press; // TODO
-static void _button_message_thread(void *pvParameters);
-static void _button_debounce_thread(void *pvParameters);
-static void _button_update(ButtonId button_id, uint8_t press);
-static void _button_released(ButtonHolder *button);
-static uint8_t _button_check_time(void);
+static TaskHandle_t _button_task;
+static StaticTask_t _button_task_buf;
+static StackType_t _button_task_stack[configMINIMAL_STACK_SIZE];
+
+/* edges the ISR has seen that the task hasn't, and when the first came in */
+static volatile uint32_t _button_edges;
+static volatile TickType_t _button_edge_time[NUM_BUTTONS];
+
+/* the app queue holds 5 messages, so we can't have more in flight */
+#define BUTTON_MESSAGE_COUNT 5
+static ButtonMessage _button_messages[BUTTON_MESSAGE_COUNT];
+static uint8_t _button_message_next;
+
+static void _button_thread(void *pvParameters);
+static void _button_sample(ButtonHolder *button, TickType_t when);
+static void _button_deadlines(ButtonHolder *button, TickType_t now);
+static TickType_t _button_next_wait(TickType_t now);
 static ButtonHolder *_button_holders[NUM_BUTTONS];
 
 void button_send_app_click(void *callback, void *recognizer, void *context);
@@ -53,32 +47,36 @@ void rcore_buttons_init(void)
 {
     hw_button_init();
     
-    _button_message_task = xTaskCreateStatic(_button_message_thread, "Button", configMINIMAL_STACK_SIZE, NULL, tskIDLE_PRIORITY + 5UL, _button_message_task_stack, &_button_message_task_buf);
-    _button_debounce_task = xTaskCreateStatic(_button_debounce_thread, "Debounce", configMINIMAL_STACK_SIZE, NULL, tskIDLE_PRIORITY + 5UL, _button_debounce_task_stack, &_button_debounce_task_buf);
-    
-    _button_queue = xQueueCreateStatic(5, sizeof(uint8_t), _button_queue_contents, &_button_queue_buf);
-    
-    hw_button_set_isr(_button_isr);
-        
-    // Initialise the button click configs
+    // Initialise the button click configs before anything can press them
     for (uint8_t i = 0; i < NUM_BUTTONS; i++)
     {
         button_add_click_config(i, (ClickConfig) {});
     }
     
+    _button_task = xTaskCreateStatic(_button_thread, "Button", configMINIMAL_STACK_SIZE, NULL, tskIDLE_PRIORITY + 5UL, _button_task_stack, &_button_task_buf);
+    
+    hw_button_set_isr(_button_isr);
+    
     KERN_LOG("buttons", APP_LOG_LEVEL_INFO, "Button Task Created");
 }
 
 /*
  * Callback function for the button ISR in hardware.
+ * We note when the first edge came in, so the click timing is from the
+ * press itself and not from when the task got round to it. Any bouncing
+ * after that just sets the same bit again.
  */
 static void _button_isr(hw_button_t /* which is definitionally the same as a ButtonID */ button_id)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     
-    _last_press = button_id;
+    if (!(_button_edges & (1 << button_id)))
+    {
+        _button_edge_time[button_id] = xTaskGetTickCountFromISR();
+        _button_edges |= 1 << button_id;
+    }
 
-    vTaskNotifyGiveFromISR(_button_debounce_task, &xHigherPriorityTaskWoken);
+    vTaskNotifyGiveFromISR(_button_task, &xHigherPriorityTaskWoken);
 
     /* If xHigherPriorityTaskWoken is now set to pdTRUE then a context switch
     should be performed to ensure the interrupt returns directly to the highest
@@ -102,199 +100,275 @@ ButtonHolder *button_add_click_config(ButtonId button_id, ClickConfig click_conf
 
     button_holder->click_config = click_config;
     button_holder->button_id = button_id;
+    button_holder->state = BUTTON_STATE_RELEASED;
 
     _button_holders[button_id] = button_holder;
     
     return button_holder;
 }
 
+static void _button_send(ButtonHolder *button, ClickHandler handler)
+{
+    if (handler)
+        button_send_app_click(handler, button, button->click_config.context);
+}
+
 /*
- * Called up button press or releases after debouncing has occured
+ * The button went down at 'when'. Arm whichever deadlines it is
+ * subscribed to, counted from then
  */
-static void _button_update(ButtonId button_id, uint8_t press)
+static void _button_press(ButtonHolder *button, TickType_t when)
 {
-    ButtonHolder *button = _button_holders[button_id];
+    ClickConfig *config = &button->click_config;
     
-    // go through the buttons and find any that match
-    if (press)
+    button->state = BUTTON_STATE_PRESSED;
+    
+    // send the raw keypress
+    _button_send(button, config->raw.down_handler);
+    
+    if (config->long_click.handler && config->long_click.delay_ms > 0)
     {
-        button->press_time = xTaskGetTickCount();
-        button->repeat_time = button->press_time;
-            
-        // send the raw keypress
-        if (button->click_config.raw.down_handler)
-        {
-            button_send_app_click(button->click_config.raw.down_handler,
-                NULL, // TODO
-                button->click_config.context);
-        }
-        button->state = BUTTON_STATE_PRESSED;
+        button->press_time = when + pdMS_TO_TICKS(config->long_click.delay_ms);
+        button->long_armed = true;
     }
-    else
+    
+    // a repeating click goes off as soon as it is pressed, then every interval
+    if (config->click.handler && config->click.repeat_interval_ms > 0)
     {
-        // the button was not pressed at the time we got the message. release it.
-        _button_released(button);
+        button->clicks_reported = 1;
+        _button_send(button, config->click.handler);
+        button->repeat_time = when + pdMS_TO_TICKS(config->click.repeat_interval_ms);
+        button->repeat_armed = true;
     }
+    
+    // we time the gap between clicks from the release
+    button->multi_armed = false;
+}
+
+static uint8_t _button_multi_min(ClickConfig *config)
+{
+    return config->multi_click.min ? config->multi_click.min : 2;
+}
+
+static uint8_t _button_multi_max(ClickConfig *config)
+{
+    uint8_t min = _button_multi_min(config);
+    
+    return config->multi_click.max > min ? config->multi_click.max : min;
 }
 
 /*
- * release the key. decides which callback to call depending on click settings
- * i.e. will call short click release only if its below a long clck time
+ * A short click finished. With a multi click subscribed, we count it and
+ * wait to see if another follows before deciding what it was
  */
-static void _button_released(ButtonHolder *button)
+static void _button_clicked(ButtonHolder *button, TickType_t when)
 {
-    uint32_t now = xTaskGetTickCount();
-    uint32_t delta_ms = portTICK_PERIOD_MS * (now - button->press_time);
-    
-    // we are releasing and it has a click handler
-    // if we have long click, we are below the trigger threshold
-    if (button->click_config.click.handler ||
-        (button->click_config.click.handler && 
-        button->click_config.long_click.handler &&
-        delta_ms < button->click_config.long_click.delay_ms))
+    ClickConfig *config = &button->click_config;
+    uint16_t timeout = config->multi_click.timeout ? config->multi_click.timeout : butMULTI_CLICK_TIMEOUT;
+    
+    if (!config->multi_click.handler)
     {
-        button_send_app_click(button->click_config.click.handler,
-                NULL, // TODO
-                button->click_config.context);
+        button->clicks_reported = 1;
+        _button_send(button, config->click.handler);
+        return;
     }
     
-    // long press release handler
-    if (button->click_config.long_click.release_handler && 
-        button->state == BUTTON_STATE_LONG)
+    button->clicks++;
+    button->clicks_reported = button->clicks;
+    
+    if (!config->multi_click.last_click_only && button->clicks >= _button_multi_min(config))
+        _button_send(button, config->multi_click.handler);
+    
+    if (button->clicks >= _button_multi_max(config))
     {
-        // only trigger the release if we are over the repeat time
-        button_send_app_click(button->click_config.long_click.release_handler,
-                NULL, // TODO
-                button->click_config.context);
+        if (config->multi_click.last_click_only)
+            _button_send(button, config->multi_click.handler);
+        button->clicks = 0;
+        return;
     }
     
-    // just send the raw
-    if (button->click_config.raw.up_handler)
+    button->multi_time = when + pdMS_TO_TICKS(timeout);
+    button->multi_armed = true;
+}
+
+/*
+ * Nothing followed the last click in time. A lone click goes to the
+ * single click handler; a run of them to the multi click one, if it
+ * hasn't been told about them already
+ */
+static void _button_multi_timeout(ButtonHolder *button)
+{
+    ClickConfig *config = &button->click_config;
+    
+    button->multi_armed = false;
+    button->clicks_reported = button->clicks;
+    
+    if (button->clicks >= _button_multi_min(config))
+    {
+        if (config->multi_click.last_click_only)
+            _button_send(button, config->multi_click.handler);
+    }
+    else if (button->clicks == 1)
     {
-        //button->click_config.raw.up_handler(NULL, NULL);
-        button_send_app_click(button->click_config.raw.up_handler,
-                NULL, // TODO
-                button->click_config.context);
+        _button_send(button, config->click.handler);
     }
     
-    button->press_time = 0;
-    button->repeat_time = 0;
+    button->clicks = 0;
+}
+
+/*
+ * release the key. decides which callback to call depending on click settings
+ * i.e. will only call the click handler if the long click didn't fire
+ */
+static void _button_release(ButtonHolder *button, TickType_t when)
+{
+    ClickConfig *config = &button->click_config;
+    
+    button->long_armed = false;
+    button->repeat_armed = false;
+    
+    if (button->state == BUTTON_STATE_LONG)
+    {
+        _button_send(button, config->long_click.release_handler);
+    }
+    else if (!config->click.repeat_interval_ms)
+    {
+        // a repeating click has already gone off for this press
+        _button_clicked(button, when);
+    }
+    
+    // just send the raw
+    _button_send(button, config->raw.up_handler);
+    
     button->state = BUTTON_STATE_RELEASED;
 }
 
 /*
- * Each button has a timestamp for when it last performed an action
- * If the button is set to, say, repeat, then we look for timed out
- * buttons and trigger the relevant action.
+ * Read the button, and if it has changed, act on it as of 'when'.
+ * A change starts the debounce window: edges inside it are bounce and get
+ * ignored, and we look at the button again once it is over so a press
+ * shorter than the window isn't lost
  */
-static uint8_t _button_check_time(void)
+static void _button_sample(ButtonHolder *button, TickType_t when)
 {
-    uint32_t now = xTaskGetTickCount();
-    ButtonHolder *button;
-    uint8_t pressed, any_pressed = 0;    
+    bool down = _button_pressed(button->button_id);
+    
+    if (down == button->down)
+        return;
+    
+    button->down = down;
+    button->settle_time = when + butDEBOUNCE_DELAY;
+    button->settling = true;
+    
+    if (down)
+        _button_press(button, when);
+    else
+        _button_release(button, when);
+}
 
-    for (uint8_t i = 0; i < NUM_BUTTONS; i++)
+/*
+ * Run anything that has come due for this button
+ */
+static void _button_deadlines(ButtonHolder *button, TickType_t now)
+{
+    ClickConfig *config = &button->click_config;
+    
+    if (button->settling && !TICK_AFTER(button->settle_time, now))
     {
-        button = _button_holders[i];
-        pressed = _button_pressed(i);
-                
-        if (!pressed)
-        {
-            continue;
-        }
-        else
-        {
-            any_pressed = 1;
-        }
-        
-        // button is still pressed
-        // we have a click and a repeat
-        if (button->click_config.click.handler && button->repeat_time > 0 && 
-            button->click_config.click.repeat_interval_ms > 0)
-        {
-            // and the time of the last repeat was < now
-            if (now > button->repeat_time + (button->click_config.click.repeat_interval_ms / portTICK_PERIOD_MS))
-            {
-                button->state = BUTTON_STATE_REPEATING;
-                button_send_app_click(button->click_config.click.handler,
-                        NULL, // TODO
-                        button->click_config.context);
-                
-                // reset the time
-                button->repeat_time = now;
-            }
-        }
+        button->settling = false;
+        _button_sample(button, button->settle_time);
+    }
+    
+    // button held, and we just blasted past the long press time
+    if (button->long_armed && !TICK_AFTER(button->press_time, now))
+    {
+        button->long_armed = false;
+        button->repeat_armed = false;
+        button->state = BUTTON_STATE_LONG;
+        _button_send(button, config->long_click.handler);
+    }
+    
+    if (button->repeat_armed && !TICK_AFTER(button->repeat_time, now))
+    {
+        button->state = BUTTON_STATE_REPEATING;
+        button->clicks_reported = 1;
+        _button_send(button, config->click.handler);
         
-        // button pressed, and we just blasted past the long press time
-        if (button->click_config.long_click.handler && button->press_time > 0 && 
-            button->click_config.long_click.delay_ms > 0)
-        {
-            if (now > button->press_time + (button->click_config.long_click.delay_ms / portTICK_PERIOD_MS))
-            {
-                button->state = BUTTON_STATE_LONG;
-                button_send_app_click(button->click_config.long_click.handler,
-                        NULL, // TODO
-                        button->click_config.context);
-                
-                // stop further processing
-                button->press_time = 0;
-                button->repeat_time = 0;
-            }
-        }
+        // keep to the interval, unless we have fallen right behind
+        button->repeat_time += pdMS_TO_TICKS(config->click.repeat_interval_ms);
+        if (!TICK_AFTER(button->repeat_time, now))
+            button->repeat_time = now + pdMS_TO_TICKS(config->click.repeat_interval_ms);
     }
     
-    return any_pressed;
+    if (button->multi_armed && !TICK_AFTER(button->multi_time, now))
+        _button_multi_timeout(button);
+}
+
+static void _button_wait_for(TickType_t deadline, TickType_t now, TickType_t *wait)
+{
+    TickType_t until = TICK_AFTER(deadline, now) ? deadline - now : 0;
+    
+    if (until < *wait)
+        *wait = until;
 }
 
 /*
- * Take the incoming button presses from the debounced input, and process them
- * also take care of looping around the button press checker
- * The main loop will only halt into a permanent sleep once
- * all buttons are released. Until that time, it will loop in n ms intervals
+ * How long we can sleep until the next thing any button has to do.
+ * A button held down with nothing armed doesn't wake us at all
  */
-static void _button_message_thread(void *pvParameters)
+static TickType_t _button_next_wait(TickType_t now)
 {
-    uint8_t data;
-    printf("BM\n");
-    TickType_t time_increment = portMAX_DELAY;
-           
-    for( ;; )
+    TickType_t wait = portMAX_DELAY;
+    
+    for (uint8_t i = 0; i < NUM_BUTTONS; i++)
     {
-        if (xQueueReceive(_button_queue, &data, time_increment))
-        {           
-            _button_update(data, _button_pressed(data));
-        }
+        ButtonHolder *button = _button_holders[i];
         
-        time_increment = _button_check_time();
-
-        if (time_increment == 0)
-            time_increment = portMAX_DELAY;
-        else
-            time_increment = pdMS_TO_TICKS(10);
+        if (button->settling)
+            _button_wait_for(button->settle_time, now, &wait);
+        if (button->long_armed)
+            _button_wait_for(button->press_time, now, &wait);
+        if (button->repeat_armed)
+            _button_wait_for(button->repeat_time, now, &wait);
+        if (button->multi_armed)
+            _button_wait_for(button->multi_time, now, &wait);
     }
+    
+    return wait;
 }
 
 /*
- * Debounce the button
+ * The one button task. It sleeps until either the ISR sees an edge or the
+ * next click deadline (debounce, long press, repeat, multi click) is due
  */
-static void _button_debounce_thread(void *pvParameters)
+static void _button_thread(void *pvParameters)
 {
-    printf("BD\n");
+    TickType_t wait = portMAX_DELAY;
+    uint32_t edges;
+    
     for( ;; )
     {
-        // sleep forever waiting for something on the interrupts to wake us
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ulTaskNotifyTake(pdTRUE, wait);
         
-        // tell the main worker we have something
-        xQueueSendToBack(_button_queue, &_last_press, (TickType_t)100);
-
-        // because we are using a notification on the task, any further triggers while
-        // the buttons are bouncing are ignored while we are sleeping
-        // so lets go ahead and have a nap                           
-        vTaskDelay(butDEBOUNCE_DELAY);
+        taskENTER_CRITICAL();
+        edges = _button_edges;
+        _button_edges = 0;
+        taskEXIT_CRITICAL();
+        
+        TickType_t now = xTaskGetTickCount();
+        
+        for (uint8_t i = 0; i < NUM_BUTTONS; i++)
+        {
+            ButtonHolder *button = _button_holders[i];
+            
+            // while it is bouncing, the end of the debounce window has a look
+            if ((edges & (1 << i)) && !button->settling)
+                _button_sample(button, _button_edge_time[i]);
+            
+            _button_deadlines(button, now);
+        }
         
-        // one last cleardown of our notification just to be sure
-        ulTaskNotifyTake(pdTRUE, 0);
+        wait = _button_next_wait(now);
     }
 }
 
@@ -304,13 +378,18 @@ static void _button_debounce_thread(void *pvParameters)
  */
 void button_send_app_click(void *callback, void *recognizer, void *context)
 {   
-    _button_message.callback = callback;
-    _button_message.clickref = recognizer; // TODO
-    _button_message.context  = context;
+    ButtonMessage *message = &_button_messages[_button_message_next];
+    
+    // the app may not have got to the last one yet, so don't overwrite it
+    _button_message_next = (_button_message_next + 1) % BUTTON_MESSAGE_COUNT;
+    
+    message->callback = callback;
+    message->clickref = recognizer;
+    message->context  = context;
 
     rcore_backlight_on(100, 3000);
     
-    appmanager_post_button_message(&_button_message);
+    appmanager_post_button_message(message);
 }
 
 
@@ -322,6 +401,24 @@ static uint8_t _button_pressed(ButtonId button_id)
     return hw_button_pressed(button_id);
 }
 
+/*
+ * The recogniser handed to click handlers is the button's holder
+ */
+uint8_t click_number_of_clicks_counted(ClickRecognizerRef recognizer)
+{
+    return ((ButtonHolder *)recognizer)->clicks_reported;
+}
+
+ButtonId click_recognizer_get_button_id(ClickRecognizerRef recognizer)
+{
+    return ((ButtonHolder *)recognizer)->button_id;
+}
+
+bool click_recognizer_is_repeating(ClickRecognizerRef recognizer)
+{
+    return ((ButtonHolder *)recognizer)->state == BUTTON_STATE_REPEATING;
+}
+
 /*
  * These are the subscription handlers for the button inputs and their various settings
  */
@@ -351,7 +448,13 @@ void button_multi_click_subscribe(ButtonId button_id, uint8_t min_clicks, uint8_
     if (button_id >= NUM_BUTTONS)
         return;
     
-//     ButtonHolder *holder = _button_holders[button_id]; // get the button
+    ButtonHolder *holder = _button_holders[button_id]; // get the button
+    holder->click_config.multi_click.handler = handler;
+    holder->click_config.multi_click.min = min_clicks;
+    holder->click_config.multi_click.max = max_clicks;
+    holder->click_config.multi_click.timeout = timeout;
+    holder->click_config.multi_click.last_click_only = last_click_only;
+    holder->clicks = 0;
 }
 
 void button_long_click_subscribe(ButtonId button_id, uint16_t delay_ms, ClickHandler down_handler, ClickHandler up_handler)
@@ -380,7 +483,9 @@ void button_unsubscribe_all(void)
     for(uint8_t i = 0; i < NUM_BUTTONS; i++)
     {
         ButtonHolder *holder = _button_holders[i]; // get the button
-        memset(holder, 0, sizeof(ClickConfig));
+        memset(&holder->click_config, 0, sizeof(ClickConfig));
+        holder->long_armed = holder->repeat_armed = holder->multi_armed = false;
+        holder->clicks = 0;
     }
 }
 
@@ -12,6 +12,7 @@
 #include "librebble.h"
 
 #define butDEBOUNCE_DELAY       ( portTICK_RATE_MS )
+#define butMULTI_CLICK_TIMEOUT  300 // ms between clicks, when the app doesn't say
 
 #define BUTTON_STATE_PRESSED    0
 #define BUTTON_STATE_RELEASED   1
@@ -23,9 +24,18 @@
 typedef struct ButtonHolder {
     uint8_t button_id;
     ClickConfig click_config;
-    TickType_t repeat_time;
-    TickType_t press_time;
+    TickType_t repeat_time;   // when the next repeat is due
+    TickType_t press_time;    // when the long click is due
+    TickType_t settle_time;   // when it will have stopped bouncing
+    TickType_t multi_time;    // when the click sequence times out
     uint8_t state;
+    uint8_t clicks;           // clicks so far in a multi click
+    uint8_t clicks_reported;  // what click_number_of_clicks_counted says
+    bool down;                // debounced state
+    bool settling;
+    bool long_armed;
+    bool repeat_armed;
+    bool multi_armed;
 } ButtonHolder;
 
 void rcore_buttons_init(void);
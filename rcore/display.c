@@ -12,10 +12,36 @@ static xQueueHandle _display_queue;
 static SemaphoreHandle_t _display_mutex;
 static StaticSemaphore_t _display_mutex_buf;
 
+/* area of the screen waiting to be sent. max ends are exclusive */
+static uint8_t _display_dirty_xmin, _display_dirty_ymin;
+static uint8_t _display_dirty_xmax, _display_dirty_ymax;
+/* a frame is waiting to go, or on its way out */
+static volatile bool _display_busy;
+
+#ifdef DISPLAY_DOUBLE_BUFFER
+/* Everything is rendered in here. The driver's own buffer becomes the front
+ * buffer, which only changes between transfers. Assumes an 8 bit per pixel
+ * framebuffer */
+static uint8_t _display_back_buffer[DISPLAY_ROWS * DISPLAY_COLS];
+
+static void _display_present(uint8_t ymin, uint8_t ymax);
+#endif
+
 static void _display_thread(void *pvParameters);
-static void _display_start_frame(uint8_t offset_x, uint8_t offset_y);
+static void _display_start_frame(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax);
+static void _display_dirty_add(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax);
 static void _display_cmd(uint8_t cmd, char *data);
 
+static inline uint16_t _display_min(uint16_t a, uint16_t b)
+{
+    return a < b ? a : b;
+}
+
+static inline uint16_t _display_max(uint16_t a, uint16_t b)
+{
+    return a > b ? a : b;
+}
+
 /*
  * Start the display driver and tasks. Show splash
  */
@@ -29,6 +55,8 @@ void display_init(void)
     _display_queue = xQueueCreate(2, sizeof(uint8_t));
     _display_mutex = xSemaphoreCreateMutexStatic(&_display_mutex_buf);
     
+    // send whatever the driver starts up with
+    _display_dirty_add(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
     _display_cmd(DISPLAY_CMD_DRAW, NULL);
     
     KERN_LOG("Display", APP_LOG_LEVEL_INFO, "Display Tasks Created");
@@ -67,11 +95,11 @@ void display_reset(uint8_t enabled)
 /*
  * Begin rendering a frame from the framebuffer into the display
  */
-static void _display_start_frame(uint8_t xoffset, uint8_t yoffset)
+static void _display_start_frame(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax)
 {
     xSemaphoreTake(_display_mutex, portMAX_DELAY);
     
-    hw_display_start_frame(xoffset, yoffset);
+    hw_display_start_frame(xmin, ymin, xmax, ymax);
     
     // block wait for the draw to finish
     // this is invoked via the ISR
@@ -86,9 +114,33 @@ static void _display_start_frame(uint8_t xoffset, uint8_t yoffset)
  */
 uint8_t *display_get_buffer(void)
 {
+#ifdef DISPLAY_DOUBLE_BUFFER
+    return _display_back_buffer;
+#else
     return hw_display_get_buffer();
+#endif
 }
 
+#ifdef DISPLAY_DOUBLE_BUFFER
+/*
+ * Swap the freshly rendered rows into the front buffer.
+ * The display mutex is held for the whole of a transfer, so this waits
+ * for the frame in flight to go out first. Once we return the caller can
+ * render the next frame while this one is being sent.
+ * Whole rows are copied; outside of what was just drawn the back buffer
+ * already matches the front, so this is safe for any x range
+ */
+static void _display_present(uint8_t ymin, uint8_t ymax)
+{
+    uint8_t *front = hw_display_get_buffer();
+    uint32_t offset = ymin * DISPLAY_COLS;
+    
+    xSemaphoreTake(_display_mutex, portMAX_DELAY);
+    memcpy(front + offset, _display_back_buffer + offset, (ymax - ymin) * DISPLAY_COLS);
+    xSemaphoreGive(_display_mutex);
+}
+#endif
+
 /*
  * Request a command from the display driver. 
  * Such as DISPLAY_CMD_DRAW
@@ -99,13 +151,72 @@ static void _display_cmd(uint8_t cmd, char *data)
 }
 
 /*
- * Queue a draw when available
+ * Queue a draw of the whole screen when available
  */
 void display_draw(void)
 {
+    display_draw_rect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+}
+
+/*
+ * Queue a draw of part of the screen when available.
+ * Areas requested before the display gets to them are merged
+ * into one bounding box and sent together
+ */
+void display_draw_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h)
+{
+    uint16_t xmax = _display_min(x + w, DISPLAY_COLS);
+    uint16_t ymax = _display_min(y + h, DISPLAY_ROWS);
+    
+    if (x >= xmax || y >= ymax)
+        return;
+    
+#ifdef DISPLAY_DOUBLE_BUFFER
+    _display_present(y, ymax);
+#endif
+    _display_dirty_add(x, y, xmax, ymax);
     _display_cmd(DISPLAY_CMD_DRAW, 0);
 }
 
+/*
+ * Is the display still busy with the last frame we gave it?
+ * Rendering into a buffer that is going out would tear. When double
+ * buffered it is fine to render while a frame is sent, just not to get
+ * a whole frame ahead of the display.
+ */
+bool display_is_busy(void)
+{
+#ifdef DISPLAY_DOUBLE_BUFFER
+    return _display_dirty_xmin < _display_dirty_xmax;
+#else
+    return _display_busy;
+#endif
+}
+
+/*
+ * Grow the area waiting to be sent. Max ends are exclusive
+ */
+static void _display_dirty_add(uint8_t xmin, uint8_t ymin, uint8_t xmax, uint8_t ymax)
+{
+    taskENTER_CRITICAL();
+    _display_busy = true;
+    if (_display_dirty_xmin >= _display_dirty_xmax || _display_dirty_ymin >= _display_dirty_ymax)
+    {
+        _display_dirty_xmin = xmin;
+        _display_dirty_ymin = ymin;
+        _display_dirty_xmax = xmax;
+        _display_dirty_ymax = ymax;
+    }
+    else
+    {
+        _display_dirty_xmin = _display_min(_display_dirty_xmin, xmin);
+        _display_dirty_ymin = _display_min(_display_dirty_ymin, ymin);
+        _display_dirty_xmax = _display_max(_display_dirty_xmax, xmax);
+        _display_dirty_ymax = _display_max(_display_dirty_ymax, ymax);
+    }
+    taskEXIT_CRITICAL();
+}
+
 /*
  * Main task processing for the display. Manages locking
  * state machine control and command management
@@ -130,9 +241,43 @@ static void _display_thread(void *pvParameters)
                 // the outer laters. If someone calls an overlapping draw into here
                 // it's just going to fail
                 case DISPLAY_CMD_DRAW:
-                    // all we are responsible for is starting a frame draw
-                    _display_start_frame(0, 0);
+                {
+                    uint8_t xmin, ymin, xmax, ymax;
+                    
+                    // take the area to send and start collecting a new one
+                    taskENTER_CRITICAL();
+                    xmin = _display_dirty_xmin;
+                    ymin = _display_dirty_ymin;
+                    xmax = _display_dirty_xmax;
+                    ymax = _display_dirty_ymax;
+                    _display_dirty_xmin = _display_dirty_xmax = 0;
+                    _display_dirty_ymin = _display_dirty_ymax = 0;
+                    taskEXIT_CRITICAL();
+                    
+#ifdef DISPLAY_DOUBLE_BUFFER
+                    // the next frame can be rendered while this one goes out
+                    appmanager_display_done();
+#endif
+                    
+                    // an earlier draw already sent this area
+                    if (xmin < xmax && ymin < ymax)
+                    {
+                        // all we are responsible for is starting a frame draw
+                        _display_start_frame(xmin, ymin, xmax, ymax);
+                    }
+                    
+                    // idle, unless another frame came in while we were busy
+                    taskENTER_CRITICAL();
+                    if (_display_dirty_xmin >= _display_dirty_xmax)
+                        _display_busy = false;
+                    taskEXIT_CRITICAL();
+                    
+#ifndef DISPLAY_DOUBLE_BUFFER
+                    if (!_display_busy)
+                        appmanager_display_done();
+#endif
                     break;
+                }
                 case DISPLAY_CMD_DONE:
                     break;
             }
@@ -6,7 +6,9 @@
  * Author: Barry Carter <barry.carter@gmail.com>
  */
 
+#include <stdbool.h>
 #include "FreeRTOS.h"
+#include "platform.h"
 
 #define DISPLAY_MODE_BOOTLOADER      0
 #define DISPLAY_MODE_FULLFAT         1
@@ -17,17 +19,11 @@
 #define DISPLAY_CMD_DONE             3
 
 
-/* XXX this is not portable yet, and really needs to get split into hw/ */
-#ifdef STM32F2XX
-#include "stm32f2xx.h"
-#else
-#include "stm32f4xx.h"
-#endif
-
-
 void display_init(void);
 void display_done_ISR(uint8_t cmd);
 void display_reset(uint8_t enabled);
 void display_draw(void);
+void display_draw_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h);
 uint8_t *display_get_buffer(void);
+bool display_is_busy(void);
 
@@ -14,7 +14,6 @@ extern void hw_flash_init(void);
 extern void hw_flash_read_bytes(uint32_t, uint8_t*, size_t);
 
 // TODO
-// DMA/async?
 // what about apps/watchface resource loading?
 // document
 
@@ -27,12 +26,188 @@ extern unsigned int _ram_top;
 
 static struct hw_driver_ext_flash_t *_flash_driver;
 
+/* Asynchronous reads are queued up and run one at a time by the flash
+ * thread, which calls back when each is done.  If the platform can DMA out
+ * of flash, the thread sleeps while the transfer happens.  */
+#define FLASH_ASYNC_QUEUE_SIZE 8
+
+/* it logs, and runs everyone's callbacks */
+#define FLASH_TASK_STACK_SIZE (configMINIMAL_STACK_SIZE * 3)
+
+typedef struct flash_async_request_t {
+    uint32_t address;
+    uint8_t *buffer;
+    size_t num_bytes;
+    flash_read_callback_t callback;
+    void *ctx;
+} flash_async_request_t;
+
+static TaskHandle_t _flash_task;
+static StaticTask_t _flash_task_buf;
+static StackType_t _flash_task_stack[FLASH_TASK_STACK_SIZE];
+
+static xQueueHandle _flash_queue;
+static StaticQueue_t _flash_queue_buf;
+static uint8_t _flash_queue_contents[FLASH_ASYNC_QUEUE_SIZE * sizeof(flash_async_request_t)];
+static volatile int _flash_dma_err;
+
+static void _flash_thread(void *pvParameters);
+
+#ifdef FLASH_CACHE_LINE_SIZE
+
+#if FLASH_CACHE_LINE_SIZE & (FLASH_CACHE_LINE_SIZE - 1)
+#error FLASH_CACHE_LINE_SIZE must be a power of two
+#endif
+
+/* Small set-associative cache of flash lines, for all the little reads
+ * (resource table entries, page headers, font glyphs...) that would
+ * otherwise each cost a round trip to the flash.  Reads bigger than a line
+ * go straight to the flash.  When a miss lands on the line straight after
+ * the last one we fetched, we assume someone is reading sequentially and
+ * pull in the following line too.
+ *
+ * Everything in here is protected by the flash mutex.  */
+#define FLASH_CACHE_INVALID 0xFFFFFFFF
+
+struct flash_cache_line {
+    uint32_t tag; /* flash address of the first byte in the line */
+    uint32_t last_used;
+    uint8_t data[FLASH_CACHE_LINE_SIZE];
+};
+
+static struct flash_cache_line _flash_cache[FLASH_CACHE_SETS][FLASH_CACHE_WAYS];
+static uint32_t _flash_cache_clock;
+static uint32_t _flash_cache_next_tag = FLASH_CACHE_INVALID;
+static struct flash_cache_stats _flash_cache_stats;
+
+static struct flash_cache_line *_flash_cache_set(uint32_t tag)
+{
+    return _flash_cache[(tag / FLASH_CACHE_LINE_SIZE) % FLASH_CACHE_SETS];
+}
+
+static struct flash_cache_line *_flash_cache_lookup(uint32_t tag)
+{
+    struct flash_cache_line *set = _flash_cache_set(tag);
+    
+    for (int i = 0; i < FLASH_CACHE_WAYS; i++)
+        if (set[i].tag == tag)
+            return &set[i];
+    
+    return NULL;
+}
+
+/* read a line into a free way of its set, or else the least recently used */
+static struct flash_cache_line *_flash_cache_fill(uint32_t tag)
+{
+    struct flash_cache_line *set = _flash_cache_set(tag);
+    struct flash_cache_line *line = NULL;
+    
+    for (int i = 0; i < FLASH_CACHE_WAYS && !line; i++)
+        if (set[i].tag == FLASH_CACHE_INVALID)
+            line = &set[i];
+    
+    if (!line)
+    {
+        line = &set[0];
+        for (int i = 1; i < FLASH_CACHE_WAYS; i++)
+            if (set[i].last_used < line->last_used)
+                line = &set[i];
+    }
+    
+    hw_flash_read_bytes(tag, line->data, FLASH_CACHE_LINE_SIZE);
+    line->tag = tag;
+    line->last_used = _flash_cache_clock;
+    
+    return line;
+}
+
+static void _flash_cache_read(uint32_t address, uint8_t *buffer, size_t num_bytes)
+{
+    if (num_bytes > FLASH_CACHE_LINE_SIZE)
+    {
+        _flash_cache_stats.bypasses++;
+        hw_flash_read_bytes(address, buffer, num_bytes);
+        return;
+    }
+    
+    while (num_bytes)
+    {
+        uint32_t tag = address & ~(FLASH_CACHE_LINE_SIZE - 1);
+        size_t ofs = address - tag;
+        size_t n = FLASH_CACHE_LINE_SIZE - ofs;
+        struct flash_cache_line *line;
+        
+        if (n > num_bytes)
+            n = num_bytes;
+        
+        _flash_cache_clock++;
+        line = _flash_cache_lookup(tag);
+        if (line)
+        {
+            _flash_cache_stats.hits++;
+            _flash_cache_stats.bytes_saved += n;
+            line->last_used = _flash_cache_clock;
+        }
+        else
+        {
+            _flash_cache_stats.misses++;
+            line = _flash_cache_fill(tag);
+            
+            if (tag == _flash_cache_next_tag &&
+                tag + FLASH_CACHE_LINE_SIZE < FLASH_SIZE &&
+                !_flash_cache_lookup(tag + FLASH_CACHE_LINE_SIZE))
+            {
+                _flash_cache_stats.prefetches++;
+                _flash_cache_fill(tag + FLASH_CACHE_LINE_SIZE);
+                _flash_cache_next_tag = tag + 2 * FLASH_CACHE_LINE_SIZE;
+            }
+            else
+                _flash_cache_next_tag = tag + FLASH_CACHE_LINE_SIZE;
+        }
+        
+        memcpy(buffer, line->data + ofs, n);
+        address += n;
+        buffer += n;
+        num_bytes -= n;
+    }
+}
+
+static void _flash_cache_invalidate(uint32_t address, size_t num_bytes)
+{
+    uint32_t first = address & ~(FLASH_CACHE_LINE_SIZE - 1);
+    uint32_t last = address + (num_bytes - 1);
+    
+    if (!num_bytes)
+        return;
+    if (last < address)
+        last = FLASH_CACHE_INVALID;
+    
+    for (int set = 0; set < FLASH_CACHE_SETS; set++)
+        for (int way = 0; way < FLASH_CACHE_WAYS; way++)
+        {
+            struct flash_cache_line *line = &_flash_cache[set][way];
+            
+            if (line->tag != FLASH_CACHE_INVALID &&
+                line->tag >= first && line->tag <= last)
+                line->tag = FLASH_CACHE_INVALID;
+        }
+    
+    _flash_cache_next_tag = FLASH_CACHE_INVALID;
+}
+
+#endif /* FLASH_CACHE_LINE_SIZE */
+
 void flash_init()
 {
     // initialise device specific flash
     hw_flash_init();
     
     _flash_mutex = xSemaphoreCreateMutexStatic(&_flash_mutex_buf);
+    flash_cache_invalidate_all();
+    
+    _flash_queue = xQueueCreateStatic(FLASH_ASYNC_QUEUE_SIZE, sizeof(flash_async_request_t), _flash_queue_contents, &_flash_queue_buf);
+    _flash_task = xTaskCreateStatic(_flash_thread, "Flash", FLASH_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 3UL, _flash_task_stack, &_flash_task_buf);
+    
     fs_init();
 }
 
@@ -50,12 +225,191 @@ void flash_read_bytes(uint32_t address, uint8_t *buffer, size_t num_bytes)
         xSemaphoreTake(_flash_mutex, portMAX_DELAY);
     }
 
+#ifdef FLASH_CACHE_LINE_SIZE
+    _flash_cache_read(address, buffer, num_bytes);
+#else
     hw_flash_read_bytes(address, buffer, num_bytes);
+#endif
     
     if (should_mutex)
         xSemaphoreGive(_flash_mutex);
 }
 
+/*
+ * Queue a read of num_bytes from flash into buffer, and return without
+ * waiting for it.  callback (if given) is called with ctx from the flash
+ * thread once the data is in buffer; don't touch buffer until then.
+ * Returns 0 if the read was queued, or -1 if the queue is full.
+ * An empty read is done already, so the callback is called straight away.
+ */
+int flash_read_bytes_async(uint32_t address, uint8_t *buffer, size_t num_bytes, flash_read_callback_t callback, void *ctx)
+{
+    flash_async_request_t req = {
+        .address = address,
+        .buffer = buffer,
+        .num_bytes = num_bytes,
+        .callback = callback,
+        .ctx = ctx
+    };
+    
+    /* a DMA of nothing never completes, and would hang the flash thread */
+    if (num_bytes == 0)
+    {
+        if (callback)
+            callback(ctx);
+        return 0;
+    }
+    
+    if (xQueueSendToBack(_flash_queue, &req, 0) != pdTRUE)
+        return -1;
+    
+    return 0;
+}
+
+static void _flash_read_done(void *ctx)
+{
+    xSemaphoreGive((SemaphoreHandle_t)ctx);
+}
+
+/*
+ * As flash_read_bytes, but the flash thread does the copy (with DMA, where
+ * there is some) while we sleep, so other threads get the CPU meanwhile.
+ * For big reads, like whole resources; it skips the cache.
+ * Don't call it from a flash read callback.
+ */
+void flash_read_bytes_wait(uint32_t address, uint8_t *buffer, size_t num_bytes)
+{
+    StaticSemaphore_t done_buf;
+    SemaphoreHandle_t done;
+    
+    if (rebbleos_get_system_status() != SYSTEM_STATUS_STARTED)
+    {
+        flash_read_bytes(address, buffer, num_bytes);
+        return;
+    }
+    
+    done = xSemaphoreCreateBinaryStatic(&done_buf);
+    if (flash_read_bytes_async(address, buffer, num_bytes, _flash_read_done, done) == 0)
+        xSemaphoreTake(done, portMAX_DELAY);
+    else
+        flash_read_bytes(address, buffer, num_bytes);
+    vSemaphoreDelete(done);
+}
+
+/*
+ * The hardware has finished a DMA read. Wake the flash thread
+ */
+void flash_read_done_ISR(int err)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    
+    _flash_dma_err = err;
+    vTaskNotifyGiveFromISR(_flash_task, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+static void _flash_thread(void *pvParameters)
+{
+    flash_async_request_t req;
+    
+    while (1)
+    {
+        xQueueReceive(_flash_queue, &req, portMAX_DELAY);
+        
+        /* reads are serialised against flash_read_bytes users */
+        xSemaphoreTake(_flash_mutex, portMAX_DELAY);
+#ifdef HW_FLASH_HAS_DMA
+        hw_flash_read_bytes_dma(req.address, req.buffer, req.num_bytes);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (_flash_dma_err)
+        {
+            KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "DMA read of %d bytes at 0x%x failed; retrying by hand", req.num_bytes, req.address);
+            hw_flash_read_bytes(req.address, req.buffer, req.num_bytes);
+        }
+#else
+        hw_flash_read_bytes(req.address, req.buffer, req.num_bytes);
+#endif
+        xSemaphoreGive(_flash_mutex);
+        
+        if (req.callback)
+            req.callback(req.ctx);
+    }
+}
+
+/*
+ * Get a read only pointer straight at num_bytes of flash, if the platform
+ * has it memory mapped. Returns NULL if it hasn't; read it out instead.
+ * Nothing writes flash while the OS is running, so no lock is held.
+ * Hand it back with flash_unmap
+ */
+const uint8_t *flash_map(uint32_t address, size_t num_bytes)
+{
+#ifdef HW_FLASH_HAS_MAP
+    return hw_flash_map(address, num_bytes);
+#else
+    return NULL;
+#endif
+}
+
+/*
+ * Let go of a pointer from flash_map.
+ * Returns 0 if it didn't come from there
+ */
+int flash_unmap(const uint8_t *ptr)
+{
+#ifdef HW_FLASH_HAS_MAP
+    return hw_flash_unmap(ptr);
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Throw away anything cached for the given range of flash.
+ * Anything that writes or erases flash must call this afterwards.
+ */
+void flash_cache_invalidate(uint32_t address, size_t num_bytes)
+{
+#ifdef FLASH_CACHE_LINE_SIZE
+    uint8_t should_mutex = rebbleos_get_system_status() == SYSTEM_STATUS_STARTED;
+    
+    if (should_mutex)
+        xSemaphoreTake(_flash_mutex, portMAX_DELAY);
+    
+    _flash_cache_invalidate(address, num_bytes);
+    
+    if (should_mutex)
+        xSemaphoreGive(_flash_mutex);
+#endif
+}
+
+void flash_cache_invalidate_all(void)
+{
+    flash_cache_invalidate(0, 0xFFFFFFFF);
+}
+
+void flash_cache_get_stats(struct flash_cache_stats *stats)
+{
+#ifdef FLASH_CACHE_LINE_SIZE
+    *stats = _flash_cache_stats;
+#else
+    memset(stats, 0, sizeof(struct flash_cache_stats));
+#endif
+}
+
+void flash_cache_dump_stats(void)
+{
+    struct flash_cache_stats stats;
+    uint32_t lookups;
+    
+    flash_cache_get_stats(&stats);
+    lookups = stats.hits + stats.misses;
+    
+    KERN_LOG("flash", APP_LOG_LEVEL_INFO, "cache: %d hits, %d misses (%d%% hit rate), %d prefetches, %d uncached reads",
+             stats.hits, stats.misses, lookups ? (int)(stats.hits * 100 / lookups) : 0, stats.prefetches, stats.bypasses);
+    KERN_LOG("flash", APP_LOG_LEVEL_INFO, "cache: %d bytes served without touching flash", stats.bytes_saved);
+}
+
 void flash_dump(void)
 {
     uint8_t buffer[1025];
@@ -25,7 +25,28 @@ typedef struct ResourceHeader {
     uint32_t unknownoffset;
 } __attribute__((__packed__)) ResourceHeader;
  
+/* flash read cache counters; see flash_cache_dump_stats */
+struct flash_cache_stats {
+    uint32_t hits;          /* line lookups served from the cache */
+    uint32_t misses;        /* line lookups that went to flash */
+    uint32_t prefetches;    /* lines read ahead of a sequential reader */
+    uint32_t bypasses;      /* reads too big to be worth caching */
+    uint32_t bytes_saved;   /* bytes copied from cache instead of flash */
+};
+
+/* called from the flash thread when an asynchronous read has finished */
+typedef void (*flash_read_callback_t)(void *ctx);
+
 void flash_test(uint16_t resource_id);
 void flash_init(void);
 void flash_read_bytes(uint32_t address, uint8_t *buffer, size_t num_bytes);
+int flash_read_bytes_async(uint32_t address, uint8_t *buffer, size_t num_bytes, flash_read_callback_t callback, void *ctx);
+void flash_read_bytes_wait(uint32_t address, uint8_t *buffer, size_t num_bytes);
+void flash_read_done_ISR(int err);
+const uint8_t *flash_map(uint32_t address, size_t num_bytes);
+int flash_unmap(const uint8_t *ptr);
 void flash_dump(void);
+void flash_cache_invalidate(uint32_t address, size_t num_bytes);
+void flash_cache_invalidate_all(void);
+void flash_cache_get_stats(struct flash_cache_stats *stats);
+void flash_cache_dump_stats(void);
@@ -3,7 +3,7 @@
  * RebbleOS
  */
 #include <stdint.h>
-#include "minilib.h"
+#include "rebbleos.h"
 #include "platform.h"
 #include "log.h"
 #include "fs.h"
@@ -109,6 +109,243 @@ static enum page_state _fs_get_page_state(uint16_t pg)
     return (_fs_page_flags[pg >> 2] >> (6  - 2 * (pg & 3))) & 3;
 }
 
+/* RAM index of live files, built by fs_init's page scan, so that
+ * fs_find_file doesn't have to scan the flash for every lookup.  We only
+ * keep a hash of each name; the name length is implied by startpofs.  A
+ * name that isn't there can hash the same as one that is, so a hit is
+ * checked against the name in the file's header before we believe it.  If
+ * two live files hash the same, both entries are marked, and lookups that
+ * land on them fall back to reading the headers from flash.  If there are
+ * more files than slots, the index is marked incomplete, and anything it
+ * doesn't know about falls back to a full scan.  */
+#define FS_INDEX_MAX_FILES 256
+
+struct fs_index_entry {
+    uint32_t hash;
+    uint32_t size;
+    uint16_t startpage;
+    uint8_t  startpofs;
+    uint8_t  flags;
+#define FS_INDEX_COLLISION 0x1
+};
+
+static struct fs_index_entry _fs_index[FS_INDEX_MAX_FILES];
+static uint16_t _fs_index_count;
+static uint8_t _fs_index_complete;
+static struct fs_index_stats _fs_index_stats;
+
+/* FNV-1a */
+static uint32_t _fs_name_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    
+    while (*name)
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+
+static void _fs_index_add(uint16_t pg, const struct file_hdr_with_name *buffer)
+{
+    const struct file_hdr *hdr = &buffer->hdr;
+    struct fs_index_entry *ent;
+    uint32_t hash = _fs_name_hash(buffer->name);
+    uint8_t flags = 0;
+
+    /* the scan can only match these on a truncated name, so leave them to it */
+    if (hdr->filename_len > MAX_FILENAME_LEN)
+    {
+        _fs_index_complete = 0;
+        return;
+    }
+    
+    if (_fs_index_count == FS_INDEX_MAX_FILES)
+    {
+        if (_fs_index_complete)
+            KERN_LOG("flash", APP_LOG_LEVEL_WARNING, "more than %d files; name index is incomplete", FS_INDEX_MAX_FILES);
+        _fs_index_complete = 0;
+        return;
+    }
+    
+    for (int i = 0; i < _fs_index_count; i++)
+        if (_fs_index[i].hash == hash)
+        {
+            _fs_index[i].flags |= FS_INDEX_COLLISION;
+            flags |= FS_INDEX_COLLISION;
+        }
+    
+    ent = &_fs_index[_fs_index_count++];
+    ent->hash = hash;
+    ent->size = hdr->file_size;
+    ent->startpage = pg;
+    ent->startpofs = sizeof(struct file_hdr) + hdr->filename_len;
+    ent->flags = flags;
+}
+
+/* Page maps for multi-page files, so that fs_seek can go straight to the
+ * right page instead of walking the next_page chain from the start of the
+ * file.  A map is built the first time a file is opened, and the least
+ * recently used one is thrown away to make room for a new one.  Offsets
+ * past the end of a map (files bigger than FS_PAGEMAP_MAX_PAGES pages)
+ * still get walked, but from the last mapped page.  */
+#define FS_PAGEMAP_SLOTS 4
+#define FS_PAGEMAP_MAX_PAGES 64
+
+/* bytes of file data in the first page and in each following page */
+#define FS_FIRST_PAGE_BYTES(file) (REGION_FS_PAGE_SIZE - (file)->startpofs)
+#define FS_PAGE_BYTES (REGION_FS_PAGE_SIZE - sizeof(struct page_hdr))
+
+struct fs_pagemap {
+    uint16_t startpage; /* 0xFFFF if the slot is free */
+    uint16_t npages;
+    uint32_t last_used;
+    uint16_t pages[FS_PAGEMAP_MAX_PAGES];
+};
+
+static struct fs_pagemap _fs_pagemap[FS_PAGEMAP_SLOTS];
+static uint32_t _fs_pagemap_clock;
+static SemaphoreHandle_t _fs_pagemap_mutex;
+static StaticSemaphore_t _fs_pagemap_mutex_buf;
+
+static uint8_t _fs_pagemap_lock(void)
+{
+    if (rebbleos_get_system_status() != SYSTEM_STATUS_STARTED)
+        return 0;
+    
+    xSemaphoreTake(_fs_pagemap_mutex, portMAX_DELAY);
+    return 1;
+}
+
+static void _fs_pagemap_unlock(uint8_t locked)
+{
+    if (locked)
+        xSemaphoreGive(_fs_pagemap_mutex);
+}
+
+static void _fs_pagemap_reset(void)
+{
+    if (!_fs_pagemap_mutex)
+        _fs_pagemap_mutex = xSemaphoreCreateMutexStatic(&_fs_pagemap_mutex_buf);
+    
+    for (int i = 0; i < FS_PAGEMAP_SLOTS; i++)
+        _fs_pagemap[i].startpage = 0xFFFF;
+    _fs_pagemap_clock = 0;
+}
+
+/* call with the pagemap lock held */
+static struct fs_pagemap *_fs_pagemap_find(uint16_t startpage)
+{
+    for (int i = 0; i < FS_PAGEMAP_SLOTS; i++)
+        if (_fs_pagemap[i].startpage == startpage)
+        {
+            _fs_pagemap[i].last_used = ++_fs_pagemap_clock;
+            return &_fs_pagemap[i];
+        }
+    
+    return NULL;
+}
+
+/*
+ * Build the page map for a file, if it spans more than one page and
+ * doesn't have one already.
+ */
+static void _fs_pagemap_build(const struct file *file)
+{
+    struct fs_pagemap *map;
+    struct page_hdr hdr;
+    uint16_t npages;
+    uint8_t locked;
+    
+    if (file->size <= FS_FIRST_PAGE_BYTES(file))
+        return;
+    
+    npages = 1 + (file->size - FS_FIRST_PAGE_BYTES(file) + FS_PAGE_BYTES - 1) / FS_PAGE_BYTES;
+    if (npages > FS_PAGEMAP_MAX_PAGES)
+        npages = FS_PAGEMAP_MAX_PAGES;
+    
+    locked = _fs_pagemap_lock();
+    if (_fs_pagemap_find(file->startpage))
+    {
+        _fs_pagemap_unlock(locked);
+        return;
+    }
+    
+    map = &_fs_pagemap[0];
+    for (int i = 1; i < FS_PAGEMAP_SLOTS; i++)
+        if (_fs_pagemap[i].last_used < map->last_used)
+            map = &_fs_pagemap[i];
+    
+    map->pages[0] = file->startpage;
+    for (int i = 1; i < npages; i++)
+    {
+        _fs_read_page_ofs(map->pages[i - 1], 0, &hdr, sizeof(hdr));
+        if (hdr.next_page >= REGION_FS_N_PAGES)
+        {
+            KERN_LOG("flash", APP_LOG_LEVEL_ERROR, "file at page %d has a broken page chain at page %d", file->startpage, map->pages[i - 1]);
+            npages = i;
+            break;
+        }
+        map->pages[i] = hdr.next_page;
+    }
+    
+    map->startpage = file->startpage;
+    map->npages = npages;
+    map->last_used = ++_fs_pagemap_clock;
+    _fs_pagemap_unlock(locked);
+}
+
+/*
+ * Point an fd at the given offset using the file's page map.  Returns 0 if
+ * there's no map, or the offset is past the end of it.
+ */
+static int _fs_pagemap_seek(struct fd *fd, size_t offset)
+{
+    struct fs_pagemap *map;
+    size_t first = FS_FIRST_PAGE_BYTES(&fd->file);
+    size_t idx, pofs;
+    uint8_t locked;
+    int rv = 0;
+    
+    if (offset < first)
+    {
+        idx = 0;
+        pofs = fd->file.startpofs + offset;
+    }
+    else
+    {
+        idx = 1 + (offset - first) / FS_PAGE_BYTES;
+        pofs = sizeof(struct page_hdr) + (offset - first) % FS_PAGE_BYTES;
+    }
+    
+    locked = _fs_pagemap_lock();
+    map = _fs_pagemap_find(fd->file.startpage);
+    if (map && idx < map->npages)
+    {
+        fd->curpage = map->pages[idx];
+        fd->curpofs = pofs;
+        fd->offset = offset;
+        rv = 1;
+    }
+    else if (map && map->npages > 1)
+    {
+        /* past the end of the map; walk the rest from its last page */
+        size_t lastofs = first + (map->npages - 2) * FS_PAGE_BYTES;
+        
+        if (fd->offset < lastofs || fd->offset > offset)
+        {
+            fd->curpage = map->pages[map->npages - 1];
+            fd->curpofs = sizeof(struct page_hdr);
+            fd->offset = lastofs;
+        }
+    }
+    _fs_pagemap_unlock(locked);
+    
+    return rv;
+}
+
 void fs_init()
 {
     /* Do a basic integrity check to see if there's any cleanup that needs
@@ -121,6 +358,10 @@ void fs_init()
     KERN_LOG("flash", APP_LOG_LEVEL_INFO, "doing basic filesystem check");
     _fs_valid = 1;
     memset(&_fs_page_flags, 0, sizeof(_fs_page_flags));
+    _fs_index_count = 0;
+    _fs_index_complete = 1;
+    _fs_pagemap_reset();
+    memset(&_fs_index_stats, 0, sizeof(_fs_index_stats));
 
     /* Make sure that at least the first page has the header of the right
      * version.  There might be pages with missing headers later, and we can
@@ -196,9 +437,11 @@ void fs_init()
             continue;
         
         _fs_set_page_state(pg, PageStateFileStart);
+        _fs_index_add(pg, &buffer);
     }
     
     KERN_LOG("flash", APP_LOG_LEVEL_INFO, "checked %d pages, and it's good enough to read, at least", pg);
+    KERN_LOG("flash", APP_LOG_LEVEL_INFO, "indexed %d files", _fs_index_count);
     
     /* test it out some ... */
     struct file file;
@@ -217,12 +460,62 @@ void fs_init()
     
 }
 
+/*
+ * Look a name up in the RAM index.  Returns 1 if found, 0 if the file
+ * definitely doesn't exist, and -1 if we have to go ask the flash.
+ */
+static int _fs_index_find(struct file *file, const char *name)
+{
+    uint32_t hash = _fs_name_hash(name);
+    size_t len = strlen(name);
+    int rv = _fs_index_complete ? 0 : -1;
+    char stored[MAX_FILENAME_LEN];
+
+    if (len > MAX_FILENAME_LEN)
+        return -1;
+    
+    for (int i = 0; i < _fs_index_count; i++)
+    {
+        struct fs_index_entry *ent = &_fs_index[i];
+        
+        if (ent->hash != hash || ent->startpofs != sizeof(struct file_hdr) + len)
+            continue;
+        
+        if (ent->flags & FS_INDEX_COLLISION)
+            return -1;
+        
+        /* only one live file has this hash, so if it isn't us, we aren't here */
+        _fs_read_page_ofs(ent->startpage, sizeof(struct file_hdr), stored, len);
+        if (memcmp(stored, name, len))
+            return rv;
+        
+        file->startpage = ent->startpage;
+        file->size = ent->size;
+        file->startpofs = ent->startpofs;
+        return 1;
+    }
+    
+    return rv;
+}
+
 int fs_find_file(struct file *file, const char *name)
 {
     /* no need to say it -- they already heard it at init time ... */
     if (!_fs_valid)
         return -1;
 
+    switch (_fs_index_find(file, name))
+    {
+    case 1:
+        _fs_index_stats.hits++;
+        return 0;
+    case 0:
+        _fs_index_stats.misses++;
+        return -1;
+    }
+    
+    _fs_index_stats.fallbacks++;
+
     struct file_hdr_with_name buffer;
     struct file_hdr *hdr = &buffer.hdr;
 
@@ -243,6 +536,11 @@ int fs_find_file(struct file *file, const char *name)
     return -1;
 }
 
+void fs_get_index_stats(struct fs_index_stats *stats)
+{
+    *stats = _fs_index_stats;
+}
+
 void fs_open(struct fd *fd, const struct file *file)
 {
     fd->file = *file;
@@ -251,9 +549,16 @@ void fs_open(struct fd *fd, const struct file *file)
     fd->curpofs = fd->file.startpofs;
     
     fd->offset  = 0;
+    
+    _fs_pagemap_build(&fd->file);
 }
 
-int fs_read(struct fd *fd, void *p, size_t bytes)
+static void _fs_read_done(void *ctx)
+{
+    xSemaphoreGive((SemaphoreHandle_t)ctx);
+}
+
+static int _fs_read(struct fd *fd, void *p, size_t bytes, SemaphoreHandle_t done)
 {
     size_t bytesrem;
     
@@ -268,7 +573,11 @@ int fs_read(struct fd *fd, void *p, size_t bytes)
         if (n > (REGION_FS_PAGE_SIZE - fd->curpofs))
             n = REGION_FS_PAGE_SIZE - fd->curpofs;
         
-        _fs_read_page_ofs(fd->curpage, fd->curpofs, p, n);
+        if (done && flash_read_bytes_async(REGION_FS_START + fd->curpage * REGION_FS_PAGE_SIZE + fd->curpofs,
+                                           p, n, _fs_read_done, done) == 0)
+            xSemaphoreTake(done, portMAX_DELAY);
+        else
+            _fs_read_page_ofs(fd->curpage, fd->curpofs, p, n);
         
         fd->curpofs += n;
         fd->offset += n;
@@ -288,6 +597,27 @@ int fs_read(struct fd *fd, void *p, size_t bytes)
     return bytes;
 }
 
+int fs_read(struct fd *fd, void *p, size_t bytes)
+{
+    return _fs_read(fd, p, bytes, NULL);
+}
+
+/*
+ * As fs_read, but each page's worth is copied by the flash thread (with
+ * DMA, where there is some) while we sleep, so other threads get the CPU
+ * in the meantime. For big reads, like loading an app
+ */
+int fs_read_wait(struct fd *fd, void *p, size_t bytes)
+{
+    StaticSemaphore_t done_buf;
+    SemaphoreHandle_t done = xSemaphoreCreateBinaryStatic(&done_buf);
+    int n = _fs_read(fd, p, bytes, done);
+    
+    vSemaphoreDelete(done);
+    
+    return n;
+}
+
 long fs_seek(struct fd *fd, long ofs, enum seek whence)
 {
     size_t newoffset;
@@ -301,6 +631,9 @@ long fs_seek(struct fd *fd, long ofs, enum seek whence)
     if (newoffset > fd->file.size)
         newoffset = fd->file.size;
     
+    if (_fs_pagemap_seek(fd, newoffset))
+        return fd->offset;
+    
     if (newoffset < fd->offset)
     {
         fd->curpage = fd->file.startpage;
@@ -332,3 +665,18 @@ long fs_seek(struct fd *fd, long ofs, enum seek whence)
     
     return fd->offset;
 }
+
+/*
+ * Where in flash the next n bytes of the file live, or 0 if they run on
+ * into another page, and so aren't in one piece
+ */
+uint32_t fs_get_flash_address(struct fd *fd, size_t n)
+{
+    if (n > (fd->file.size - fd->offset))
+        return 0;
+    
+    if (n > (REGION_FS_PAGE_SIZE - fd->curpofs))
+        return 0;
+    
+    return REGION_FS_START + fd->curpage * REGION_FS_PAGE_SIZE + fd->curpofs;
+}
@@ -23,6 +23,14 @@ struct fd {
     size_t offset;
 };
 
+/* fs_find_file name index counters; a hit or miss is answered from RAM,
+ * a fallback had to scan the flash */
+struct fs_index_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t fallbacks;
+};
+
 enum seek {
     FS_SEEK_SET,
     FS_SEEK_CUR,
@@ -31,7 +39,10 @@ enum seek {
 
 void fs_init();
 int fs_find_file(struct file *file, const char *name);
+void fs_get_index_stats(struct fs_index_stats *stats);
 void fs_open(struct fd *fd, const struct file *file);
 int fs_read(struct fd *fd, void *p, size_t n);
+int fs_read_wait(struct fd *fd, void *p, size_t n);
 long fs_seek(struct fd *fd, long ofs, enum seek whence);
+uint32_t fs_get_flash_address(struct fd *fd, size_t n);
 
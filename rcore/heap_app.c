@@ -301,7 +301,7 @@ BlockLink_t *pxFirstFreeBlock;
 uint8_t *pucAlignedHeap;
 size_t uxAddress;
 
-printf("CALLOC INIT %x %d\n",(unsigned int)e_app_stack_heap, (int)xTotalHeapSize);
+printf("CALLOC INIT %p %d\n", e_app_stack_heap, (int)xTotalHeapSize);
 	/* Ensure the heap starts on a correctly aligned boundary. */
 	uxAddress = ( size_t ) e_app_stack_heap;
 
@@ -6,7 +6,6 @@
  */
 
 #include "rebbleos.h"
-#include "stm32_power.h"
 
 static SemaphoreHandle_t _log_mutex = NULL;
 static StaticSemaphore_t _log_mutex_buf;
@@ -104,7 +103,12 @@ void log_printf(const char *layer, const char *module, uint8_t level, const char
     _log_pad_string(tbuf, buf + INT_LEN + LEVEL_LEN + LAYER_LEN + MODULE_LEN + FILENM_LEN - 1, LINENO_LEN + 1);
     snprintf(buf + INT_LEN + LEVEL_LEN + LAYER_LEN + MODULE_LEN + FILENM_LEN + LINENO_LEN - 1, 3, "] ");
 
+#ifdef REBBLE_PLATFORM_SIM
+    /* no minilib on the host; its libc formats the same way */
+    vsnprintf(buf + INT_LEN + LEVEL_LEN + LAYER_LEN + MODULE_LEN + FILENM_LEN + LINENO_LEN + 1, 128, fmt, ar);
+#else
     vsfmt(buf + INT_LEN + LEVEL_LEN + LAYER_LEN + MODULE_LEN + FILENM_LEN + LINENO_LEN + 1, 128, fmt, ar);
+#endif
 
     printf(buf);
     printf("\n");
@@ -5,6 +5,8 @@
  * Author: Barry Carter <barry.carter@gmail.com>
  */
 
+#include "rebbleos.h"
+#include "platform.h"
 #include "power.h"
 
 void power_init()
@@ -20,3 +22,30 @@ uint16_t power_get_battery_level(void)
 {
     return 0;
 }
+
+/*
+ * How long we have spent in tickless idle sleep, and how long awake,
+ * since boot
+ */
+void power_get_sleep_stats(uint32_t *asleep_ms, uint32_t *awake_ms)
+{
+    uint32_t sleeps = 0, asleep_ticks = 0;
+    
+#ifdef HW_RTC_HAS_TICKLESS
+    rtc_get_sleep_stats(&sleeps, &asleep_ticks);
+#endif
+    
+    *asleep_ms = asleep_ticks * portTICK_PERIOD_MS;
+    *awake_ms = (xTaskGetTickCount() - asleep_ticks) * portTICK_PERIOD_MS;
+}
+
+void power_dump_sleep_stats(void)
+{
+    uint32_t asleep_ms, awake_ms, total_ms;
+    
+    power_get_sleep_stats(&asleep_ms, &awake_ms);
+    total_ms = asleep_ms + awake_ms;
+    
+    KERN_LOG("power", APP_LOG_LEVEL_INFO, "%d ms asleep, %d ms awake (%d%% asleep)",
+             asleep_ms, awake_ms, total_ms ? (int)((uint64_t)asleep_ms * 100 / total_ms) : 0);
+}
@@ -11,3 +11,5 @@
 void power_init();
 void power_off();
 uint16_t power_get_battery_level(void);
+void power_get_sleep_stats(uint32_t *asleep_ms, uint32_t *awake_ms);
+void power_dump_sleep_stats(void);
@@ -76,21 +76,35 @@ bool rblos_memory_sanity_check_app(size_t size)
     return true;
 }
 
-void *app_malloc(size_t size)
+/*
+ * Allocate from the app heap. When it's short, idle cached resources
+ * are given up to make room before we fail
+ */
+static void *_app_alloc(size_t size)
 {
+    if (size > xPortGetFreeAppHeapSize())
+        resource_cache_reclaim(size);
+    
     if(!rblos_memory_sanity_check_app(size))
         return NULL;
     
-    return (void*)pvPortAppMalloc(size);
+    void *x = (void*)pvPortAppMalloc(size);
     
+    // enough free, but not in one piece
+    while (x == NULL && resource_cache_reclaim(size))
+        x = (void*)pvPortAppMalloc(size);
+    
+    return x;
+}
+
+void *app_malloc(size_t size)
+{
+    return _app_alloc(size);
 }
 
 void *app_calloc(size_t count, size_t size)
 {
-    if(!rblos_memory_sanity_check_app(size))
-        return NULL;
-    
-    void *x = (void*)pvPortAppMalloc(count * size);
+    void *x = _app_alloc(count * size);
     
     if (x != NULL)
         memset(x, 0, count * size);
@@ -20,6 +20,13 @@ void rcore_time_init(void)
     _boot_ticks = xTaskGetTickCount();
     tm = hw_get_time();
     _boot_time_t = rcore_mktime(tm);
+    
+#ifndef REBBLE_PLATFORM_SIM
+    /* start the cycle counter for rcore_cycles */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
 }
 
 time_t rcore_mktime(struct tm *tm)
@@ -37,7 +44,8 @@ void rcore_time_ms(time_t *tutc, uint16_t *ms)
     TickType_t ticks_since_boot = xTaskGetTickCount() - _boot_ticks;
     
     *tutc = _boot_time_t + ticks_since_boot / configTICK_RATE_HZ;
-    *ms = (ticks_since_boot % configTICK_RATE_HZ) * 1000 / configTICK_RATE_HZ;
+    if (ms)
+        *ms = (ticks_since_boot % configTICK_RATE_HZ) * 1000 / configTICK_RATE_HZ;
 }
 
 TickType_t rcore_time_to_ticks(time_t t, uint16_t ms) {
@@ -46,6 +54,29 @@ TickType_t rcore_time_to_ticks(time_t t, uint16_t ms) {
     return (t - _boot_time_t) * configTICK_RATE_HZ + pdMS_TO_TICKS(ms);
 }
 
+/*
+ * A free running count of CPU cycles, for timing things shorter than a
+ * tick. It wraps every 2^32 cycles (25s at 168MHz), so only take the
+ * difference of two close together, and hand that to rcore_cycles_to_us.
+ */
+uint32_t rcore_cycles(void)
+{
+#ifdef REBBLE_PLATFORM_SIM
+    /* no DWT on the host; count SystemCoreClock cycles off its clock */
+    struct timespec t;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint32_t)(t.tv_sec * SystemCoreClock + (uint64_t)t.tv_nsec * (SystemCoreClock / 1000000) / 1000);
+#else
+    return DWT->CYCCNT;
+#endif
+}
+
+uint32_t rcore_cycles_to_us(uint32_t cycles)
+{
+    return cycles / (SystemCoreClock / 1000000);
+}
+
 size_t rcore_strftime(char* buffer, size_t maxSize, const char* format, const struct tm* tm) {
     return strftime(buffer, maxSize, format, tm);
 }
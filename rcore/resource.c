@@ -13,9 +13,45 @@ extern size_t xPortGetFreeAppHeapSize(void);
 
 uint32_t _resource_get_app_res_slot_address(const struct file *file);
 
+/*
+ * Resource cache
+ * 
+ * Loaded resources are kept in the app heap and shared. Apps tend to
+ * create the same bitmaps and fonts each time a window is pushed, and a
+ * hit saves reading the whole thing out of flash again.
+ * An entry is busy while anyone holds a reference. Once released it stays
+ * around idle until its slot is wanted, or the app heap runs short (see
+ * app_malloc) and it gets evicted, oldest first.
+ * System resources are keyed with a startpage that no file can have.
+ * Bitmaps and fonts come through resource_map_res_*, which only copies
+ * into the cache what can't be used straight out of flash and is small
+ * enough to be worth keeping. Anything bigger is streamed by its loader
+ */
+#define RESOURCE_CACHE_ENTRIES  8
+#define RESOURCE_CACHE_SYSTEM   0xFFFF
+#define RESOURCE_CACHE_MAX_SIZE 4096
+
+typedef struct resource_cache_entry_t {
+    uint8_t *buffer;
+    uint16_t startpage;
+    uint32_t offset;
+    uint32_t size;
+    uint16_t refcount;
+    uint32_t last_used;
+} resource_cache_entry_t;
+
+static resource_cache_entry_t _resource_cache[RESOURCE_CACHE_ENTRIES];
+static uint32_t _resource_cache_clock;
+static ResourceCacheStats _resource_cache_stats;
+
+static void _resource_cache_evict(resource_cache_entry_t *entry);
+static uint8_t *_resource_acquire(ResHandle res_handle, const struct file *file);
+static const uint8_t *_resource_try_map_res_system(ResHandle res_handle);
+static const uint8_t *_resource_try_map_res_app(ResHandle res_handle, const struct file *file);
+
 void resource_init()
 {
-
+    resource_cache_flush();
 }
 
 /*
@@ -31,7 +67,7 @@ void resource_load_id_system(uint16_t resource_id, uint8_t *buffer)
     }
     handle = resource_get_handle_system(resource_id);
 
-    flash_read_bytes(REGION_RES_START + RES_START + handle.offset, buffer, handle.size);
+    flash_read_bytes_wait(REGION_RES_START + RES_START + handle.offset, buffer, handle.size);
 }
 
 /*
@@ -113,7 +149,7 @@ void resource_load_app(ResHandle resource_handle, uint8_t *buffer, const struct
     struct fd fd;
     fs_open(&fd, file);
     fs_seek(&fd, APP_RES_START + resource_handle.offset + ofs, FS_SEEK_SET);
-    fs_read(&fd, buffer, resource_handle.size);
+    fs_read_wait(&fd, buffer, resource_handle.size);
     return;
 }
 
@@ -158,7 +194,7 @@ void resource_load_system(ResHandle resource_handle, uint8_t *buffer)
         KERN_LOG("resou", APP_LOG_LEVEL_ERROR, "Ress: malloc fail. Not enough heap for %d", resource_handle.size);
         return;
     }
-    flash_read_bytes(REGION_RES_START + RES_START + resource_handle.offset, buffer, resource_handle.size);
+    flash_read_bytes_wait(REGION_RES_START + RES_START + resource_handle.offset, buffer, resource_handle.size);
 }
 
 /*
@@ -189,7 +225,7 @@ bool _resource_is_sane(ResHandle res_handle)
         return false;
     }
     
-    if (sz > xPortGetFreeAppHeapSize())
+    if (sz > xPortGetFreeAppHeapSize() && !resource_cache_reclaim(sz))
     {
         KERN_LOG("resou", APP_LOG_LEVEL_ERROR, "Res: malloc fail. Not enough heap for %d", sz);
         return false;
@@ -247,6 +283,268 @@ uint8_t *resource_fully_load_res_app(ResHandle res_handle, const struct file *fi
     resource_load_app(res_handle, buffer, file);
     return buffer;
 }
+
+/*
+ * Get a shared, read only copy of a resource, loading it if it isn't
+ * cached. Hand it back with resource_release when done
+ */
+uint8_t *resource_acquire_res_system(ResHandle res_handle)
+{
+    return _resource_acquire(res_handle, NULL);
+}
+
+uint8_t *resource_acquire_res_app(ResHandle res_handle, const struct file *file)
+{
+    return _resource_acquire(res_handle, file);
+}
+
+static uint8_t *_resource_acquire(ResHandle res_handle, const struct file *file)
+{
+    uint16_t startpage = file ? file->startpage : RESOURCE_CACHE_SYSTEM;
+    resource_cache_entry_t *slot = NULL;
+
+    for (uint8_t i = 0; i < RESOURCE_CACHE_ENTRIES; i++)
+    {
+        resource_cache_entry_t *entry = &_resource_cache[i];
+        if (entry->buffer && entry->startpage == startpage &&
+            entry->offset == res_handle.offset && entry->size == res_handle.size)
+        {
+            entry->refcount++;
+            entry->last_used = ++_resource_cache_clock;
+            _resource_cache_stats.hits++;
+            return entry->buffer;
+        }
+    }
+    _resource_cache_stats.misses++;
+
+    uint8_t *buffer = file ? resource_fully_load_res_app(res_handle, file)
+                           : resource_fully_load_res_system(res_handle);
+    if (buffer == NULL)
+        return NULL;
+
+    /* 
+     * Find it a home. Done after the load, as loading may have evicted
+     * things. If everything is busy it just goes uncached
+     */
+    for (uint8_t i = 0; i < RESOURCE_CACHE_ENTRIES; i++)
+    {
+        resource_cache_entry_t *entry = &_resource_cache[i];
+        if (entry->refcount)
+            continue;
+        if (!entry->buffer)
+        {
+            slot = entry;
+            break;
+        }
+        if (!slot || entry->last_used < slot->last_used)
+            slot = entry;
+    }
+
+    if (slot)
+    {
+        if (slot->buffer)
+            _resource_cache_evict(slot);
+        slot->buffer = buffer;
+        slot->startpage = startpage;
+        slot->offset = res_handle.offset;
+        slot->size = res_handle.size;
+        slot->refcount = 1;
+        slot->last_used = ++_resource_cache_clock;
+        _resource_cache_stats.bytes += res_handle.size;
+    }
+
+    return buffer;
+}
+
+/*
+ * Drop a reference to a resource from resource_acquire_*.
+ * Buffers that didn't make it into the cache are freed
+ */
+void resource_release(uint8_t *buffer)
+{
+    if (buffer == NULL)
+        return;
+
+    for (uint8_t i = 0; i < RESOURCE_CACHE_ENTRIES; i++)
+    {
+        if (_resource_cache[i].buffer == buffer)
+        {
+            if (_resource_cache[i].refcount)
+                _resource_cache[i].refcount--;
+            return;
+        }
+    }
+
+    app_free(buffer);
+}
+
+/*
+ * Read part of a resource, without loading the rest of it
+ */
+void resource_read_res_system(ResHandle res_handle, uint32_t offset, uint8_t *buffer, size_t length)
+{
+    if (offset >= res_handle.size)
+        return;
+    if (length > res_handle.size - offset)
+        length = res_handle.size - offset;
+    
+    flash_read_bytes(REGION_RES_START + RES_START + res_handle.offset + offset, buffer, length);
+}
+
+void resource_read_res_app(ResHandle res_handle, const struct file *file, uint32_t offset, uint8_t *buffer, size_t length)
+{
+    struct fd fd;
+    
+    fs_open(&fd, file);
+    resource_read_res_app_fd(res_handle, &fd, offset, buffer, length);
+}
+
+/*
+ * As resource_read_res_app, but through the app's resource file that the
+ * caller already has open, so many small reads don't each open it again
+ */
+void resource_read_res_app_fd(ResHandle res_handle, struct fd *fd, uint32_t offset, uint8_t *buffer, size_t length)
+{
+    if (offset >= res_handle.size)
+        return;
+    if (length > res_handle.size - offset)
+        length = res_handle.size - offset;
+    
+    fs_seek(fd, APP_RES_START + res_handle.offset + 0xC + offset, FS_SEEK_SET);
+    fs_read(fd, buffer, length);
+}
+
+/*
+ * Get a read only pointer straight into flash for a resource, if the flash
+ * is memory mapped and the resource is in one piece there. It costs no heap
+ * and no time to load, but the flash stays powered up until it is handed
+ * back (see hw_flash_map), so don't hold on to it for longer than needed.
+ * Returns NULL if it can't be done.
+ * Hand it back with resource_unmap
+ */
+static const uint8_t *_resource_try_map_res_system(ResHandle res_handle)
+{
+    /* system resources are one contiguous region */
+    const uint8_t *data = flash_map(REGION_RES_START + RES_START + res_handle.offset, res_handle.size);
+    
+    if (data)
+        _resource_cache_stats.maps++;
+    
+    return data;
+}
+
+static const uint8_t *_resource_try_map_res_app(ResHandle res_handle, const struct file *file)
+{
+    struct fd fd;
+    uint32_t address;
+    const uint8_t *data = NULL;
+    
+    /* only if it doesn't cross an fs page, as each starts with a header */
+    fs_open(&fd, file);
+    fs_seek(&fd, APP_RES_START + res_handle.offset + 0xC, FS_SEEK_SET);
+    address = fs_get_flash_address(&fd, res_handle.size);
+    if (address)
+        data = flash_map(address, res_handle.size);
+    
+    if (data)
+        _resource_cache_stats.maps++;
+    
+    return data;
+}
+
+/*
+ * Get a read only pointer to a resource. Mapped straight out of flash if
+ * it can be, or a shared copy as from resource_acquire_* if not and it is
+ * no bigger than RESOURCE_CACHE_MAX_SIZE. Returns NULL for anything else;
+ * read it a bit at a time instead.
+ * Either way, hand it back with resource_unmap
+ */
+const uint8_t *resource_map_res_system(ResHandle res_handle)
+{
+    const uint8_t *data = _resource_try_map_res_system(res_handle);
+    
+    if (data || res_handle.size > RESOURCE_CACHE_MAX_SIZE)
+        return data;
+    
+    return resource_acquire_res_system(res_handle);
+}
+
+const uint8_t *resource_map_res_app(ResHandle res_handle, const struct file *file)
+{
+    const uint8_t *data = _resource_try_map_res_app(res_handle, file);
+    
+    if (data || res_handle.size > RESOURCE_CACHE_MAX_SIZE)
+        return data;
+    
+    return resource_acquire_res_app(res_handle, file);
+}
+
+void resource_unmap(const uint8_t *data)
+{
+    if (data == NULL)
+        return;
+    
+    if (!flash_unmap(data))
+        resource_release((uint8_t *)data);
+}
+
+static void _resource_cache_evict(resource_cache_entry_t *entry)
+{
+    app_free(entry->buffer);
+    _resource_cache_stats.bytes -= entry->size;
+    _resource_cache_stats.evictions++;
+    entry->buffer = NULL;
+}
+
+/*
+ * The app heap is short of space for an allocation of size. Evict idle
+ * resources, oldest first, until there's enough free (or, if there was
+ * already, as it's too fragmented, just the oldest one).
+ * Returns false if there was nothing to evict
+ */
+bool resource_cache_reclaim(size_t size)
+{
+    bool evicted = false;
+
+    do
+    {
+        resource_cache_entry_t *victim = NULL;
+        for (uint8_t i = 0; i < RESOURCE_CACHE_ENTRIES; i++)
+        {
+            resource_cache_entry_t *entry = &_resource_cache[i];
+            if (entry->buffer && !entry->refcount &&
+                (!victim || entry->last_used < victim->last_used))
+                victim = entry;
+        }
+        if (!victim)
+            break;
+
+        _resource_cache_evict(victim);
+        evicted = true;
+    } while (size > xPortGetFreeAppHeapSize());
+
+    return evicted;
+}
+
+/*
+ * Forget everything. Only for when the app heap is about to be reset,
+ * as nothing is freed
+ */
+void resource_cache_flush(void)
+{
+    if (_resource_cache_stats.hits || _resource_cache_stats.misses || _resource_cache_stats.maps)
+        KERN_LOG("resou", APP_LOG_LEVEL_INFO, "Res cache: %d hits %d misses %d evicted %d mapped",
+                 _resource_cache_stats.hits, _resource_cache_stats.misses,
+                 _resource_cache_stats.evictions, _resource_cache_stats.maps);
+
+    memset(_resource_cache, 0, sizeof(_resource_cache));
+    memset(&_resource_cache_stats, 0, sizeof(_resource_cache_stats));
+}
+
+void resource_cache_get_stats(ResourceCacheStats *stats)
+{
+    *stats = _resource_cache_stats;
+}
     
 
 
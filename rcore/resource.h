@@ -6,9 +6,19 @@
  * Author: Barry Carter <barry.carter@gmail.com>
  */
 
+#include <stdbool.h>
 #include "graphics_reshandle.h"
 
 struct file;
+struct fd;
+
+typedef struct ResourceCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t maps; // handed out straight from flash, no copy
+    size_t bytes; // held by the cache, busy or idle
+} ResourceCacheStats;
 
 void resource_init();
 void resource_load_id_system(uint16_t resource_id, uint8_t *buffer);
@@ -21,3 +31,15 @@ uint8_t *resource_fully_load_id_app(uint16_t resource_id, const struct file *fil
 uint8_t *resource_fully_load_id_system(uint16_t resource_id);
 uint8_t *resource_fully_load_res_system(ResHandle res_handle);
 uint8_t *resource_fully_load_res_app(ResHandle res_handle, const struct file *file);
+uint8_t *resource_acquire_res_system(ResHandle res_handle);
+uint8_t *resource_acquire_res_app(ResHandle res_handle, const struct file *file);
+void resource_release(uint8_t *buffer);
+void resource_read_res_system(ResHandle res_handle, uint32_t offset, uint8_t *buffer, size_t length);
+void resource_read_res_app(ResHandle res_handle, const struct file *file, uint32_t offset, uint8_t *buffer, size_t length);
+void resource_read_res_app_fd(ResHandle res_handle, struct fd *fd, uint32_t offset, uint8_t *buffer, size_t length);
+const uint8_t *resource_map_res_system(ResHandle res_handle);
+const uint8_t *resource_map_res_app(ResHandle res_handle, const struct file *file);
+void resource_unmap(const uint8_t *data);
+bool resource_cache_reclaim(size_t size);
+void resource_cache_flush(void);
+void resource_cache_get_stats(ResourceCacheStats *stats);
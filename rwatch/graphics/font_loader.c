@@ -16,17 +16,76 @@ uint16_t _fonts_get_resource_id_for_key(const char *key);
 
 GFont fonts_get_system_font_by_resource_id(uint32_t resource_id);
 
+/*
+ * Fonts are used straight out of flash where it's memory mapped, and small
+ * ones are shared out of the resource cache. Other fonts are streamed: only
+ * the header and hash table are loaded, and glyphs are read in as they are
+ * drawn, so a font costs the app a couple of KB rather than the whole
+ * thing. The stream remembers where to read from, and keeps an app's
+ * resource file open so a glyph miss is just a seek and a read
+ */
+typedef struct GFontSource
+{
+    ResHandle handle;
+    struct fd fd;
+    bool is_app;
+} GFontSource;
+
+/*
+ * System fonts are cached so they aren't loaded over and over. The cache
+ * lives in the app heap along with the fonts, so it is flushed with it.
+ * Apps never give system fonts back, so nothing is evicted; there are only
+ * so many system fonts, and each is loaded once at most.
+ * A mapped font keeps the flash clocked for as long as it is cached, which
+ * is the rest of the app's life (see hw_flash_map on snowy)
+ */
 typedef struct GFontCache
 {
+    list_node node;
     uint32_t resource_id;
     GFont font;
 } GFontCache;
 
-static GFontCache _cached_fonts[5];
-static uint8_t _cached_count = 0;
+static list_head _cached_fonts = LIST_HEAD(_cached_fonts);
+
+static void _fonts_read(void *context, uint32_t offset, void *buffer, size_t length)
+{
+    GFontSource *source = (GFontSource *)context;
+    
+    if (source->is_app)
+        resource_read_res_app_fd(source->handle, &source->fd, offset, buffer, length);
+    else
+        resource_read_res_system(source->handle, offset, buffer, length);
+}
+
+static GFont _fonts_load(ResHandle handle, const struct file *file)
+{
+    GFontSource source = { .handle = handle, .is_app = (file != NULL) };
+    const uint8_t *data = file ? resource_map_res_app(handle, file)
+                               : resource_map_res_system(handle);
+    
+    if (data)
+        return (GFont)data;
+    
+    if (file)
+        fs_open(&source.fd, file);
+    
+    return (GFont)n_graphics_font_stream_create(_fonts_read, &source, sizeof(GFontSource), app_malloc);
+}
+
+static void _fonts_unload(GFont font)
+{
+    if (n_graphics_font_is_stream(font))
+    {
+        n_graphics_font_stream_destroy(font, app_free);
+        return;
+    }
+    
+    n_graphics_font_cache_flush(font);
+    resource_unmap((const uint8_t *)font);
+}
 
 // get a system font and then cache it. Ugh.
-// TODO make this not suck (RAM)
 GFont fonts_get_system_font(const char *font_key)
 {
     uint16_t res_id = _fonts_get_resource_id_for_key(font_key);
@@ -36,46 +95,61 @@ GFont fonts_get_system_font(const char *font_key)
 
 /*
  * Load a system font from the resource table
- * Will save into a cheesey cache so it isn't loaded over and over.
  */
 GFont fonts_get_system_font_by_resource_id(uint32_t resource_id)
 {
-    if (_cached_count == 0)
+    GFontCache *cached;
+    
+    list_foreach(cached, &_cached_fonts, GFontCache, node)
     {
-        for (uint8_t i = 0; i < 5; i++)
-            _cached_fonts[i].resource_id = 0;
+        if (cached->resource_id == resource_id)
+            return cached->font;
     }
-    else
+
+    cached = app_calloc(1, sizeof(GFontCache));
+    if (cached == NULL)
+        return NULL;
+    
+    cached->font = _fonts_load(resource_get_handle_system(resource_id), NULL);
+    if (cached->font == NULL)
     {
-        for (uint8_t i = 0; i < 5; i++)
-        {
-            if (_cached_fonts[i].resource_id == resource_id)
-                return _cached_fonts[i].font;
-        }
+        app_free(cached);
+        return NULL;
     }
+    
+    cached->resource_id = resource_id;
+    list_init_node(&cached->node);
+    list_insert_head(&_cached_fonts, &cached->node);
 
-    uint8_t *buffer = resource_fully_load_id_system(resource_id);
-
-    GFont font = (GFont)buffer;
-
-    _cached_fonts[_cached_count].resource_id = resource_id;
-    _cached_fonts[_cached_count].font = font;
-    _cached_count++;
+    return cached->font;
+}
 
-    return font;
+/*
+ * Forget the cached system fonts. For when the app heap is about to be
+ * reset, so streamed ones (and the cache itself) are dropped, not freed
+ */
+void fonts_cache_flush(void)
+{
+    GFontCache *cached;
+    
+    list_foreach(cached, &_cached_fonts, GFontCache, node)
+    {
+        if (!n_graphics_font_is_stream(cached->font))
+            resource_unmap((const uint8_t *)cached->font);
+    }
+    
+    list_init_head(&_cached_fonts);
 }
 
 /*
  * Load a custom font
  */
-GFont *fonts_load_custom_font(ResHandle *handle, const struct file* file)
+GFont fonts_load_custom_font(ResHandle *handle, const struct file* file)
 {
     // The font is offset. account for it.
     //handle->offset += APP_FONT_START;
     
-    uint8_t *buffer = resource_fully_load_res_app(*handle, file);
-
-    return (GFont *)buffer;
+    return _fonts_load(*handle, file);
 }
 
 /*
@@ -83,7 +157,8 @@ GFont *fonts_load_custom_font(ResHandle *handle, const struct file* file)
  */
 void fonts_unload_custom_font(GFont font)
 {
-    app_free(font);
+    n_graphics_text_layout_cache_flush(font);
+    _fonts_unload(font);
 }
 
 #define EQ_FONT(font) (strncmp(key, font, strlen(key)) == 0) return font ## _ID;
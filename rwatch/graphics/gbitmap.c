@@ -10,6 +10,7 @@
 #include "flash.h"
 #include "png.h"
 #include "ngfxwrap.h"
+#include "utils.h"
 
 extern uint8_t *resource_fully_load_id_app(uint16_t, const struct file *file);
 
@@ -54,21 +55,141 @@ void gbitmap_draw(GBitmap *bitmap, GRect bounds)
     _gbitmap_draw(bitmap, bounds);
 }
 
+/*
+ * What we write to the framebuffer for each palette index, worked out
+ * once per draw. It's the colour, or 0 for transparent (an opaque colour
+ * is never 0 as its alpha bits are set)
+ */
+static uint8_t _gbitmap_lut[256];
+
+/*
+ * Put one pixel of colour argb into a framebuffer row
+ */
+static inline void _gbitmap_put(uint8_t *row, int16_t x, uint8_t argb)
+{
+#ifdef PBL_BW
+    // any colour at all is white
+    if (argb & 0b111111)
+        row[x / 8] |= (1 << (x % 8));
+    else
+        row[x / 8] &= ~(1 << (x % 8));
+#else
+    row[x] = argb;
+#endif
+}
+
+/*
+ * Draw a span of a 1, 2 or 4 bit image. Pixels are packed MSB first, as
+ * PNG has them, so pixel 0 of a 1 bit row is bit 7 (a shift of 7, not 8).
+ * bpp is always a constant, so each of these gets its own inner loop
+ */
+static inline void _gbitmap_span_packed(uint8_t *row, const uint8_t *src, int16_t x0, int16_t x1,
+                                        int16_t screen_x, const uint8_t bpp)
+{
+    const uint8_t per_byte = 8 / bpp;
+    const uint8_t mask = (1 << bpp) - 1;
+
+    for (int16_t x = x0; x < x1; x++)
+    {
+        uint8_t shift = 8 - bpp - (x % per_byte) * bpp;
+        uint8_t argb = _gbitmap_lut[(src[x / per_byte] >> shift) & mask];
+
+        if (argb)
+            _gbitmap_put(row, screen_x + x, argb);
+    }
+}
+
+/*
+ * Draw a span of an 8 bit image through the lut
+ */
+static inline void _gbitmap_span_8bit(uint8_t *row, const uint8_t *src, int16_t x0, int16_t x1,
+                                      int16_t screen_x)
+{
+    for (int16_t x = x0; x < x1; x++)
+    {
+        uint8_t argb = _gbitmap_lut[src[x]];
+
+        if (argb)
+            _gbitmap_put(row, screen_x + x, argb);
+    }
+}
+
+/*
+ * Draw a span of an 8 bit image with no palette. Those are already
+ * framebuffer colours, so if the whole span is opaque just copy it
+ */
+static inline void _gbitmap_span_raw(uint8_t *row, const uint8_t *src, int16_t x0, int16_t x1,
+                                     int16_t screen_x)
+{
+#ifndef PBL_BW
+    int16_t x = x0;
+
+    while (x < x1 && (src[x] & 0xC0) == 0xC0)
+        x++;
+
+    if (x == x1)
+    {
+        memcpy(row + screen_x + x0, src + x0, x1 - x0);
+        return;
+    }
+#endif
+    for (int16_t x = x0; x < x1; x++)
+    {
+        // alpha of 0 is transparent
+        if (src[x] & 0xC0)
+            _gbitmap_put(row, screen_x + x, src[x]);
+    }
+}
+
+/*
+ * Fill in the lut for this bitmap. Returns the bits per pixel
+ */
+static uint8_t _gbitmap_build_lut(GBitmap *bitmap)
+{
+    uint16_t colours = 0;
+    uint8_t bpp = 8;
+    
+    switch (bitmap->format)
+    {
+        case GBitmapFormat1Bit:
+            _gbitmap_lut[0] = GColorBlack.argb;
+            _gbitmap_lut[1] = GColorWhite.argb;
+            return 1;
+        case GBitmapFormat8Bit: bpp = 8; break;
+        case GBitmapFormat1BitPalette: bpp = 1; break;
+        case GBitmapFormat2BitPalette: bpp = 2; break;
+        case GBitmapFormat4BitPalette: bpp = 4; break;
+    }
+    
+    if (bitmap->palette)
+        colours = MIN(bitmap->palette_size ? bitmap->palette_size : (1 << bpp), 1 << bpp);
+    
+    // alpha offset 0 means we have a fully transparent pixel, so skip it
+    // TODO compositing
+    for (uint16_t i = 0; i < colours; i++)
+        _gbitmap_lut[i] = bitmap->palette[i].a > 0 ? bitmap->palette[i].argb : 0;
+    // anything off the end of the palette doesn't get drawn
+    for (uint16_t i = colours; i < (1 << bpp); i++)
+        _gbitmap_lut[i] = 0;
+    
+    return bpp;
+}
+
 /*
  * Mega draw. Draw based on format etc
+ * Clipping to the image, the clip rect and the screen is done once up
+ * front, and each row then gets drawn with a loop for its format
  */
 void _gbitmap_draw(GBitmap *bitmap, GRect clipping_bounds)
 {
-    uint32_t pal_idx;
-    //Decode paletized image to raw rgb values
     uint8_t *buffer = (uint8_t*)bitmap->addr;
     
+    if (buffer == NULL)
+        return;
+    
     // clip to the smallest real size of the image
-    uint16_t ctmp = (bitmap->bounds.size.w > bitmap->raw_bitmap_size.w) ? bitmap->raw_bitmap_size.w : bitmap->bounds.size.w;
-    uint16_t w = ctmp > clipping_bounds.size.w ? clipping_bounds.size.w : ctmp;
-
-    ctmp = (bitmap->bounds.size.h > bitmap->raw_bitmap_size.h) ? bitmap->raw_bitmap_size.h : bitmap->bounds.size.h;
-    uint16_t h = ctmp > clipping_bounds.size.h ? clipping_bounds.size.h : ctmp;
+    int16_t w = MIN(MIN(bitmap->bounds.size.w, bitmap->raw_bitmap_size.w), clipping_bounds.size.w);
+    int16_t h = MIN(MIN(bitmap->bounds.size.h, bitmap->raw_bitmap_size.h), clipping_bounds.size.h);
        
     // set x, y start offset for the row based on the clipping mask
     int16_t clip_y = (clipping_bounds.origin.y > bitmap->bounds.origin.y)
@@ -78,115 +199,37 @@ void _gbitmap_draw(GBitmap *bitmap, GRect clipping_bounds)
             ? clipping_bounds.origin.x - bitmap->bounds.origin.x
             : 0;
     
-    uint8_t bpp = 8;
-    switch (bitmap->format)
-    {
-        case GBitmapFormat1Bit: bpp = 1; break;
-        case GBitmapFormat8Bit: bpp = 8; break;
-        case GBitmapFormat1BitPalette: bpp = 1; break;
-        case GBitmapFormat2BitPalette: bpp = 2; break;
-        case GBitmapFormat4BitPalette: bpp = 4; break;
-    }
-    
-    clip_x = ((clip_x + ((8 / bpp) - 1)) / (8 / bpp));
-    
     int16_t newx = bitmap->bounds.origin.x;
     int16_t newy = bitmap->bounds.origin.y + clip_y;
+    
+    // and now to the screen
+    int16_t x0 = MAX(clip_x, -newx);
+    int16_t x1 = MIN(w, DISPLAY_COLS - newx);
+    int16_t y0 = MAX(0, -newy);
+    int16_t y1 = MIN(MIN(h, DISPLAY_ROWS - newy), bitmap->raw_bitmap_size.h - clip_y);
+    
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    
+    bool raw = (bitmap->format == GBitmapFormat8Bit && bitmap->palette == NULL);
+    uint8_t bpp = raw ? 8 : _gbitmap_build_lut(bitmap);
+    n_GContext *ctx = rwatch_neographics_get_global_context();
 
-    for(int y = 0; y < h; y++)
+    for (int16_t y = y0; y < y1; y++)
     {
-        uint32_t bitmap_row_start = (y + clip_y) * bitmap->row_size_bytes;
-
-        GColor argb;
+        const uint8_t *src = buffer + (y + clip_y) * bitmap->row_size_bytes;
+        uint8_t *row = ctx->fbuf + (y + newy) * __SCREEN_FRAMEBUFFER_ROW_BYTE_AMOUNT;
         
-        for(int x = clip_x; x < w; x++)
-        {   
-            /* XXX: Replace with more efficient bounds checking later. */         
-            if (((x + newx) < 0) || ((x + newx) >= DISPLAY_COLS) ||
-                ((y + newy) < 0) || ((y + newy) >= DISPLAY_ROWS))
-                continue;
-            
-            if (bitmap->format == GBitmapFormat2BitPalette)
-            {
-                // shift the bits according to their position mod
-                // I'm sure theres a more efficient way, but heres whats going on here
-                // we find the start of the bitmap buffer for this x. Becuase we get 4 colour per bytes
-                // divide x over 4. Then shift the result by the mod of x. 
-                pal_idx = (buffer[(bitmap_row_start + (x/4))]) >> (6 - (((x % 4) * 2)));
-                pal_idx &= 0x03;
-
-                // alpha offset 0 means we have an 255 alpha so skip
-                if (bitmap->palette[pal_idx].a > 0)
-                {
-                    argb = bitmap->palette[pal_idx];
-                    // TODO compositing
-                }
-                else
-                {
-                    argb.argb = 0;
-                }
-            }
-            else if (bitmap->format == GBitmapFormat4BitPalette)
-            {
-                // we read hi lo bytes depending on the odd/even bytes in the final buffer
-                // we can cheat and save the *2 on row start when we compute 4-8 bit. It doesn't affect odd/evenness
-
-                if (x % 2)
-                    pal_idx = buffer[bitmap_row_start + (x/2)] & 0xF;
-                else
-                    pal_idx = buffer[bitmap_row_start + (x/2)] >> 4;
-
-                // alpha offset 0 means we have an alpha
-                if (bitmap->palette[pal_idx].a > 0)
-                {
-                    argb = bitmap->palette[pal_idx];
-                }
-                else
-                {
-                    argb.argb = 0;
-                }
-            }
-            else if (bitmap->format == GBitmapFormat1BitPalette)
-            {
-                pal_idx = (buffer[(bitmap_row_start + (x/8))]) >> (8 - (x % 8));
-                pal_idx &= 0x01;
-
-                // alpha offset 0 means we have an 255 alpha so skip
-                if (bitmap->palette[pal_idx].a > 0)
-                {
-                    argb = bitmap->palette[pal_idx];
-                }
-                else
-                {
-                    argb.argb = 0;
-                }
-            }
-            else if (bitmap->format == GBitmapFormat8Bit)
-            {
-                pal_idx = buffer[bitmap_row_start + x];
-                if (bitmap->palette[pal_idx].a > 0)
-                    argb = bitmap->palette[pal_idx];
-                else
-                    argb.argb = 0;
-            }
-            else if (bitmap->format == GBitmapFormat1Bit)
-            {
-                pal_idx = (buffer[(bitmap_row_start + (x/8))]) >> (8 - (x % 8));
-                pal_idx &= 0x01;
-
-                if (pal_idx == 1)
-                    argb = GColorWhite;
-                else
-                    argb = GColorBlack;
-            }
-            
-            // set the pixel in the buffer.
-            if (argb.argb > 0)
-            {
-                n_GContext *ctx = rwatch_neographics_get_global_context();
-                n_graphics_set_pixel(ctx, n_GPoint(x + newx, y + newy), argb);
-            }
-        }
+        if (raw)
+            _gbitmap_span_raw(row, src, x0, x1, newx);
+        else if (bpp == 8)
+            _gbitmap_span_8bit(row, src, x0, x1, newx);
+        else if (bpp == 4)
+            _gbitmap_span_packed(row, src, x0, x1, newx, 4);
+        else if (bpp == 2)
+            _gbitmap_span_packed(row, src, x0, x1, newx, 2);
+        else
+            _gbitmap_span_packed(row, src, x0, x1, newx, 1);
     }
 }
 
@@ -259,25 +302,70 @@ void gbitmap_set_palette(GBitmap *bitmap, GColor *palette, bool free_on_destroy)
     bitmap->free_palette_on_destroy = free_on_destroy;
 }
 
+typedef struct gbitmap_png_source_t {
+    ResHandle handle;
+    const struct file *file;
+} gbitmap_png_source_t;
+
+static void _gbitmap_png_read(void *context, unsigned long offset, unsigned char *buffer, unsigned long length)
+{
+    gbitmap_png_source_t *source = (gbitmap_png_source_t *)context;
+    
+    if (source->file)
+        resource_read_res_app(source->handle, source->file, offset, buffer, length);
+    else
+        resource_read_res_system(source->handle, offset, buffer, length);
+}
+
+/*
+ * Decode a png resource. If it is mapped then it gets decoded straight out
+ * of flash, or out of the resource cache if it is small enough to be kept
+ * there. Otherwise it is read in as it is inflated, and the compressed
+ * image is never copied into the heap
+ */
+static GBitmap *_gbitmap_create_with_res(ResHandle res_handle, const struct file *file)
+{
+    const uint8_t *png_data = file ? resource_map_res_app(res_handle, file)
+                                   : resource_map_res_system(res_handle);
+    GBitmap *bitmap;
+    
+    if (png_data)
+    {
+        bitmap = gbitmap_create_from_png_data((uint8_t *)png_data, resource_size(res_handle));
+        resource_unmap(png_data);
+        return bitmap;
+    }
+    
+    gbitmap_png_source_t source = { .handle = res_handle, .file = file };
+    
+    bitmap = gbitmap_create(GRect(0, 0, 0, 0));
+    if (bitmap == NULL)
+        return NULL;
+    
+    if (!png_to_gbitmap_stream(bitmap, _gbitmap_png_read, &source, resource_size(res_handle)))
+    {
+        gbitmap_destroy(bitmap);
+        return NULL;
+    }
+    
+    return bitmap;
+}
+
 /*
  * Load a resource into the GBitmap by resource id
  */
 GBitmap *gbitmap_create_with_resource(uint32_t resource_id)
 {
-    uint8_t *png_data = resource_fully_load_id_system(resource_id);
     ResHandle res_handle = resource_get_handle_system(resource_id);
-    size_t png_data_size = resource_size(res_handle);
-        
-    return gbitmap_create_from_png_data(png_data, png_data_size);
+    
+    return _gbitmap_create_with_res(res_handle, NULL);
 }
 
 GBitmap *gbitmap_create_with_resource_app(uint32_t resource_id, const struct file *file)
 {
-    uint8_t *png_data = (uint8_t*)resource_fully_load_id_app(resource_id, file);
     ResHandle res_handle = resource_get_handle_app(resource_id, file);
-    size_t png_data_size = resource_size(res_handle);
-        
-    return gbitmap_create_from_png_data(png_data, png_data_size);
+    
+    return _gbitmap_create_with_res(res_handle, file);
 }
 
 /*
@@ -320,11 +408,17 @@ GBitmap *gbitmap_create_as_sub_bitmap(const GBitmap *base_bitmap, GRect sub_rect
  */
 GBitmap *gbitmap_create_from_png_data(uint8_t *png_data, size_t png_data_size)
 {   
-    GRect fr;
     //Allocate gbitmap
-    GBitmap *bitmap = gbitmap_create(fr);
+    GBitmap *bitmap = gbitmap_create(GRect(0, 0, 0, 0));
+    
+    if (bitmap == NULL)
+        return NULL;
 
-    png_to_gbitmap(bitmap, png_data, png_data_size);
+    if (!png_to_gbitmap(bitmap, png_data, png_data_size))
+    {
+        gbitmap_destroy(bitmap);
+        return NULL;
+    }
     
     return bitmap;
 }
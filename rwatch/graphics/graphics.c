@@ -64,6 +64,15 @@ void graphics_draw_text(
                             text_attributes);
 }
 
+GSize graphics_text_layout_get_content_size(const char * text, n_GFont const font,
+    const n_GRect box, const n_GTextOverflowMode overflow_mode,
+    const n_GTextAlignment alignment)
+{
+    return n_graphics_text_layout_get_content_size_with_attributes(text, font, box,
+                                                                   overflow_mode, alignment,
+                                                                   NULL);
+}
+
 void graphics_draw_bitmap_in_rect(GContext *ctx, GBitmap *bitmap, GRect rect)
 {
     r_graphics_draw_bitmap_in_rect(ctx, bitmap, _jimmy_layer_offset(ctx, rect));
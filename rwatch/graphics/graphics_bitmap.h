@@ -12,4 +12,5 @@
 
 struct n_GRect;
 GFont fonts_get_system_font(const char *key);
+void fonts_cache_flush(void);
 
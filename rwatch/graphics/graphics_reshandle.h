@@ -15,3 +15,5 @@ typedef struct ResHandle
 } ResHandle;
 
 ResHandle resource_get_handle(uint16_t resource_id);
+uint8_t *resource_acquire(ResHandle resource_handle);
+void resource_release(uint8_t *buffer);
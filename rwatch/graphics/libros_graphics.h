@@ -28,6 +28,10 @@ void gpath_move_to_app(n_GPath * path, n_GPoint offset);
 n_GRect _jimmy_layer_offset(n_GContext *ctx, n_GRect rect);
 n_GPoint _jimmy_layer_point_offset(n_GContext *ctx, n_GPoint point);
 
+GSize graphics_text_layout_get_content_size(const char * text, n_GFont const font,
+    const n_GRect box, const n_GTextOverflowMode overflow_mode,
+    const n_GTextAlignment alignment);
+
 GBitmap *graphics_capture_frame_buffer(n_GContext *context);
 GBitmap *graphics_capture_frame_buffer_format(n_GContext *context, GBitmap format);
 void graphics_release_frame_buffer(n_GContext *context, GBitmap *bitmap);
@@ -0,0 +1,12 @@
+#pragma once
+/* system_resource.h
+ * IDs of resources in the system resource pack
+ * libRebbleOS
+ */
+
+/*
+ * The system resources come from the stock firmware's SPI image, so there
+ * is no generated header for them. The fonts are in system_font.h; this
+ * is everything else that gets asked for by ID.
+ */
+#define RESOURCE_ID_SYSTEM_ICON           21  // small PNG icon, as in the test app
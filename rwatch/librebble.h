@@ -20,6 +20,7 @@
 #include <inttypes.h>
 
 #include "system_font.h"
+#include "system_resource.h"
 
 #include "graphics.h"
 
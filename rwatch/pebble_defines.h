@@ -19,6 +19,9 @@
 #define PBL_PLATFORM_SWITCH(tintin, snowy, chalk, diorite, emery) (snowy)
 #elif defined REBBLE_PLATFORM_CHALK
 #define PBL_PLATFORM_SWITCH(tintin, snowy, chalk, diorite, emery) (chalk)
+#elif defined REBBLE_PLATFORM_SIM
+/* the simulator uses the snowy display and flash layout */
+#define PBL_PLATFORM_SWITCH(tintin, snowy, chalk, diorite, emery) (snowy)
 #else
 #error Add the new platform to PBL_PLATFORM_SWITCH in pebble_defines.h
 #endif
@@ -10,9 +10,15 @@
 #include "FreeRTOS.h"
 #include "property_animation.h"
 
+#include <stdarg.h>
+
 #define ANIMATION_FPS 30
 #define ANIMATION_TICKS (pdMS_TO_TICKS(1000) / ANIMATION_FPS)
 
+#define ANIMATION_TYPE_PRIMITIVE 0
+#define ANIMATION_TYPE_SEQUENCE  1
+#define ANIMATION_TYPE_SPAWN     2
+
 /* XXX: The memory allocation story here is kind of a mess.  We do an
  * app_malloc on this, and store a bunch of state in the application's
  * memory -- you know, where the application could trample on it.  This is
@@ -26,6 +32,22 @@
  * But in the mean time, we're here.
  */
 
+/*
+ * All of the running animations are driven from one frame clock. Every
+ * ANIMATION_TICKS a single timer fires and every animation is stepped on
+ * to the same frame time. Their layer_mark_dirty calls all land before the
+ * window gets to draw, so they come out as one render per frame, not one
+ * per animation.
+ *
+ * Sequences and spawns are just a tree of animations under the one that
+ * was scheduled. The children have no timers or list entries of their own.
+ */
+static CoreTimer _anim_timer;
+static bool _anim_timer_queued;
+static Animation *_anim_running; /* scheduled, and waiting for the next frame */
+static Animation *_anim_frame; /* the ones still to be stepped in this frame */
+static Animation *_anim_current; /* the one being stepped right now */
+
 Animation *animation_create()
 {
     SYS_LOG("animation", APP_LOG_LEVEL_INFO, "animation_create");
@@ -51,72 +73,403 @@ bool animation_destroy(Animation *anim)
     return true;
 }
 
+static void _animation_remove(Animation *anim);
+
 void animation_dtor(Animation* animation)
 {
+    if (animation->scheduled)
+        _animation_remove(animation);
+    
+    if (animation->children)
+        app_free(animation->children);
+    animation->children = NULL;
 }
 
-void _animation_update(Animation *anim)
+static Animation *_animation_complex_create(uint8_t type, Animation **animations, uint32_t count)
 {
-    if (anim->onqueue)
-        appmanager_timer_remove(&anim->timer);
+    if (count == 0 || count > ANIMATION_MAX_CHILDREN)
+        return NULL;
     
-    TickType_t now = xTaskGetTickCount();
+    for (uint32_t i = 0; i < count; i++)
+        if (!animations[i])
+            return NULL;
     
-    anim->timer.when = now + ANIMATION_TICKS;
-    if (anim->duration == ANIMATION_DURATION_INFINITE) {
-        anim->onqueue = 1;
-        appmanager_timer_add(&anim->timer);
-        return;
+    Animation *anim = animation_create();
+    if (!anim)
+        return NULL;
+    
+    anim->children = app_calloc(count, sizeof(Animation *));
+    if (!anim->children) {
+        app_free(anim);
+        return NULL;
     }
     
-    TickType_t progress = now - anim->startticks;
-    if (progress > anim->duration) {
-        /* Ok, we're done. */
-        if (anim->impl.update)
-            anim->impl.update(anim, ANIMATION_NORMALIZED_MAX);
-        if (anim->impl.teardown)
-            anim->impl.teardown(anim);            
+    memcpy(anim->children, animations, count * sizeof(Animation *));
+    anim->child_count = count;
+    anim->type = type;
+    
+    return anim;
+}
+
+/* Gather up a NULL terminated list of arguments. Returns one too many if
+ * there are too many, so the create fails */
+#define ANIMATION_COLLECT(animations, count, a, b, c) \
+    do { \
+        Animation *_next = (a); \
+        va_list _args; \
+        va_start(_args, c); \
+        for (uint8_t _i = 0; _next && count <= ANIMATION_MAX_CHILDREN; _i++) { \
+            animations[count++] = _next; \
+            _next = _i == 0 ? (b) : _i == 1 ? (c) : va_arg(_args, Animation *); \
+        } \
+        va_end(_args); \
+    } while (0)
+
+/*
+ * Play the animations one after the other. Each one's delay is counted
+ * from when the one before it finished
+ */
+Animation *animation_sequence_create(Animation *animation_a, Animation *animation_b, Animation *animation_c, ...)
+{
+    Animation *animations[ANIMATION_MAX_CHILDREN + 1];
+    uint32_t count = 0;
+    
+    ANIMATION_COLLECT(animations, count, animation_a, animation_b, animation_c);
+    
+    return animation_sequence_create_from_array(animations, count);
+}
+
+Animation *animation_sequence_create_from_array(Animation **animation_array, uint32_t array_len)
+{
+    return _animation_complex_create(ANIMATION_TYPE_SEQUENCE, animation_array, array_len);
+}
+
+/*
+ * Play the animations all at once. It is done when the longest one is
+ */
+Animation *animation_spawn_create(Animation *animation_a, Animation *animation_b, Animation *animation_c, ...)
+{
+    Animation *animations[ANIMATION_MAX_CHILDREN + 1];
+    uint32_t count = 0;
+    
+    ANIMATION_COLLECT(animations, count, animation_a, animation_b, animation_c);
+    
+    return animation_spawn_create_from_array(animations, count);
+}
+
+Animation *animation_spawn_create_from_array(Animation **animation_array, uint32_t array_len)
+{
+    return _animation_complex_create(ANIMATION_TYPE_SPAWN, animation_array, array_len);
+}
+
+/* Work out how long an animation takes, children and all. When it is
+ * about to be scheduled, also ready them all for a fresh run, and note down
+ * their lengths while they all still exist */
+static TickType_t _animation_measure(Animation *anim, bool prepare)
+{
+    TickType_t total = 0;
+    
+    if (prepare) {
+        anim->started = false;
+        anim->current = 0;
+        anim->offset = 0;
+        anim->done = 0;
+    }
+    
+    if (anim->type == ANIMATION_TYPE_PRIMITIVE) {
+        total = anim->duration;
+    } else {
+        for (uint8_t i = 0; i < anim->child_count; i++) {
+            TickType_t child = _animation_measure(anim->children[i], prepare);
+            
+            if (total == ANIMATION_DURATION_INFINITE || child == ANIMATION_DURATION_INFINITE)
+                total = ANIMATION_DURATION_INFINITE;
+            else if (anim->type == ANIMATION_TYPE_SEQUENCE)
+                total += child;
+            else if (child > total)
+                total = child;
+        }
+    }
+    
+    if (total != ANIMATION_DURATION_INFINITE)
+        total += anim->delay;
+    if (prepare)
+        anim->total = total;
+    
+    return total;
+}
+
+static bool _animation_advance(Animation *anim, TickType_t elapsed);
+static void _animation_frame(CoreTimer *timer);
+
+static bool _animation_advance_sequence(Animation *seq, TickType_t elapsed)
+{
+    while (seq->current < seq->child_count) {
+        Animation *child = seq->children[seq->current];
+        /* read it now, the teardown is free to destroy the child */
+        TickType_t total = child->total;
+        bool finished = _animation_advance(child, elapsed - seq->offset);
+        
+        if (!_anim_current || !finished)
+            return finished;
         
+        /* the next one starts when this one was due to end, not when we
+         * got round to noticing */
+        seq->offset += total;
+        seq->current++;
+    }
+    
+    return true;
+}
+
+static bool _animation_advance_spawn(Animation *spawn, TickType_t elapsed)
+{
+    uint32_t all = UINT32_MAX >> (32 - spawn->child_count);
+    
+    for (uint8_t i = 0; i < spawn->child_count; i++) {
+        if (spawn->done & (1UL << i))
+            continue;
+        
+        if (_animation_advance(spawn->children[i], elapsed))
+            spawn->done |= 1UL << i;
+        if (!_anim_current)
+            return true;
+    }
+    
+    return spawn->done == all;
+}
+
+/*
+ * Step an animation on to 'elapsed' ticks since its parent started it.
+ * Returns true once it has finished. Any of the callbacks can unschedule
+ * the lot; if _anim_current has gone, get straight out without touching
+ * anything, as it may well have been freed.
+ */
+static bool _animation_advance(Animation *anim, TickType_t elapsed)
+{
+    if (elapsed < anim->delay)
+        return false;
+    elapsed -= anim->delay;
+    
+    if (anim->type == ANIMATION_TYPE_SEQUENCE)
+        return _animation_advance_sequence(anim, elapsed);
+    if (anim->type == ANIMATION_TYPE_SPAWN)
+        return _animation_advance_spawn(anim, elapsed);
+    
+    if (!anim->started) {
+        anim->started = true;
+        if (anim->impl.setup) {
+            anim->impl.setup(anim);
+            if (!_anim_current)
+                return true;
+        }
+    }
+    
+    if (anim->duration == ANIMATION_DURATION_INFINITE)
+        return false;
+    
+    if (elapsed < anim->duration) {
+        if (anim->impl.update)
+            anim->impl.update(anim, (uint32_t)((uint64_t)elapsed * ANIMATION_NORMALIZED_MAX / anim->duration));
+        return false;
+    }
+    
+    /* Ok, we're done. */
+    if (anim->impl.update) {
+        anim->impl.update(anim, ANIMATION_NORMALIZED_MAX);
+        if (!_anim_current)
+            return true;
+    }
+    
+    /* the teardown can free it, so it stops being ours first */
+    if (anim == _anim_current) {
         anim->scheduled = 0;
-        return;
+        _anim_current = NULL;
     }
+    if (anim->impl.teardown)
+        anim->impl.teardown(anim);
     
-    progress *= ANIMATION_NORMALIZED_MAX;
-    progress /= anim->duration;
+    return true;
+}
+
+static void _animation_queue_frame(TickType_t when)
+{
+    _anim_timer.when = when;
+    _anim_timer.callback = _animation_frame;
+    appmanager_timer_add(&_anim_timer);
+    _anim_timer_queued = true;
+}
+
+static void _animation_frame(CoreTimer *timer)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t next = timer->when + ANIMATION_TICKS;
+    Animation *anim;
     
-    if (anim->impl.update)
-        anim->impl.update(anim, (uint32_t) progress);
+    /* Anything scheduled from a callback goes on the running list, and
+     * the frame is queued once we are done here */
+    _anim_timer_queued = true;
+    _anim_frame = _anim_running;
+    _anim_running = NULL;
     
-    anim->onqueue = 1;
-    appmanager_timer_add(&anim->timer);
+    while ((anim = _anim_frame)) {
+        _anim_frame = anim->next;
+        anim->next = NULL;
+        
+        _anim_current = anim;
+        bool finished = _animation_advance(anim, now - anim->startticks);
+        
+        /* unscheduled, or finished and torn down, by a callback */
+        if (!_anim_current)
+            continue;
+        _anim_current = NULL;
+        
+        if (finished) {
+            anim->scheduled = 0;
+        } else {
+            anim->next = _anim_running;
+            _anim_running = anim;
+        }
+    }
+    
+    _anim_timer_queued = false;
+    if (_anim_running) {
+        /* keep to the frame clock, unless we have fallen behind it */
+        if (!TICK_AFTER(next, now))
+            next = now + ANIMATION_TICKS;
+        _animation_queue_frame(next);
+    }
 }
 
-void _anim_callback(CoreTimer *timer)
+static bool _animation_unlink(Animation **head, Animation *anim)
 {
-    Animation *anim = (Animation *) timer;
+    for (; *head; head = &(*head)->next) {
+        if (*head == anim) {
+            *head = anim->next;
+            anim->next = NULL;
+            return true;
+        }
+    }
     
-    anim->onqueue = 0;
-    _animation_update(anim);
+    return false;
+}
+
+/* Take it off the scheduler, wherever it has got to */
+static void _animation_remove(Animation *anim)
+{
+    if (anim == _anim_current)
+        _anim_current = NULL;
+    else if (!_animation_unlink(&_anim_running, anim))
+        _animation_unlink(&_anim_frame, anim);
+    
+    anim->scheduled = 0;
+}
+
+/* Tear down every part of it that hasn't finished yet */
+static void _animation_stop(Animation *anim)
+{
+    if (anim->type == ANIMATION_TYPE_PRIMITIVE) {
+        if (anim->impl.teardown)
+            anim->impl.teardown(anim);
+        return;
+    }
+    
+    for (uint8_t i = 0; i < anim->child_count; i++) {
+        if (anim->type == ANIMATION_TYPE_SEQUENCE && i < anim->current)
+            continue;
+        if (anim->type == ANIMATION_TYPE_SPAWN && (anim->done & (1UL << i)))
+            continue;
+        _animation_stop(anim->children[i]);
+    }
 }
 
 bool animation_schedule(Animation *anim)
 {
     SYS_LOG("animation", APP_LOG_LEVEL_INFO, "animation scheduled");
-    if (anim->impl.setup)
-        anim->impl.setup(anim);
     
-    if (anim->onqueue)
-        appmanager_timer_remove(&anim->timer);
-        
+    if (!anim)
+        return false;
+    
+    /* scheduling it again starts it over */
+    if (anim->scheduled)
+        _animation_remove(anim);
+    
+    _animation_measure(anim, true);
     anim->startticks = xTaskGetTickCount();
     anim->scheduled = 1;
+    anim->next = _anim_running;
+    _anim_running = anim;
+    
+    /* the first frame goes out straight away */
+    if (!_anim_timer_queued)
+        _animation_queue_frame(anim->startticks);
+    
+    return true;
+}
+
+bool animation_unschedule(Animation *anim)
+{
+    if (!anim || !anim->scheduled)
+        return false;
     
-    anim->timer.callback = _anim_callback;
-    _animation_update(anim);
+    _animation_remove(anim);
+    _animation_stop(anim);
     
     return true;
 }
 
+void animation_unschedule_all(void)
+{
+    if (_anim_current)
+        animation_unschedule(_anim_current);
+    while (_anim_frame)
+        animation_unschedule(_anim_frame);
+    while (_anim_running)
+        animation_unschedule(_anim_running);
+}
+
+bool animation_is_scheduled(Animation *anim)
+{
+    return anim && anim->scheduled;
+}
+
+/*
+ * Forget about everything without calling anyone back. For when the app
+ * that owned the animations (and the timer wheel) is gone
+ */
+void animation_scheduler_reset(void)
+{
+    _anim_running = _anim_frame = _anim_current = NULL;
+    _anim_timer_queued = false;
+}
+
+void animation_set_delay(Animation *anim, uint32_t delay)
+{
+    if (anim)
+        anim->delay = pdMS_TO_TICKS(delay);
+}
+
+uint32_t animation_get_delay(Animation *anim)
+{
+    return anim ? anim->delay * portTICK_PERIOD_MS : 0;
+}
+
+uint32_t animation_get_duration(Animation *anim, bool include_delay, bool include_play_count)
+{
+    TickType_t total;
+    
+    if (!anim)
+        return 0;
+    
+    total = _animation_measure(anim, false);
+    if (total == ANIMATION_DURATION_INFINITE)
+        return ANIMATION_DURATION_INFINITE;
+    if (!include_delay)
+        total -= anim->delay;
+    
+    return total * portTICK_PERIOD_MS;
+}
+
 bool animation_set_duration(Animation *anim, uint32_t ms)
 {
     if (!anim)
@@ -135,12 +488,15 @@ bool animation_set_implementation(Animation *anim, const AnimationImplementation
         return false;
     
     anim->impl = *impl;
+#ifndef REBBLE_PLATFORM_SIM
+    // everything we call is Thumb code; the host has no Thumb bit to set
     if (anim->impl.setup)
         anim->impl.setup = (void *)(((uint32_t)anim->impl.setup) | 1);
     if (anim->impl.update)
         anim->impl.update = (void *)(((uint32_t)anim->impl.update) | 1);
     if (anim->impl.teardown)
         anim->impl.teardown = (void *)(((uint32_t)anim->impl.teardown) | 1);
+#endif
 
     return true;
 }
@@ -19,6 +19,9 @@
 #define ANIMATION_NORMALIZED_MIN 0 
 #define ANIMATION_NORMALIZED_MAX 65535
 
+/* a sequence or spawn holds at most this many animations */
+#define ANIMATION_MAX_CHILDREN 32
+
 struct Animation;
 typedef struct PropertyAnimation PropertyAnimation;
 
@@ -51,14 +54,24 @@ typedef void (*AnimationStoppedHandler)(struct Animation *animation, bool finish
 // animation
 typedef struct Animation
 {
-    CoreTimer timer;
+    struct Animation *next; /* on the scheduler's list of running animations */
     
     int scheduled;
-    int onqueue;
+    bool started; /* setup has been called for this run */
+    uint8_t type;
     TickType_t duration;
+    TickType_t delay;
     TickType_t startticks;
+    TickType_t total; /* delay and duration, children and all, as of schedule */
     AnimationImplementation impl;
     struct AnimationHandler *anim_handlers;
+    
+    /* sequences and spawns */
+    struct Animation **children;
+    uint8_t child_count;
+    uint8_t current; /* sequence: the child that is playing */
+    TickType_t offset; /* sequence: when the current child started */
+    uint32_t done; /* spawn: the children that have finished */
 } Animation;
 
 typedef struct AnimationHandler
@@ -101,3 +114,4 @@ bool animation_schedule(Animation *anim);
 bool animation_unschedule(Animation *animation);
 void animation_unschedule_all(void);
 bool animation_is_scheduled(Animation *animation);
+void animation_scheduler_reset(void);
@@ -12,7 +12,8 @@ static void _layer_remove_node(Layer *to_be_removed);
 static void _layer_insert_node(Layer *layer_to_insert, Layer *sibling_layer, bool below);
 static void _layer_delete_tree(Layer *layer);
 static Layer *_layer_find_parent(Layer *orig_layer, Layer *layer);
-static void _layer_walk(/*const*/ Layer *layer, GContext *context);
+static void _layer_walk(Layer *layer, GContext *context, const GRect *dirty);
+static bool _layer_expand_dirty(const Layer *layer, GPoint origin, GRect *dirty);
 
 // Layer Functions
 Layer *layer_create(GRect frame)
@@ -108,10 +109,13 @@ void layer_add_child(Layer *parent_layer, Layer *child_layer)
     layer_mark_dirty(parent_layer);
 }
 
+/*
+ * Schedule a redraw of the part of the screen this layer covers
+ */
 void layer_mark_dirty(Layer *layer)
 {
     //layer->window
-    window_dirty(true);
+    window_dirty_rect(layer_convert_rect_to_screen(layer, GRect(0, 0, layer->frame.size.w, layer->frame.size.h)));
 }
 
 void layer_set_bounds(Layer *layer, GRect bounds)
@@ -134,11 +138,17 @@ GPoint layer_convert_point_to_screen(const Layer *layer, GPoint point)
     {
         point = GPoint(point.x + current_layer->frame.origin.x,
                        point.y + current_layer->frame.origin.y);
-        current_layer = layer->parent;
+        current_layer = current_layer->parent;
     } 
     return point;
 }
 
+GRect layer_convert_rect_to_screen(const Layer *layer, GRect rect)
+{
+    rect.origin = layer_convert_point_to_screen(layer, rect.origin);
+    return rect;
+}
+
 GPoint layer_get_bounds_origin(Layer* layer)
 {
     return layer->bounds.origin;
@@ -154,6 +164,8 @@ void layer_set_bounds_origin(Layer* layer, GPoint origin) {
 void layer_set_frame(Layer *layer, GRect frame)
 {
     if (!RECT_EQ(layer->frame, frame)) {
+        // the old position needs clearing up too
+        layer_mark_dirty(layer);
         layer->frame = frame;
         layer_mark_dirty(layer);
     }
@@ -171,6 +183,7 @@ struct Window *layer_get_window(const Layer *layer)
 
 void layer_remove_from_parent(Layer *child)
 {
+    layer_mark_dirty(child);
     _layer_remove_node(child);
 }
 
@@ -191,6 +204,8 @@ void layer_insert_above_sibling(Layer *layer_to_insert, Layer *above_sibling_lay
 
 void layer_set_hidden(Layer *layer, bool hidden)
 {
+    if (layer->hidden != hidden)
+        layer_mark_dirty(layer);
     layer->hidden = hidden;
 }
 
@@ -199,9 +214,35 @@ bool layer_get_hidden(const Layer *layer)
     return layer->hidden;
 }
 
-void layer_draw(const Layer *layer, GContext *context)
+/*
+ * Draw the layer and all of its children.
+ * The layer isn't const, as each update_proc is handed it to draw
+ */
+void layer_draw(Layer *layer, GContext *context)
 {
-    _layer_walk(layer, context);
+    _layer_walk(layer, context, NULL);
+}
+
+/*
+ * Grow dirty (in screen coordinates) to cover every drawing layer that it
+ * overlaps. origin is the screen position of layer's parent.
+ * We don't clip drawing, so a layer that gets redrawn paints over the whole
+ * of its frame, including bits of other layers outside of dirty. Growing
+ * the rect until nothing else overlaps it means everything inside it can
+ * be cleared and redrawn safely, assuming layers draw inside their frames.
+ */
+void layer_expand_dirty_rect(const Layer *layer, GPoint origin, GRect *dirty)
+{
+    while (_layer_expand_dirty(layer, origin, dirty))
+        ;
+}
+
+/*
+ * Like layer_draw, but only redraw the layers that overlap dirty
+ */
+void layer_draw_rect(Layer *layer, GContext *context, const GRect *dirty)
+{
+    _layer_walk(layer, context, dirty);
 }
 
 void layer_apply_frame_offset(const Layer *layer, GContext *context)
@@ -268,7 +309,7 @@ static void _layer_remove_node(Layer *to_be_removed)
  * When exhaused it will walk the siblings of the parent, etc etc until
  * either 1) no more ram 2) completion
  */
-static void _layer_walk(/*const*/ Layer *layer, GContext *context)
+static void _layer_walk(Layer *layer, GContext *context, const GRect *dirty)
 {
     if (layer)
     {
@@ -277,16 +318,55 @@ static void _layer_walk(/*const*/ Layer *layer, GContext *context)
             GRect previous_offset = context->offset;
             layer_apply_frame_offset(layer, context);
 
-            if (layer->update_proc)
+            GRect screen = GRect(context->offset.origin.x, context->offset.origin.y,
+                                 layer->frame.size.w, layer->frame.size.h);
+            
+            if (layer->update_proc && (!dirty || RECT_INTERSECTS(screen, *dirty)))
                 layer->update_proc(layer, context);
 
             // walk this elements sub elements recursively before moving on to the next element
-            _layer_walk(layer->child, context);
+            // children aren't clipped to their parent, so always look at them
+            _layer_walk(layer->child, context, dirty);
 
             context->offset = previous_offset; // restore offset
         }
-        _layer_walk(layer->sibling, context);
+        _layer_walk(layer->sibling, context, dirty);
+    }
+}
+
+/*
+ * Grow dirty to cover any drawing layer that overlaps it.
+ * origin is the screen position of layer's parent.
+ * Returns true if dirty changed.
+ */
+static bool _layer_expand_dirty(const Layer *layer, GPoint origin, GRect *dirty)
+{
+    bool grown = false;
+    
+    for (; layer; layer = layer->sibling)
+    {
+        if (layer->hidden)
+            continue;
+        
+        GRect screen = GRect(origin.x + layer->frame.origin.x, origin.y + layer->frame.origin.y,
+                             layer->frame.size.w, layer->frame.size.h);
+        
+        if (layer->update_proc && RECT_INTERSECTS(screen, *dirty))
+        {
+            GRect grown_rect = rect_union(*dirty, screen);
+            
+            if (!RECT_EQ(grown_rect, *dirty))
+            {
+                *dirty = grown_rect;
+                grown = true;
+            }
+        }
+        
+        if (_layer_expand_dirty(layer->child, screen.origin, dirty))
+            grown = true;
     }
+    
+    return grown;
 }
 
 static Layer *_layer_find_parent(Layer *orig_layer, Layer *layer)
@@ -51,7 +51,7 @@ GPoint layer_convert_point_to_screen(const Layer *layer, GPoint point);
 GPoint layer_get_bounds_origin(Layer* layer); // Not in the original API, but necessary for property_animation
 void layer_set_bounds_origin(Layer* layer, GPoint origin);
 GPoint layer_convert_point_to_screen(const Layer *layer, GPoint point); //TODO
-GRect layer_convert_rect_to_screen(const Layer *layer, GRect rect); //TODO
+GRect layer_convert_rect_to_screen(const Layer *layer, GRect rect);
 struct Window *layer_get_window(const Layer *layer);
 void layer_remove_from_parent(Layer *child);
 void layer_remove_child_layers(Layer *parent);
@@ -62,7 +62,9 @@ bool layer_get_hidden(const Layer *layer);
 void layer_set_clips(Layer *layer, bool clips);  //TODO
 bool layer_get_clips(const Layer *layer); //TODO
 void *layer_get_data(const Layer *layer); //TODO
-void layer_draw(const Layer *layer, GContext *context);
+void layer_draw(Layer *layer, GContext *context);
+void layer_expand_dirty_rect(const Layer *layer, GPoint origin, GRect *dirty);
+void layer_draw_rect(Layer *layer, GContext *context, const GRect *dirty);
 // updates context offset based on layer frame, used to properly adjust layer drawing calls
 void layer_apply_frame_offset(const Layer *layer, GContext *context);
 
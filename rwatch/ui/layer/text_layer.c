@@ -42,6 +42,8 @@ Layer *text_layer_get_layer(TextLayer *text_layer)
 
 void text_layer_set_text(TextLayer *text_layer, const char* text)
 {
+    // the old layout is no good now, even if the pointer is the same
+    n_graphics_text_layout_cache_invalidate(text_layer->text);
     text_layer->text = text;
     layer_mark_dirty(text_layer->layer);
 }
@@ -71,6 +73,7 @@ void text_layer_set_overflow_mode(TextLayer *text_layer, GTextOverflowMode line_
 
 void text_layer_set_font(TextLayer * text_layer, GFont font)
 {   
+    n_graphics_text_layout_cache_invalidate(text_layer->text);
     text_layer->font = font;
     layer_mark_dirty(text_layer->layer);
 }
@@ -81,9 +84,17 @@ void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_al
     layer_mark_dirty(text_layer->layer);
 }
 
+/*
+ * The size the text takes up when laid out in the layer.
+ * The layout is cached, so the next draw gets it for free
+ */
 GSize text_layer_get_content_size(TextLayer *text_layer)
 {
-    return text_layer->layer->bounds.size;
+    GRect bounds = GRect(0, 0, text_layer->layer->frame.size.w, text_layer->layer->frame.size.h);
+
+    return graphics_text_layout_get_content_size(text_layer->text, text_layer->font,
+                                                 bounds, text_layer->overflow_mode,
+                                                 text_layer->text_alignment);
 }
 
 void text_layer_set_size(TextLayer *text_layer, const GSize max_size)
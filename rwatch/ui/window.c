@@ -9,6 +9,7 @@
 #include "librebble.h"
 #include "ngfxwrap.h"
 #include "node_list.h"
+#include "utils.h"
 
 static list_head _window_list_head = LIST_HEAD(_window_list_head);
 
@@ -194,7 +195,6 @@ void window_destroy(Window *window)
     
     /* Clean up the clink handler and remap back to our current window */
     _window_load_click_config(window);
-    window_draw();
     window_dirty(true);
 }
 
@@ -215,18 +215,41 @@ Layer *window_get_root_layer(Window *window)
  */
 void window_dirty(bool is_dirty)
 {
+    if (is_dirty)
+    {
+        window_dirty_rect(GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS));
+        return;
+    }
+    
     Window *wind = window_stack_get_top_window();
     
     if (wind == NULL)
         return;
     
-    if (wind->is_render_scheduled != is_dirty)
-    {
-        wind->is_render_scheduled = is_dirty;
-        
-        if (is_dirty)
-            appmanager_post_draw_message();
-    }
+    wind->is_render_scheduled = false;
+    wind->dirty_rect = GRect(0, 0, 0, 0);
+}
+
+/*
+ * Invalidate part of the screen. The window gathers up all of the dirty
+ * bits until it next draws, and then only redraws that part
+ */
+void window_dirty_rect(GRect rect)
+{
+    Window *wind = window_stack_get_top_window();
+    
+    if (wind == NULL)
+        return;
+    
+    rect = rect_intersection(rect, GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS));
+    if (RECT_IS_EMPTY(rect))
+        return;
+    
+    wind->dirty_rect = rect_union(wind->dirty_rect, rect);
+    wind->is_render_scheduled = true;
+    
+    // the app manager folds these into one pending draw
+    appmanager_post_draw_message();
 }
 
 void window_draw()
@@ -239,14 +262,25 @@ void window_draw()
     {
         GContext *context = rwatch_neographics_get_global_context();
         GRect frame = layer_get_frame(wind->root_layer);
+        GRect dirty = wind->dirty_rect;
+        
+        // anything marked dirty while we draw is for the next frame
+        wind->is_render_scheduled = false;
+        wind->dirty_rect = GRect(0, 0, 0, 0);
+        
+        // a moved root layer (i.e. mid-animation) is drawn in full
+        if (frame.origin.x != 0 || frame.origin.y != 0 || RECT_IS_EMPTY(dirty))
+            dirty = GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS);
+        
+        layer_expand_dirty_rect(wind->root_layer, frame.origin, &dirty);
+        dirty = rect_intersection(dirty, GRect(0, 0, DISPLAY_COLS, DISPLAY_ROWS));
+        
         context->offset = frame;
         context->fill_color = wind->background_color;
-        graphics_fill_rect(context, GRect(0, 0, frame.size.w, frame.size.h), 0, GCornerNone);
-        
-        layer_draw(wind->root_layer, context);
+        graphics_fill_rect(context, dirty, 0, GCornerNone);
+        layer_draw_rect(wind->root_layer, context, &dirty);
         
-        rbl_draw();
-        wind->is_render_scheduled = false;
+        display_draw_rect(dirty.origin.x, dirty.origin.y, dirty.size.w, dirty.size.h);
     }
 }
 
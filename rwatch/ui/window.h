@@ -49,6 +49,7 @@ typedef struct Window
     void *user_data;
     GColor background_color;
     bool is_render_scheduled;
+    GRect dirty_rect; // screen area to redraw when is_render_scheduled
     //bool on_screen : 1;
     bool is_loaded;
     //bool overrides_back_button : 1;
@@ -84,5 +85,6 @@ bool window_stack_remove(Window *window, bool animated);
 bool window_stack_contains_window(Window *window);
 Window * window_stack_get_top_window(void);
 void window_dirty(bool is_dirty);
+void window_dirty_rect(GRect rect);
 void window_draw();
 uint16_t window_count(void);